@@ -0,0 +1,108 @@
+# Measures how long a node takes to reconnect to its MQTT broker, to compare
+# full TLS handshakes with resumed ones.
+#
+# Usage:
+#   python .bench_mqtt_reconnect.py [--user U --password P] [--cycles N] http://node ADDRESS ADDRESS
+#
+# The node only reconnects when its MQTT settings change, so each cycle
+# switches mqtt_server between two addresses of the same broker (e.g. its
+# hostname and its IP). With fingerprint pinning both pass verification;
+# with a CA certificate only names on the certificate do. Each switch
+# recreates the client, which keeps the TLS session, and /about reports the
+# duration of the connect, handshake included.
+#
+# Reboot the node first: its connect at boot is then a full handshake and the
+# cycles after it should resume. For a baseline, run the same cycles with
+# mqtt_tls off. A local Mosquitto TLS listener is enough, e.g.:
+#
+#   listener 8883
+#   certfile server.crt
+#   keyfile server.key
+#   allow_anonymous true
+
+import argparse
+import base64
+import json
+import sys
+import time
+
+try:
+    from urllib.request import Request, urlopen
+except ImportError:
+    from urllib2 import Request, urlopen
+
+# /about is cached for a second.
+POLL_INTERVAL = 1.1
+CONNECT_TIMEOUT = 30
+
+def request(url, args, body=None, method=None):
+    req = Request(url, data=json.dumps(body).encode("utf-8") if body is not None else None)
+
+    if body is not None:
+        req.add_header("Content-Type", "application/json")
+    if method:
+        req.get_method = lambda: method
+
+    if args.user:
+        token = base64.b64encode(("%s:%s" % (args.user, args.password or "")).encode("utf-8"))
+        req.add_header("Authorization", "Basic " + token.decode("ascii"))
+
+    body = urlopen(req, timeout=10).read().decode("utf-8")
+    return json.loads(body) if body.startswith("{") else body
+
+def reconnect(args, server):
+    node = args.node.rstrip("/")
+    request(node + "/settings", args, {"mqtt_server": server}, "PUT")
+
+    deadline = time.time() + CONNECT_TIMEOUT
+    while time.time() < deadline:
+        time.sleep(POLL_INTERVAL)
+        mqtt = request(node + "/about", args).get("mqtt", {})
+
+        # A fresh client starts counting from zero.
+        if mqtt.get("connects", 0) > 0:
+            return mqtt
+        if mqtt.get("failures", 0) > 0:
+            raise Exception("Node failed to connect to %s" % server)
+
+    raise Exception("Node didn't connect to %s within %ds" % (server, CONNECT_TIMEOUT))
+
+def summarize(label, values):
+    if not values:
+        return
+    values = sorted(values)
+    sys.stderr.write("%s: n=%d min=%dms median=%dms max=%dms\n" % (
+        label, len(values), values[0], values[len(values) // 2], values[-1]))
+
+def main():
+    parser = argparse.ArgumentParser(description="Benchmark a dash_stadium node's MQTT reconnects.")
+    parser.add_argument("node", help="e.g. http://192.168.4.1")
+    parser.add_argument("servers", nargs=2, metavar="ADDRESS", help="two addresses of the same broker")
+    parser.add_argument("--cycles", type=int, default=10)
+    parser.add_argument("--user")
+    parser.add_argument("--password")
+    args = parser.parse_args()
+
+    node = args.node.rstrip("/")
+    original = request(node + "/settings", args).get("mqtt_server")
+    boot = request(node + "/about", args).get("mqtt", {})
+    durations = []
+
+    if boot.get("connects") != 1:
+        sys.stderr.write("Node has reconnected since it booted, its first connect isn't known\n")
+
+    try:
+        for cycle in range(args.cycles):
+            mqtt = reconnect(args, args.servers[cycle % 2])
+            durations.append(mqtt["last_connect_ms"])
+            print(json.dumps(dict(mqtt, cycle=cycle)))
+    finally:
+        if original:
+            request(node + "/settings", args, {"mqtt_server": original}, "PUT")
+
+    if boot.get("connects") == 1:
+        summarize("connect at boot", [boot["last_connect_ms"]])
+    summarize("reconnects", durations)
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,97 @@
+# Generates dist/baked_config.h from a settings file, for builds with
+# -DDASH_BAKED_CONFIG.
+#
+# Usage: python .build_config.py config.json > dist/baked_config.h
+#
+# config.json has the same format as GET /settings. The output is an image of
+# the settings arena (see lib/Settings/SettingsArena.h) that is copied out of
+# flash in one go at boot, so nothing has to be read from SPIFFS or parsed.
+# Changes made at runtime are still journaled and applied on top of it.
+#
+# The output contains any passwords in the input. Don't commit it.
+
+import json
+import struct
+import sys
+
+# Must match Settings::FIELD_KEYS, and the defaults in the Settings
+# constructor.
+STRING_FIELDS = [
+    ("admin_username", ""),
+    ("admin_password", ""),
+    ("mqtt_server", ""),
+    ("mqtt_username", ""),
+    ("mqtt_password", ""),
+    ("mqtt_topic_pattern", ""),
+    ("mqtt_tls_fingerprint", ""),
+    ("ap_name", "DashStadium"),
+    ("ap_password", "qu3c2ER9Ddl"),
+]
+
+NUMERIC_FIELDS = [
+    ("mqtt_tls", "BAKED_CONFIG_MQTT_TLS", False),
+    ("debounce_threshold_ms", "BAKED_CONFIG_DEBOUNCE_THRESHOLD_MS", 0),
+    ("cluster_claim_window_ms", "BAKED_CONFIG_CLUSTER_CLAIM_WINDOW_MS", 0),
+    ("fleet_enabled", "BAKED_CONFIG_FLEET_ENABLED", False),
+    ("fleet_version", "BAKED_CONFIG_FLEET_VERSION", 0),
+]
+
+def parse_mac(s):
+    return bytes(bytearray(int(b, 16) for b in s.split(":")))
+
+def c_value(v):
+    if isinstance(v, bool):
+        return "true" if v else "false"
+    return "%d" % v
+
+def build_arena(config):
+    strings = [config.get(k, default) or "" for k, default in STRING_FIELDS]
+
+    # Kept in file order, same as when the JSON is loaded at runtime, so device
+    # indexes (and the warm state's device table hash) match between builds.
+    devices = [
+        (parse_mac(d[0]), d[1] if len(d) > 1 and d[1] else "")
+        for d in config.get("monitored_macs", [])
+    ]
+
+    pool = b""
+    offsets = []
+    for s in strings + [alias for _, alias in devices]:
+        offsets.append(len(pool))
+        pool += s.encode("utf-8") + b"\0"
+
+    if len(pool) > 0xFFFF:
+        raise Exception("Settings don't fit in 16-bit arena offsets")
+
+    arena = struct.pack("<%dH" % len(offsets), *offsets)
+    arena += b"".join(mac for mac, _ in devices)
+    arena += pool
+
+    return arena, len(devices)
+
+def main(args):
+    with open(args[0]) as f:
+        config = json.load(f)
+
+    arena, num_devices = build_arena(config)
+
+    out = sys.stdout
+    out.write("// Generated by .build_config.py. Do not edit.\n")
+    out.write("// %d devices, %d bytes of flash.\n\n" % (num_devices, len(arena)))
+    out.write("#include <Arduino.h>\n\n")
+    out.write("#ifndef _BAKED_CONFIG_H\n#define _BAKED_CONFIG_H\n\n")
+    out.write("#define BAKED_CONFIG_NUM_STRINGS %d\n" % len(STRING_FIELDS))
+    out.write("#define BAKED_CONFIG_NUM_DEVICES %d\n" % num_devices)
+    out.write("#define BAKED_CONFIG_ARENA_SIZE %d\n" % len(arena))
+    for key, name, default in NUMERIC_FIELDS:
+        out.write("#define %s %s\n" % (name, c_value(config.get(key, default))))
+    out.write("\n")
+
+    out.write("const uint8_t BAKED_CONFIG_ARENA[] PROGMEM = {\n")
+    data = bytearray(arena)
+    for i in range(0, len(data), 16):
+        out.write("  " + ", ".join("0x%02X" % b for b in data[i:i+16]) + ",\n")
+    out.write("};\n\n#endif\n")
+
+if __name__ == '__main__':
+    main(sys.argv[1:])
@@ -0,0 +1,80 @@
+# Generates dist/oui_table.h from the IEEE OUI registry.
+#
+# Usage: python .build_oui.py oui.txt [vendors.txt] > dist/oui_table.h
+#
+# oui.txt is the registry as published at
+# http://standards-oui.ieee.org/oui/oui.txt. The full registry does not fit in
+# the esp01 flash layout, so the table is restricted to the vendor name
+# prefixes (one per line) in vendors.txt, .oui_vendors.txt by default.
+
+import os
+import re
+import sys
+
+MAX_VENDOR_LENGTH = 24
+DEFAULT_FILTER = os.path.join(os.path.dirname(os.path.abspath(__file__)), '.oui_vendors.txt')
+LINE_PATTERN = re.compile(r'^\s*([0-9A-Fa-f]{2})-([0-9A-Fa-f]{2})-([0-9A-Fa-f]{2})\s+\(hex\)\s+(.+?)\s*$')
+
+def read_registry(path):
+    entries = {}
+    with open(path) as f:
+        for line in f:
+            match = LINE_PATTERN.match(line)
+            if match:
+                oui = int(match.group(1) + match.group(2) + match.group(3), 16)
+                entries[oui] = match.group(4).strip()[:MAX_VENDOR_LENGTH].rstrip(" ,")
+    return entries
+
+def read_filter(path):
+    with open(path) as f:
+        return [l.strip().lower() for l in f if l.strip() and not l.startswith('#')]
+
+def c_string(s):
+    return '"' + s.replace('\\', '\\\\').replace('"', '\\"') + '\\0"'
+
+def main(args):
+    entries = read_registry(args[0])
+
+    prefixes = read_filter(args[1] if len(args) > 1 else DEFAULT_FILTER)
+    entries = dict((k, v) for k, v in entries.items()
+        if any(v.lower().startswith(p) for p in prefixes))
+
+    vendors = sorted(set(entries.values()))
+    if len(vendors) > 256:
+        raise Exception("Too many vendors (%d), narrow the filter" % len(vendors))
+
+    vendor_ix = dict((v, i) for i, v in enumerate(vendors))
+    offsets = []
+    pool_size = 0
+    for v in vendors:
+        offsets.append(pool_size)
+        pool_size += len(v) + 1
+
+    table_size = 4*len(entries) + 2*len(offsets) + pool_size
+
+    out = sys.stdout
+    out.write("// Generated by .build_oui.py. Do not edit.\n")
+    out.write("// %d prefixes, %d vendors, %d bytes of flash.\n\n" % (len(entries), len(vendors), table_size))
+    out.write("#include <Arduino.h>\n\n")
+    out.write("#ifndef _OUI_TABLE_H\n#define _OUI_TABLE_H\n\n")
+    out.write("#define OUI_TABLE_SIZE %d\n" % len(entries))
+    out.write("#define OUI_NUM_VENDORS %d\n\n" % len(vendors))
+
+    out.write("// (prefix << 8) | vendor index, sorted by prefix.\n")
+    out.write("const uint32_t OUI_ENTRIES[] PROGMEM = {\n")
+    for oui in sorted(entries.keys()):
+        out.write("  0x%06X%02X,\n" % (oui, vendor_ix[entries[oui]]))
+    out.write("};\n\n")
+
+    out.write("const uint16_t OUI_VENDOR_OFFSETS[] PROGMEM = {\n")
+    for offset in offsets:
+        out.write("  %d,\n" % offset)
+    out.write("};\n\n")
+
+    out.write("const char OUI_VENDORS[] PROGMEM =\n")
+    for v in vendors:
+        out.write("  %s\n" % c_string(v))
+    out.write(";\n\n#endif\n")
+
+if __name__ == '__main__':
+    main(sys.argv[1:])
@@ -0,0 +1,183 @@
+# Replays captured or synthetic traffic into a node through POST /debug/inject,
+# then reports the run's throughput and latency.
+#
+# Usage:
+#   python .replay_trace.py [--user U --password P] http://node trace.pcap
+#   python .replay_trace.py [--user U --password P] http://node --synthetic N RATE COUNT
+#
+# A trace is a pcap of 802.11 management frames (raw or with radiotap headers,
+# e.g. from airodump-ng or tcpdump on a monitor interface). Probe requests are
+# replayed as probe_request events and association requests as connected
+# events. The injector sends at a fixed rate to at most 8 MACs, so the trace
+# is replayed at its average rate using its most frequent senders.
+#
+# The node only accepts injections when admin credentials are set.
+#
+# To replay a trace with its own timing through the pipeline built on the
+# host, with a stand-in broker, see test/test_trace_replay.
+
+import argparse
+import base64
+import collections
+import json
+import random
+import struct
+import sys
+import time
+
+try:
+    from urllib.request import Request, urlopen
+except ImportError:
+    from urllib2 import Request, urlopen
+
+INJECT_MAX_MACS = 8
+INJECT_MAX_RATE = 1000
+INJECT_MAX_COUNT = 100000
+
+LINKTYPE_IEEE802_11 = 105
+LINKTYPE_RADIOTAP = 127
+
+# (type, subtype) of 802.11 management frames to event names.
+FRAME_EVENTS = {
+    (0, 4): "probe_request",
+    (0, 0): "connected",
+}
+
+def read_pcap(path):
+    with open(path, "rb") as f:
+        header = f.read(24)
+
+        if len(header) < 24:
+            raise Exception("Not a pcap file")
+
+        magic = struct.unpack("<I", header[:4])[0]
+        if magic in (0xa1b2c3d4, 0xa1b23c4d):
+            endian = "<"
+        elif magic in (0xd4c3b2a1, 0x4d3cb2a1):
+            endian = ">"
+        else:
+            raise Exception("Not a pcap file (pcapng isn't supported)")
+
+        linktype = struct.unpack(endian + "I", header[20:24])[0]
+        if linktype not in (LINKTYPE_IEEE802_11, LINKTYPE_RADIOTAP):
+            raise Exception("Unsupported link type %d, expected 802.11 or radiotap" % linktype)
+
+        while True:
+            record = f.read(16)
+            if len(record) < 16:
+                break
+
+            ts_sec, ts_frac, incl_len, _ = struct.unpack(endian + "IIII", record)
+            frame = f.read(incl_len)
+
+            if linktype == LINKTYPE_RADIOTAP:
+                if len(frame) < 4:
+                    continue
+                frame = frame[struct.unpack("<H", frame[2:4])[0]:]
+
+            yield ts_sec + ts_frac / 1e6, bytearray(frame)
+
+def read_trace(path):
+    events = []
+
+    for ts, frame in read_pcap(path):
+        if len(frame) < 16:
+            continue
+
+        frame_type = (frame[0] >> 2) & 0x3
+        subtype = (frame[0] >> 4) & 0xF
+        event = FRAME_EVENTS.get((frame_type, subtype))
+
+        if event:
+            mac = ":".join("%02x" % b for b in frame[10:16])
+            events.append((ts, event, mac))
+
+    return events
+
+def plan_runs(events):
+    # One run per event type, since a run has a single type.
+    runs = []
+    duration = max(events[-1][0] - events[0][0], 1.0)
+
+    for event in sorted(set(e[1] for e in events)):
+        matching = [e for e in events if e[1] == event]
+        senders = collections.Counter(e[2] for e in matching)
+        macs = [mac for mac, _ in senders.most_common(INJECT_MAX_MACS)]
+
+        if len(senders) > INJECT_MAX_MACS:
+            sys.stderr.write("%s: %d senders in trace, replaying as the top %d\n" % (event, len(senders), INJECT_MAX_MACS))
+
+        runs.append({
+            "macs": macs,
+            "event": event,
+            "rate": min(max(int(round(len(matching) / duration)), 1), INJECT_MAX_RATE),
+            "count": min(len(matching), INJECT_MAX_COUNT),
+        })
+
+    return runs
+
+def synthetic_run(num_macs, rate, count):
+    macs = []
+    for _ in range(min(num_macs, INJECT_MAX_MACS)):
+        # Locally administered, so they can't collide with a real device.
+        octets = [0x02] + [random.randint(0, 255) for _ in range(5)]
+        macs.append(":".join("%02x" % b for b in octets))
+
+    return {"macs": macs, "event": "probe_request", "rate": rate, "count": count}
+
+def request(url, args, body=None):
+    req = Request(url, data=json.dumps(body).encode("utf-8") if body is not None else None)
+
+    if body is not None:
+        req.add_header("Content-Type", "application/json")
+
+    if args.user:
+        token = base64.b64encode(("%s:%s" % (args.user, args.password or "")).encode("utf-8"))
+        req.add_header("Authorization", "Basic " + token.decode("ascii"))
+
+    return json.loads(urlopen(req, timeout=10).read().decode("utf-8"))
+
+def replay(args, run):
+    url = args.node.rstrip("/") + "/debug/inject"
+    sys.stderr.write("Injecting %(count)d %(event)s events at %(rate)d/s from %(num)d MACs\n" % dict(run, num=len(run["macs"])))
+
+    request(url, args, run)
+
+    # Give the tail of the run a few seconds to get through the pipeline.
+    deadline = time.time() + float(run["count"]) / run["rate"] + 10
+    while True:
+        time.sleep(1)
+        stats = request(url, args)
+
+        done = stats["processed"] + stats["dropped"] >= stats["requested"]
+        if (done and not stats["running"]) or time.time() > deadline:
+            return stats
+
+def main():
+    parser = argparse.ArgumentParser(description="Replay traffic into a dash_stadium node.")
+    parser.add_argument("node", help="e.g. http://192.168.4.1")
+    parser.add_argument("trace", nargs="?", help="pcap of 802.11 management frames")
+    parser.add_argument("--synthetic", nargs=3, type=int, metavar=("MACS", "RATE", "COUNT"))
+    parser.add_argument("--user")
+    parser.add_argument("--password")
+    parser.add_argument("--dry-run", action="store_true", help="print the runs without sending them")
+    args = parser.parse_args()
+
+    if args.synthetic:
+        runs = [synthetic_run(*args.synthetic)]
+    elif args.trace:
+        events = read_trace(args.trace)
+        if not events:
+            sys.exit("No probe or association requests in %s" % args.trace)
+        runs = plan_runs(events)
+    else:
+        parser.error("a trace or --synthetic is required")
+
+    for run in runs:
+        if args.dry_run:
+            print(json.dumps(run))
+        else:
+            print(json.dumps(replay(args, run)))
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,261 @@
+// Generated by .build_oui.py. Do not edit.
+// 201 prefixes, 19 vendors, 1196 bytes of flash.
+
+#include <Arduino.h>
+
+#ifndef _OUI_TABLE_H
+#define _OUI_TABLE_H
+
+#define OUI_TABLE_SIZE 201
+#define OUI_NUM_VENDORS 19
+
+// (prefix << 8) | vendor index, sorted by prefix.
+const uint32_t OUI_ENTRIES[] PROGMEM = {
+  0x00039301,
+  0x0007AB0E,
+  0x00095B08,
+  0x000A2701,
+  0x000A9501,
+  0x000E580F,
+  0x00125A07,
+  0x0012FB0E,
+  0x0013E805,
+  0x00146C08,
+  0x00155D07,
+  0x00156D11,
+  0x0015990E,
+  0x0016320E,
+  0x0017880A,
+  0x0017F201,
+  0x0017FA07,
+  0x00188204,
+  0x001A1103,
+  0x001B2105,
+  0x001B2F08,
+  0x001B6301,
+  0x001C6206,
+  0x001D250E,
+  0x001DD807,
+  0x001E1004,
+  0x001E2A08,
+  0x001E6405,
+  0x001E7506,
+  0x001EC201,
+  0x00216A05,
+  0x00223F08,
+  0x00224807,
+  0x00231201,
+  0x0024B208,
+  0x0024D705,
+  0x00250001,
+  0x00259E04,
+  0x00260801,
+  0x00272211,
+  0x0050F207,
+  0x00E0FC04,
+  0x00FC8B00,
+  0x040CCE01,
+  0x0418D611,
+  0x0805810D,
+  0x0C47C900,
+  0x1040F301,
+  0x10683F06,
+  0x14CC2010,
+  0x18742E00,
+  0x18B43009,
+  0x18FE3402,
+  0x204E7F08,
+  0x20DFB903,
+  0x240AC402,
+  0x245A4C11,
+  0x2462AB02,
+  0x24A07401,
+  0x24A43C11,
+  0x24B2DE02,
+  0x28187807,
+  0x286C0712,
+  0x286ED404,
+  0x28CDC10C,
+  0x28CFE901,
+  0x2C3AE802,
+  0x2CB05D08,
+  0x30469A08,
+  0x30AEA402,
+  0x3423BA0E,
+  0x34363B01,
+  0x347E5C0F,
+  0x3480B312,
+  0x34D27000,
+  0x34FCEF06,
+  0x38F73D00,
+  0x3C075401,
+  0x3C5AB403,
+  0x3C71BF02,
+  0x3CA9F405,
+  0x40A6D901,
+  0x40B4CD00,
+  0x44650D00,
+  0x44D9E711,
+  0x4846FB04,
+  0x48D6D503,
+  0x50C7BF10,
+  0x50F5DA00,
+  0x54600903,
+  0x5855CA01,
+  0x58A2B506,
+  0x5C0A5B0E,
+  0x5CAAFD0F,
+  0x5CCF7F02,
+  0x60019402,
+  0x6045BD07,
+  0x60E32710,
+  0x60FB4201,
+  0x64098012,
+  0x64166609,
+  0x64700210,
+  0x6837E900,
+  0x6854FD00,
+  0x68725111,
+  0x68C63A02,
+  0x70568101,
+  0x70723C04,
+  0x74754800,
+  0x7483C211,
+  0x74C24600,
+  0x7811DC12,
+  0x7828CA0F,
+  0x7831C101,
+  0x78521A0E,
+  0x788A2011,
+  0x78E10300,
+  0x7C1E5207,
+  0x7C49EB12,
+  0x7C7A9105,
+  0x7CD1C301,
+  0x802AA811,
+  0x807D3A02,
+  0x80FB0604,
+  0x840D8E02,
+  0x8425DB0E,
+  0x84D6D000,
+  0x84F3EB02,
+  0x8863DF01,
+  0x8871E500,
+  0x88C9D006,
+  0x8C77120E,
+  0x8C859001,
+  0x8CAAB502,
+  0x94350A0E,
+  0x949F3E0F,
+  0x9801A701,
+  0x98DED010,
+  0x98F4AB02,
+  0xA002DC00,
+  0xA020A602,
+  0xA040A008,
+  0xA0F3C110,
+  0xA434D905,
+  0xA45E6001,
+  0xA4773303,
+  0xA4CF1202,
+  0xA816B206,
+  0xA886DD01,
+  0xAC3A7A0D,
+  0xAC63BE00,
+  0xACBC3201,
+  0xACD07402,
+  0xACE21504,
+  0xB0A7370D,
+  0xB47C9C00,
+  0xB4E62D02,
+  0xB4FBE411,
+  0xB827EB0B,
+  0xB8E85601,
+  0xB8E9370F,
+  0xBC20A40E,
+  0xBCDDC202,
+  0xC04A0010,
+  0xC4041508,
+  0xC44F3302,
+  0xC82A1401,
+  0xC83F2607,
+  0xCC07AB0E,
+  0xCC50E302,
+  0xCC6DA00D,
+  0xD023DB01,
+  0xD8306201,
+  0xD831340D,
+  0xD83ADD0C,
+  0xDC3A5E0D,
+  0xDC4F2202,
+  0xDC9FDB11,
+  0xDCA6320C,
+  0xE0247F04,
+  0xE091F508,
+  0xE0F84701,
+  0xE45F010C,
+  0xE8508B0E,
+  0xEC086B10,
+  0xECB5FA0A,
+  0xECFABC02,
+  0xF025B70E,
+  0xF0272D00,
+  0xF09FC211,
+  0xF0D2F100,
+  0xF0DBE201,
+  0xF40F2401,
+  0xF4F26D10,
+  0xF4F5D803,
+  0xF4F5E803,
+  0xF88FCA03,
+  0xF8A45F12,
+  0xFC65DE00,
+  0xFCA18300,
+  0xFCECDA11,
+};
+
+const uint16_t OUI_VENDOR_OFFSETS[] PROGMEM = {
+  0,
+  25,
+  37,
+  52,
+  65,
+  89,
+  105,
+  120,
+  142,
+  150,
+  165,
+  185,
+  209,
+  234,
+  245,
+  269,
+  281,
+  306,
+  329,
+};
+
+const char OUI_VENDORS[] PROGMEM =
+  "Amazon Technologies Inc.\0"
+  "Apple, Inc.\0"
+  "Espressif Inc.\0"
+  "Google, Inc.\0"
+  "HUAWEI TECHNOLOGIES CO.\0"
+  "Intel Corporate\0"
+  "LG Electronics\0"
+  "Microsoft Corporation\0"
+  "NETGEAR\0"
+  "Nest Labs Inc.\0"
+  "Philips Lighting BV\0"
+  "Raspberry Pi Foundation\0"
+  "Raspberry Pi Trading Ltd\0"
+  "Roku, Inc.\0"
+  "Samsung Electronics Co.\0"
+  "Sonos, Inc.\0"
+  "TP-LINK TECHNOLOGIES CO.\0"
+  "Ubiquiti Networks Inc.\0"
+  "Xiaomi Communications Co\0"
+;
+
+#endif
@@ -0,0 +1,228 @@
+#include <ClaimTracker.h>
+#include <IntParsing.h>
+
+ClaimTracker::ClaimTracker(const uint32_t nodeId)
+  : nodeId(nodeId),
+    windowMs(0),
+    wonHandler(NULL)
+{
+  clear();
+}
+
+void ClaimTracker::onWon(ClaimWonHandler handler) {
+  this->wonHandler = handler;
+}
+
+void ClaimTracker::setWindow(const uint32_t windowMs) {
+  this->windowMs = windowMs;
+}
+
+uint32_t ClaimTracker::window() const {
+  return windowMs;
+}
+
+void ClaimTracker::clear() {
+  for (size_t i = 0; i < CLUSTER_MAX_CLAIMS; i++) {
+    claims[i].active = false;
+  }
+
+  memset(&stats, 0, sizeof(stats));
+}
+
+const ClaimStats& ClaimTracker::getStats() const {
+  return stats;
+}
+
+bool ClaimTracker::claimLocal(const DashEventType type, const uint8_t* mac, const int8_t rssi, const unsigned long now) {
+  expire(now);
+  stats.claimed++;
+
+  PressClaim* claim = find(type, mac);
+
+  if (claim == NULL) {
+    claim = allocate(type, mac, now);
+  } else if (claim->pending) {
+    // Already waiting on a claim for this press.
+    return false;
+  }
+
+  if (claim->hasRemote && beats(claim->remoteRssi, claim->remoteNode, rssi, nodeId)) {
+    stats.yielded++;
+    return false;
+  }
+
+  claim->pending = true;
+  claim->localRssi = rssi;
+  claim->claimedAt = now;
+
+  return true;
+}
+
+void ClaimTracker::recordRemote(const DashEventType type, const uint8_t* mac, const uint32_t nodeId, const int8_t rssi, const unsigned long now) {
+  // MQTT echoes our own publishes back to us.
+  if (nodeId == this->nodeId) {
+    return;
+  }
+
+  expire(now);
+  stats.remoteClaims++;
+
+  PressClaim* claim = find(type, mac);
+
+  if (claim == NULL) {
+    claim = allocate(type, mac, now);
+  }
+
+  if (!claim->hasRemote || beats(rssi, nodeId, claim->remoteRssi, claim->remoteNode)) {
+    claim->hasRemote = true;
+    claim->remoteRssi = rssi;
+    claim->remoteNode = nodeId;
+  }
+  claim->remoteAt = now;
+
+  if (claim->pending && beats(rssi, nodeId, claim->localRssi, this->nodeId)) {
+    claim->pending = false;
+    stats.yielded++;
+  }
+}
+
+void ClaimTracker::loop(const unsigned long now) {
+  for (size_t i = 0; i < CLUSTER_MAX_CLAIMS; i++) {
+    PressClaim& claim = claims[i];
+
+    if (claim.active && claim.pending && (now - claim.claimedAt) >= windowMs) {
+      stats.won++;
+      resolve(claim);
+    }
+  }
+
+  expire(now);
+}
+
+void ClaimTracker::resolve(PressClaim& claim) {
+  claim.pending = false;
+
+  if (this->wonHandler) {
+    this->wonHandler(claim.type, claim.mac);
+  }
+}
+
+void ClaimTracker::expire(const unsigned long now) {
+  for (size_t i = 0; i < CLUSTER_MAX_CLAIMS; i++) {
+    PressClaim& claim = claims[i];
+
+    if (!claim.active || claim.pending) {
+      continue;
+    }
+
+    // Remote claims only count toward presses within the window of them.
+    if (claim.hasRemote && (now - claim.remoteAt) > windowMs) {
+      claim.hasRemote = false;
+    }
+
+    if (!claim.hasRemote && (now - claim.claimedAt) > windowMs) {
+      claim.active = false;
+    }
+  }
+}
+
+PressClaim* ClaimTracker::find(const DashEventType type, const uint8_t* mac) {
+  for (size_t i = 0; i < CLUSTER_MAX_CLAIMS; i++) {
+    if (claims[i].active && claims[i].type == type && memcmp(claims[i].mac, mac, 6) == 0) {
+      return &claims[i];
+    }
+  }
+
+  return NULL;
+}
+
+PressClaim* ClaimTracker::allocate(const DashEventType type, const uint8_t* mac, const unsigned long now) {
+  PressClaim* slot = NULL;
+
+  for (size_t i = 0; i < CLUSTER_MAX_CLAIMS && slot == NULL; i++) {
+    if (!claims[i].active) {
+      slot = &claims[i];
+    }
+  }
+
+  // Full. Take over the oldest claim. If it was still pending, publish it now:
+  // a duplicate is better than a dropped press.
+  if (slot == NULL) {
+    slot = &claims[0];
+
+    for (size_t i = 1; i < CLUSTER_MAX_CLAIMS; i++) {
+      if ((now - claims[i].claimedAt) > (now - slot->claimedAt)) {
+        slot = &claims[i];
+      }
+    }
+
+    if (slot->pending) {
+      stats.evicted++;
+      resolve(*slot);
+    }
+  }
+
+  slot->active = true;
+  memcpy(slot->mac, mac, 6);
+  slot->type = type;
+  slot->pending = false;
+  slot->hasRemote = false;
+  slot->claimedAt = now;
+
+  return slot;
+}
+
+bool ClaimTracker::beats(const int8_t rssi, const uint32_t node, const int8_t otherRssi, const uint32_t otherNode) {
+  return rssi > otherRssi || (rssi == otherRssi && node < otherNode);
+}
+
+void ClaimTracker::formatClaim(const DashEventType type, const uint8_t* mac, const int8_t rssi, char* topic, char* payload) const {
+  char macStr[20];
+  IntParsing::bytesToHexStr(mac, 6, macStr, sizeof(macStr), ':');
+
+  snprintf_P(topic, CLUSTER_CLAIM_TOPIC_LENGTH, PSTR("%s%s/%s"), CLUSTER_CLAIM_TOPIC_PREFIX, macStr, DASH_EVENT_NAMES[type]);
+  snprintf_P(payload, CLUSTER_CLAIM_PAYLOAD_LENGTH, PSTR("%08X %d"), static_cast<unsigned>(nodeId), rssi);
+}
+
+bool ClaimTracker::parseClaim(const char* topic, const uint8_t* payload, const size_t length, DashEventType& type, uint8_t* mac, uint32_t& nodeId, int8_t& rssi) {
+  const size_t prefixLength = strlen(CLUSTER_CLAIM_TOPIC_PREFIX);
+
+  if (strncmp(topic, CLUSTER_CLAIM_TOPIC_PREFIX, prefixLength) != 0) {
+    return false;
+  }
+
+  const char* macStr = topic + prefixLength;
+  const char* typeStr = strchr(macStr, '/');
+
+  if (typeStr == NULL || (typeStr - macStr) != 17) {
+    return false;
+  }
+
+  typeStr++;
+
+  bool found = false;
+  for (size_t i = 0; i < DASH_NUM_EVENT_TYPES && !found; i++) {
+    if (strcmp(typeStr, DASH_EVENT_NAMES[i]) == 0) {
+      type = static_cast<DashEventType>(i);
+      found = true;
+    }
+  }
+
+  if (!found || length < 10 || length >= CLUSTER_CLAIM_PAYLOAD_LENGTH || payload[8] != ' ') {
+    return false;
+  }
+
+  char macBuffer[18];
+  memcpy(macBuffer, macStr, 17);
+  macBuffer[17] = 0;
+  IntParsing::parseDelimitedBytes(macBuffer, mac, 6);
+
+  char payloadBuffer[CLUSTER_CLAIM_PAYLOAD_LENGTH];
+  memcpy(payloadBuffer, payload, length);
+  payloadBuffer[length] = 0;
+
+  nodeId = IntParsing::strToHex<uint32_t>(payloadBuffer, 8);
+  rssi = atoi(payloadBuffer + 9);
+
+  return true;
+}
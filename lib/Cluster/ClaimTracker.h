@@ -0,0 +1,98 @@
+#include <Arduino.h>
+#include <functional>
+#include <DashEvent.h>
+
+#ifndef _CLAIM_TRACKER_H
+#define _CLAIM_TRACKER_H
+
+#ifndef CLUSTER_MAX_CLAIMS
+#define CLUSTER_MAX_CLAIMS 8
+#endif
+
+// Claims are published to <prefix><mac>/<event type> with a "<node id> <rssi>"
+// payload. Nodes subscribe to <prefix># to hear each other.
+#ifndef CLUSTER_CLAIM_TOPIC_PREFIX
+#define CLUSTER_CLAIM_TOPIC_PREFIX "dash_stadium/claims/"
+#endif
+
+#define CLUSTER_CLAIM_TOPIC_LENGTH (sizeof(CLUSTER_CLAIM_TOPIC_PREFIX) + 32)
+#define CLUSTER_CLAIM_PAYLOAD_LENGTH 16
+
+// Only the MAC is kept, the device table may have changed by the time a claim
+// is won.
+typedef std::function<void(const DashEventType type, const uint8_t* mac)> ClaimWonHandler;
+
+struct PressClaim {
+  bool active;
+  uint8_t mac[6];
+  DashEventType type;
+
+  // Set while our own claim is waiting out the window.
+  bool pending;
+  int8_t localRssi;
+  unsigned long claimedAt;
+
+  // Strongest claim heard from another node.
+  bool hasRemote;
+  int8_t remoteRssi;
+  uint32_t remoteNode;
+  unsigned long remoteAt;
+};
+
+struct ClaimStats {
+  uint32_t claimed;
+  uint32_t won;
+  uint32_t yielded;
+  uint32_t remoteClaims;
+  // Pending claims published early because the table was full.
+  uint32_t evicted;
+};
+
+// Decides which node in a cluster publishes a press that several of them
+// heard. A press is identified by device MAC and event type; claims for it
+// that arrive within the window of each other are treated as the same press.
+// Each node broadcasts a claim with the RSSI it heard the press at, and after
+// the window the node with the strongest signal (lowest node id on a tie)
+// publishes. Nodes that already know they've lost stay quiet.
+//
+// Time is always passed in, so this has no dependency on the clock or the
+// network and can be driven directly.
+class ClaimTracker {
+public:
+  ClaimTracker(const uint32_t nodeId);
+
+  void onWon(ClaimWonHandler handler);
+  void setWindow(const uint32_t windowMs);
+  uint32_t window() const;
+
+  // Returns true if the claim should be broadcast. False means another node
+  // has already claimed this press with a stronger signal.
+  bool claimLocal(const DashEventType type, const uint8_t* mac, const int8_t rssi, const unsigned long now);
+  void recordRemote(const DashEventType type, const uint8_t* mac, const uint32_t nodeId, const int8_t rssi, const unsigned long now);
+
+  // Resolves claims whose window has passed.
+  void loop(const unsigned long now);
+  void clear();
+
+  const ClaimStats& getStats() const;
+
+  void formatClaim(const DashEventType type, const uint8_t* mac, const int8_t rssi, char* topic, char* payload) const;
+  // Returns false if the message isn't a well-formed claim.
+  static bool parseClaim(const char* topic, const uint8_t* payload, const size_t length, DashEventType& type, uint8_t* mac, uint32_t& nodeId, int8_t& rssi);
+
+private:
+  const uint32_t nodeId;
+  uint32_t windowMs;
+  PressClaim claims[CLUSTER_MAX_CLAIMS];
+  ClaimStats stats;
+  ClaimWonHandler wonHandler;
+
+  PressClaim* find(const DashEventType type, const uint8_t* mac);
+  PressClaim* allocate(const DashEventType type, const uint8_t* mac, const unsigned long now);
+  void resolve(PressClaim& claim);
+  void expire(const unsigned long now);
+
+  static bool beats(const int8_t rssi, const uint32_t node, const int8_t otherRssi, const uint32_t otherNode);
+};
+
+#endif
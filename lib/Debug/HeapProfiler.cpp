@@ -0,0 +1,190 @@
+#ifdef DASH_HEAP_PROFILE
+
+#include <HeapProfiler.h>
+#include <string.h>
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#define HEAP_PROFILE_LOCK() uint32_t _savedPS = xt_rsil(15)
+#define HEAP_PROFILE_UNLOCK() xt_wsr_ps(_savedPS)
+#else
+#define HEAP_PROFILE_LOCK()
+#define HEAP_PROFILE_UNLOCK()
+#endif
+
+extern "C" {
+  void* __real_malloc(size_t size);
+  void __real_free(void* ptr);
+  void* __real_realloc(void* ptr, size_t size);
+}
+
+#define HEAP_BLOCK_MAGIC 0xD5A5
+
+// Prepended to every block. Kept at 8 bytes so the pointer handed out keeps
+// malloc's alignment.
+struct HeapBlockHeader {
+  uint32_t size;
+  uint16_t magic;
+  uint16_t tag;
+};
+
+const char* HeapProfiler::TAG_NAMES[HEAP_NUM_TAGS] = {
+  "other", "mqtt", "http", "websockets", "event_stream", "settings", "events"
+};
+
+static HeapTagStats tagStats[HEAP_NUM_TAGS];
+static HeapSample samples[HEAP_PROFILE_NUM_SAMPLES];
+static uint32_t allocSeq = 0;
+static uint32_t numSamples = 0;
+static HeapTag activeTag = HEAP_TAG_OTHER;
+
+HeapTag HeapProfiler::currentTag() {
+  return activeTag;
+}
+
+HeapTag HeapProfiler::setTag(const HeapTag tag) {
+  const HeapTag previous = activeTag;
+  activeTag = tag;
+  return previous;
+}
+
+const HeapTagStats& HeapProfiler::stats(const HeapTag tag) {
+  return tagStats[tag];
+}
+
+uint32_t HeapProfiler::numAllocs() {
+  return allocSeq;
+}
+
+bool HeapProfiler::sample(const size_t ix, HeapSample& sample) {
+  const uint32_t available = numSamples < HEAP_PROFILE_NUM_SAMPLES ? numSamples : HEAP_PROFILE_NUM_SAMPLES;
+
+  if (ix >= available) {
+    return false;
+  }
+
+  HEAP_PROFILE_LOCK();
+  sample = samples[(numSamples - available + ix) % HEAP_PROFILE_NUM_SAMPLES];
+  HEAP_PROFILE_UNLOCK();
+
+  return true;
+}
+
+static void* track(HeapBlockHeader* header, const size_t size, const uintptr_t caller) {
+  if (header == NULL) {
+    return NULL;
+  }
+
+  HEAP_PROFILE_LOCK();
+
+  header->size = size;
+  header->magic = HEAP_BLOCK_MAGIC;
+  header->tag = activeTag;
+
+  HeapTagStats& stats = tagStats[activeTag];
+  stats.allocs++;
+  stats.allocatedBytes += size;
+  stats.liveBlocks++;
+  stats.liveBytes += size;
+  if (stats.liveBytes > stats.peakLiveBytes) {
+    stats.peakLiveBytes = stats.liveBytes;
+  }
+
+  if ((allocSeq++ % HEAP_PROFILE_SAMPLE_RATE) == 0) {
+    HeapSample& sample = samples[numSamples++ % HEAP_PROFILE_NUM_SAMPLES];
+    sample.caller = caller;
+    sample.size = size;
+    sample.seq = allocSeq;
+    sample.tag = activeTag;
+  }
+
+  HEAP_PROFILE_UNLOCK();
+
+  return header + 1;
+}
+
+// Returns the block's header, or NULL if it didn't come from here.
+static HeapBlockHeader* untrack(void* ptr) {
+  HeapBlockHeader* header = reinterpret_cast<HeapBlockHeader*>(ptr) - 1;
+
+  if (header->magic != HEAP_BLOCK_MAGIC) {
+    return NULL;
+  }
+
+  HEAP_PROFILE_LOCK();
+
+  HeapTagStats& stats = tagStats[header->tag];
+  stats.frees++;
+  stats.liveBlocks--;
+  stats.liveBytes -= header->size;
+  header->magic = 0;
+
+  HEAP_PROFILE_UNLOCK();
+
+  return header;
+}
+
+extern "C" {
+
+void* __wrap_malloc(size_t size) {
+  void* block = __real_malloc(size + sizeof(HeapBlockHeader));
+  return track(reinterpret_cast<HeapBlockHeader*>(block), size, reinterpret_cast<uintptr_t>(__builtin_return_address(0)));
+}
+
+void* __wrap_calloc(size_t count, size_t size) {
+  const size_t total = count * size;
+
+  if (size != 0 && total / size != count) {
+    return NULL;
+  }
+
+  void* block = __real_malloc(total + sizeof(HeapBlockHeader));
+
+  if (block != NULL) {
+    memset(reinterpret_cast<HeapBlockHeader*>(block) + 1, 0, total);
+  }
+
+  return track(reinterpret_cast<HeapBlockHeader*>(block), total, reinterpret_cast<uintptr_t>(__builtin_return_address(0)));
+}
+
+void __wrap_free(void* ptr) {
+  if (ptr == NULL) {
+    return;
+  }
+
+  HeapBlockHeader* header = untrack(ptr);
+
+  // Allocated before the wrappers were linked in, e.g. by a prebuilt blob
+  // calling the real allocator directly.
+  __real_free(header != NULL ? static_cast<void*>(header) : ptr);
+}
+
+void* __wrap_realloc(void* ptr, size_t size) {
+  if (ptr == NULL) {
+    return __wrap_malloc(size);
+  }
+
+  HeapBlockHeader* header = untrack(ptr);
+
+  if (header == NULL) {
+    return __real_realloc(ptr, size);
+  }
+
+  const HeapTag tag = HeapProfiler::setTag(static_cast<HeapTag>(header->tag));
+  const uint32_t oldSize = header->size;
+  void* block = __real_realloc(header, size + sizeof(HeapBlockHeader));
+
+  // A failed realloc leaves the original block in place, so keep counting it.
+  void* result = track(
+    reinterpret_cast<HeapBlockHeader*>(block != NULL ? block : header),
+    block != NULL ? size : oldSize,
+    reinterpret_cast<uintptr_t>(__builtin_return_address(0))
+  );
+  HeapProfiler::setTag(tag);
+
+  return block != NULL ? result : NULL;
+}
+
+}
+
+#endif
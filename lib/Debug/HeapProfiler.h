@@ -0,0 +1,88 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef _HEAP_PROFILER_H
+#define _HEAP_PROFILER_H
+
+// Allocation profiling, enabled by building with
+//
+//   -DDASH_HEAP_PROFILE -Wl,--wrap=malloc -Wl,--wrap=free -Wl,--wrap=realloc -Wl,--wrap=calloc
+//
+// Every allocation is charged to the subsystem whose HEAP_SCOPE is innermost
+// when it's made, and credited back to the same subsystem when it's freed.
+// Nothing here depends on Arduino, so the same flags work in a host build.
+// There, only calls from objects being linked are wrapped: allocations made
+// inside a shared libstdc++ (operator new, std::string) aren't seen.
+
+enum HeapTag {
+  HEAP_TAG_OTHER = 0,
+  HEAP_TAG_MQTT,
+  HEAP_TAG_HTTP,
+  HEAP_TAG_WEBSOCKETS,
+  HEAP_TAG_EVENT_STREAM,
+  HEAP_TAG_SETTINGS,
+  HEAP_TAG_EVENTS,
+  HEAP_NUM_TAGS
+};
+
+#ifdef DASH_HEAP_PROFILE
+
+#ifndef HEAP_PROFILE_NUM_SAMPLES
+#define HEAP_PROFILE_NUM_SAMPLES 32
+#endif
+
+// Every Nth allocation is recorded in the sample ring.
+#ifndef HEAP_PROFILE_SAMPLE_RATE
+#define HEAP_PROFILE_SAMPLE_RATE 16
+#endif
+
+struct HeapTagStats {
+  uint32_t allocs;
+  uint32_t frees;
+  uint32_t allocatedBytes;
+  uint32_t liveBlocks;
+  uint32_t liveBytes;
+  uint32_t peakLiveBytes;
+};
+
+struct HeapSample {
+  // Return address of the allocation call, resolve with addr2line.
+  uintptr_t caller;
+  uint32_t size;
+  uint32_t seq;
+  uint8_t tag;
+};
+
+class HeapProfiler {
+public:
+  static const char* TAG_NAMES[HEAP_NUM_TAGS];
+
+  static HeapTag currentTag();
+  static HeapTag setTag(const HeapTag tag);
+
+  static const HeapTagStats& stats(const HeapTag tag);
+  static uint32_t numAllocs();
+  // Samples come back oldest first. Returns false past the last one.
+  static bool sample(const size_t ix, HeapSample& sample);
+};
+
+class HeapScope {
+public:
+  HeapScope(const HeapTag tag) : previous(HeapProfiler::setTag(tag)) { }
+  ~HeapScope() { HeapProfiler::setTag(previous); }
+
+private:
+  const HeapTag previous;
+};
+
+#define HEAP_SCOPE_CONCAT_(a, b) a ## b
+#define HEAP_SCOPE_CONCAT(a, b) HEAP_SCOPE_CONCAT_(a, b)
+#define HEAP_SCOPE(tag) HeapScope HEAP_SCOPE_CONCAT(_heapScope, __LINE__)(tag)
+
+#else
+
+#define HEAP_SCOPE(tag)
+
+#endif
+
+#endif
@@ -0,0 +1,62 @@
+#include <CaptureQueue.h>
+
+CaptureQueue::CaptureQueue()
+  : head(0),
+    tail(0),
+    _dropped(0)
+{ }
+
+bool CaptureQueue::push(const DashEventType type, const uint8_t* mac, const int8_t rssi, const uint8_t flags) {
+  if (size() == CAPTURE_QUEUE_SIZE) {
+    _dropped++;
+    return false;
+  }
+
+  CapturedEvent& event = events[head % CAPTURE_QUEUE_SIZE];
+  memcpy(event.mac, mac, 6);
+  event.type = type;
+  event.rssi = rssi;
+  event.flags = flags;
+  head++;
+
+  return true;
+}
+
+bool CaptureQueue::pop(CapturedEvent& event) {
+  if (head == tail) {
+    return false;
+  }
+
+  event = events[tail % CAPTURE_QUEUE_SIZE];
+  tail++;
+
+  return true;
+}
+
+bool CaptureQueue::peek(CapturedEvent& event) const {
+  if (head == tail) {
+    return false;
+  }
+
+  event = events[tail % CAPTURE_QUEUE_SIZE];
+
+  return true;
+}
+
+size_t CaptureQueue::copyTo(CapturedEvent* out, const size_t maxEvents) const {
+  size_t n = 0;
+
+  for (size_t i = tail; i != head && n < maxEvents; i++) {
+    out[n++] = events[i % CAPTURE_QUEUE_SIZE];
+  }
+
+  return n;
+}
+
+size_t CaptureQueue::size() const {
+  return head - tail;
+}
+
+uint32_t CaptureQueue::dropped() const {
+  return _dropped;
+}
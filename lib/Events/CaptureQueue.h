@@ -0,0 +1,44 @@
+#include <Arduino.h>
+#include <DashEvent.h>
+
+#ifndef _CAPTURE_QUEUE_H
+#define _CAPTURE_QUEUE_H
+
+#ifndef CAPTURE_QUEUE_SIZE
+#define CAPTURE_QUEUE_SIZE 32
+#endif
+
+// Injected for testing, see EventInjector.
+#define CAPTURE_FLAG_SYNTHETIC 0x01
+
+struct CapturedEvent {
+  uint8_t mac[6];
+  uint8_t type;
+  int8_t rssi;
+  uint8_t flags;
+};
+
+// Hands events from the WiFi callbacks to loop(). Bounded; when full, new
+// events are dropped and counted.
+class CaptureQueue {
+public:
+  CaptureQueue();
+
+  bool push(const DashEventType type, const uint8_t* mac, const int8_t rssi, const uint8_t flags = 0);
+  bool pop(CapturedEvent& event);
+  // Oldest event, without removing it.
+  bool peek(CapturedEvent& event) const;
+  // Copies up to maxEvents, oldest first, without removing them.
+  size_t copyTo(CapturedEvent* events, const size_t maxEvents) const;
+
+  size_t size() const;
+  uint32_t dropped() const;
+
+private:
+  CapturedEvent events[CAPTURE_QUEUE_SIZE];
+  size_t head;
+  size_t tail;
+  uint32_t _dropped;
+};
+
+#endif
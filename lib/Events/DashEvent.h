@@ -0,0 +1,15 @@
+#include <Arduino.h>
+
+#ifndef _DASH_EVENT_H
+#define _DASH_EVENT_H
+
+enum DashEventType {
+  DASH_EVENT_PROBE_REQUEST = 0,
+  DASH_EVENT_CONNECTED = 1
+};
+
+#define DASH_NUM_EVENT_TYPES 2
+
+extern const char* DASH_EVENT_NAMES[DASH_NUM_EVENT_TYPES];
+
+#endif
@@ -0,0 +1,51 @@
+#include <DeviceDiscovery.h>
+
+DeviceDiscovery::DeviceDiscovery()
+  : numDevices(0)
+{ }
+
+void DeviceDiscovery::record(const uint8_t* mac, const unsigned long timestamp) {
+  size_t minIx = 0;
+
+  for (size_t i = 0; i < numDevices; i++) {
+    DiscoveredDevice& device = devices[i];
+
+    if (memcmp(device.mac, mac, 6) == 0) {
+      device.count++;
+      device.lastSeen = timestamp;
+      return;
+    }
+
+    if (device.count < devices[minIx].count) {
+      minIx = i;
+    }
+  }
+
+  DiscoveredDevice* device;
+  uint32_t inheritedCount = 0;
+
+  if (numDevices < DISCOVERY_MAX_DEVICES) {
+    device = &devices[numDevices++];
+  } else {
+    device = &devices[minIx];
+    inheritedCount = device->count;
+  }
+
+  memcpy(device->mac, mac, 6);
+  device->count = inheritedCount + 1;
+  device->error = inheritedCount;
+  device->firstSeen = timestamp;
+  device->lastSeen = timestamp;
+}
+
+void DeviceDiscovery::clear() {
+  numDevices = 0;
+}
+
+size_t DeviceDiscovery::size() const {
+  return numDevices;
+}
+
+const DiscoveredDevice& DeviceDiscovery::get(const size_t ix) const {
+  return devices[ix];
+}
@@ -0,0 +1,38 @@
+#include <Arduino.h>
+
+#ifndef _DEVICE_DISCOVERY_H
+#define _DEVICE_DISCOVERY_H
+
+#ifndef DISCOVERY_MAX_DEVICES
+#define DISCOVERY_MAX_DEVICES 16
+#endif
+
+struct DiscoveredDevice {
+  uint8_t mac[6];
+  uint32_t count;
+  // Upper bound on how much count was overestimated by when this slot was
+  // taken over from an evicted device.
+  uint32_t error;
+  unsigned long firstSeen;
+  unsigned long lastSeen;
+};
+
+// Tracks the most frequently seen unmonitored devices in constant memory using
+// the Space-Saving algorithm: when the table is full, the device with the
+// lowest count is replaced and the newcomer inherits its count.
+class DeviceDiscovery {
+public:
+  DeviceDiscovery();
+
+  void record(const uint8_t* mac, const unsigned long timestamp);
+  void clear();
+
+  size_t size() const;
+  const DiscoveredDevice& get(const size_t ix) const;
+
+private:
+  DiscoveredDevice devices[DISCOVERY_MAX_DEVICES];
+  size_t numDevices;
+};
+
+#endif
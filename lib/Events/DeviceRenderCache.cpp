@@ -0,0 +1,122 @@
+#include <DeviceRenderCache.h>
+
+DeviceRenderCache::DeviceRenderCache()
+  : pool(NULL),
+    numDevices(0),
+    hasTopics(false),
+    onDemand(NULL)
+{ }
+
+DeviceRenderCache::~DeviceRenderCache() {
+  delete[] pool;
+}
+
+String DeviceRenderCache::renderTopic(const char* pattern, const char* eventType, const char* macAddr, const char* deviceAlias) {
+  String topic = pattern;
+
+  topic.replace(":event_type", eventType);
+  topic.replace(":mac_addr", macAddr);
+  topic.replace(":device_alias", deviceAlias);
+
+  return topic;
+}
+
+void DeviceRenderCache::rebuild(Settings& settings) {
+  delete[] pool;
+  pool = NULL;
+  onDemand = NULL;
+
+  numDevices = settings.numMonitoredMacs();
+  hasTopics = strlen(settings.mqttTopicPattern()) > 0;
+
+  if (numDevices == 0) {
+    return;
+  }
+
+  char macBuffer[25];
+  size_t stringsSize = 0;
+
+  // First pass only measures, so that everything fits in one allocation.
+  for (size_t i = 0; i < numDevices; i++) {
+    Settings::formatMac(settings.monitoredMac(i), macBuffer);
+    const char* alias = settings.deviceAlias(i);
+
+    stringsSize += strlen(macBuffer) + 1;
+    stringsSize += strlen(alias) + 1;
+
+    if (hasTopics) {
+      for (size_t j = 0; j < DASH_NUM_EVENT_TYPES; j++) {
+        stringsSize += renderTopic(settings.mqttTopicPattern(), DASH_EVENT_NAMES[j], macBuffer, alias).length() + 1;
+      }
+    }
+  }
+
+  if (stringsSize > UINT16_MAX) {
+    Serial.println(F("ERROR: device strings too large to pre-render, rendering them on demand"));
+    onDemand = &settings;
+    return;
+  }
+
+  pool = new uint8_t[(numDevices * sizeof(Entry)) + stringsSize];
+
+  Entry* entryTable = reinterpret_cast<Entry*>(pool);
+  char* stringPool = reinterpret_cast<char*>(pool + (numDevices * sizeof(Entry)));
+  char* p = stringPool;
+
+  for (size_t i = 0; i < numDevices; i++) {
+    Entry& entry = entryTable[i];
+    Settings::formatMac(settings.monitoredMac(i), macBuffer);
+    const char* alias = settings.deviceAlias(i);
+
+    entry.mac = p - stringPool;
+    p = stpcpy(p, macBuffer) + 1;
+
+    entry.alias = p - stringPool;
+    p = stpcpy(p, alias) + 1;
+
+    for (size_t j = 0; j < DASH_NUM_EVENT_TYPES; j++) {
+      if (hasTopics) {
+        entry.topics[j] = p - stringPool;
+        String topic = renderTopic(settings.mqttTopicPattern(), DASH_EVENT_NAMES[j], macBuffer, alias);
+        p = stpcpy(p, topic.c_str()) + 1;
+      } else {
+        entry.topics[j] = 0;
+      }
+    }
+  }
+}
+
+size_t DeviceRenderCache::size() const {
+  return numDevices;
+}
+
+const char* DeviceRenderCache::mac(const size_t deviceIx) const {
+  if (onDemand) {
+    Settings::formatMac(onDemand->monitoredMac(deviceIx), macBuffer);
+    return macBuffer;
+  }
+
+  return strings() + entries()[deviceIx].mac;
+}
+
+const char* DeviceRenderCache::alias(const size_t deviceIx) const {
+  if (onDemand) {
+    return onDemand->deviceAlias(deviceIx);
+  }
+
+  return strings() + entries()[deviceIx].alias;
+}
+
+const char* DeviceRenderCache::topic(const size_t deviceIx, const DashEventType type) const {
+  if (!hasTopics) {
+    return NULL;
+  }
+
+  if (onDemand) {
+    Settings::formatMac(onDemand->monitoredMac(deviceIx), macBuffer);
+    rendered = renderTopic(onDemand->mqttTopicPattern(), DASH_EVENT_NAMES[type], macBuffer, onDemand->deviceAlias(deviceIx));
+    return rendered.c_str();
+  }
+
+  return strings() + entries()[deviceIx].topics[type];
+}
@@ -0,0 +1,53 @@
+#include <Arduino.h>
+#include <Settings.h>
+#include <DashEvent.h>
+
+#ifndef _DEVICE_RENDER_CACHE_H
+#define _DEVICE_RENDER_CACHE_H
+
+// Pre-rendered strings for each monitored device, built once when settings are
+// applied so the publish path doesn't need to do any formatting. Everything
+// lives in a single allocation: a table of offsets followed by the string pool.
+// Offsets are 16 bits, so if the strings don't fit in 64k they're rendered
+// when they're asked for instead, each valid until the next call.
+class DeviceRenderCache {
+public:
+  DeviceRenderCache();
+  ~DeviceRenderCache();
+
+  void rebuild(Settings& settings);
+
+  size_t size() const;
+  const char* mac(const size_t deviceIx) const;
+  const char* alias(const size_t deviceIx) const;
+
+  // Returns NULL if no topic pattern is configured.
+  const char* topic(const size_t deviceIx, const DashEventType type) const;
+
+  static String renderTopic(const char* pattern, const char* eventType, const char* macAddr, const char* deviceAlias);
+
+private:
+  struct Entry {
+    uint16_t mac;
+    uint16_t alias;
+    uint16_t topics[DASH_NUM_EVENT_TYPES];
+  };
+
+  uint8_t* pool;
+  size_t numDevices;
+  bool hasTopics;
+  // Set when rendering on demand.
+  const Settings* onDemand;
+  mutable char macBuffer[25];
+  mutable String rendered;
+
+  inline const Entry* entries() const {
+    return reinterpret_cast<const Entry*>(pool);
+  }
+
+  inline const char* strings() const {
+    return reinterpret_cast<const char*>(pool + (numDevices * sizeof(Entry)));
+  }
+};
+
+#endif
@@ -0,0 +1,89 @@
+#include <EventInjector.h>
+#include <algorithm>
+
+EventInjector::EventInjector(CaptureQueue& queue)
+  : queue(queue),
+    numMacs(0),
+    type(DASH_EVENT_PROBE_REQUEST),
+    inFlightHead(0),
+    inFlight(0)
+{
+  memset(&stats, 0, sizeof(stats));
+}
+
+bool EventInjector::start(const uint8_t* macs, const size_t numMacs, const DashEventType type, const uint32_t rate, const uint32_t count) {
+  if (numMacs == 0 || numMacs > INJECT_MAX_MACS
+    || rate == 0 || rate > INJECT_MAX_RATE
+    || count == 0 || count > INJECT_MAX_COUNT) {
+    return false;
+  }
+
+  memcpy(this->macs, macs, numMacs * 6);
+  this->numMacs = numMacs;
+  this->type = type;
+
+  // Events from a previous run may still be in the queue. They're counted
+  // against this one, which is close enough.
+  memset(&stats, 0, sizeof(stats));
+  stats.requested = count;
+  stats.rate = rate;
+  stats.startedAt = millis();
+
+  return true;
+}
+
+bool EventInjector::loop(const unsigned long now) {
+  const uint32_t sent = stats.injected + stats.dropped;
+
+  if (sent >= stats.requested) {
+    return false;
+  }
+
+  // The first event goes out right away.
+  const uint64_t due = std::min(
+    static_cast<uint64_t>(stats.requested),
+    (static_cast<uint64_t>(now - stats.startedAt) * stats.rate) / 1000 + 1
+  );
+
+  bool queued = false;
+
+  for (uint32_t i = sent; i < due; i++) {
+    if (queue.push(type, macs[i % numMacs], 0, CAPTURE_FLAG_SYNTHETIC)) {
+      queuedAt[(inFlightHead + inFlight) % CAPTURE_QUEUE_SIZE] = micros();
+      inFlight++;
+      stats.injected++;
+      queued = true;
+    } else {
+      stats.dropped++;
+    }
+  }
+
+  return queued;
+}
+
+void EventInjector::processed() {
+  if (inFlight == 0) {
+    return;
+  }
+
+  const uint32_t latency = micros() - queuedAt[inFlightHead];
+  inFlightHead = (inFlightHead + 1) % CAPTURE_QUEUE_SIZE;
+  inFlight--;
+
+  stats.processed++;
+  stats.totalLatencyMicros += latency;
+  stats.maxLatencyMicros = std::max(stats.maxLatencyMicros, latency);
+  stats.lastProcessedAt = millis();
+}
+
+void EventInjector::published() {
+  stats.published++;
+}
+
+bool EventInjector::running() const {
+  return (stats.injected + stats.dropped) < stats.requested || inFlight > 0;
+}
+
+const InjectionStats& EventInjector::getStats() const {
+  return stats;
+}
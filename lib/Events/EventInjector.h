@@ -0,0 +1,58 @@
+#include <Arduino.h>
+#include <DashEvent.h>
+#include <CaptureQueue.h>
+
+#ifndef _EVENT_INJECTOR_H
+#define _EVENT_INJECTOR_H
+
+#define INJECT_MAX_MACS 8
+#define INJECT_MAX_RATE 1000
+#define INJECT_MAX_COUNT 100000
+
+struct InjectionStats {
+  uint32_t requested;
+  uint32_t rate;
+  uint32_t injected;
+  // Capture queue was full.
+  uint32_t dropped;
+  uint32_t processed;
+  uint32_t published;
+  // From being queued to having gone through the pipeline, publish included.
+  uint32_t totalLatencyMicros;
+  uint32_t maxLatencyMicros;
+  unsigned long startedAt;
+  unsigned long lastProcessedAt;
+};
+
+// Feeds synthetic events into the capture queue at a fixed rate, for load and
+// latency testing. They're flagged with CAPTURE_FLAG_SYNTHETIC so sinks can
+// tell them apart.
+class EventInjector {
+public:
+  EventInjector(CaptureQueue& queue);
+
+  // Replaces any run in progress. Rate is in events per second.
+  bool start(const uint8_t* macs, const size_t numMacs, const DashEventType type, const uint32_t rate, const uint32_t count);
+  // Queues whatever is due. Returns true if anything was queued.
+  bool loop(const unsigned long now);
+  // Called for each synthetic event once the pipeline is done with it. They
+  // come out of the capture queue in the order they went in.
+  void processed();
+  void published();
+
+  bool running() const;
+  const InjectionStats& getStats() const;
+
+private:
+  CaptureQueue& queue;
+  uint8_t macs[INJECT_MAX_MACS][6];
+  size_t numMacs;
+  DashEventType type;
+  InjectionStats stats;
+  // micros() each in-flight event was queued at.
+  uint32_t queuedAt[CAPTURE_QUEUE_SIZE];
+  size_t inFlightHead;
+  size_t inFlight;
+};
+
+#endif
@@ -0,0 +1,303 @@
+#include <EventLog.h>
+#include <time.h>
+#include <algorithm>
+
+static bool matches(const EventLogRecord& record, const bool timeRange, const uint32_t from, const uint32_t to, const uint8_t* mac) {
+  if (timeRange && ((record.flags & EVENT_LOG_FLAG_UPTIME) || record.time < from || record.time > to)) {
+    return false;
+  }
+
+  return mac == NULL || memcmp(record.mac, mac, 6) == 0;
+}
+
+EventLog::EventLog()
+  : head(0),
+    headSeq(0),
+    numRestored(0),
+    dirty(false),
+    dirtySince(0),
+    ready(false)
+{
+  memset(index, 0, sizeof(index));
+  memset(&stats, 0, sizeof(stats));
+}
+
+void EventLog::begin() {
+  File f;
+
+  if (SPIFFS.exists(EVENT_LOG_FILE)) {
+    f = SPIFFS.open(EVENT_LOG_FILE, "r");
+  }
+
+  if (!f || f.size() != EVENT_LOG_NUM_PAGES * EVENT_LOG_PAGE_SIZE) {
+    if (f) {
+      f.close();
+    }
+
+    f = SPIFFS.open(EVENT_LOG_FILE, "w");
+
+    if (!f) {
+      Serial.println(F("ERROR: Couldn't create event log"));
+      return;
+    }
+
+    uint8_t empty[EVENT_LOG_PAGE_SIZE];
+    memset(empty, 0, sizeof(empty));
+
+    for (size_t i = 0; i < EVENT_LOG_NUM_PAGES; i++) {
+      f.write(empty, sizeof(empty));
+    }
+
+    f.close();
+    ready = true;
+    return;
+  }
+
+  EventLogPageHeader header;
+  bool found = false;
+
+  for (size_t i = 0; i < EVENT_LOG_NUM_PAGES; i++) {
+    if (readPage(f, i, header, page)) {
+      indexPage(i, page, header.count);
+
+      if (!found || header.seq > headSeq) {
+        found = true;
+        head = i;
+        headSeq = header.seq;
+      }
+    }
+  }
+
+  // Keep filling the newest page if it has room.
+  if (found && readPage(f, head, header, page) && header.count < EVENT_LOG_RECORDS_PER_PAGE) {
+    numRestored = header.count;
+  } else if (found) {
+    head = (head + 1) % EVENT_LOG_NUM_PAGES;
+    headSeq++;
+    index[head].count = 0;
+  }
+
+  f.close();
+  ready = true;
+}
+
+void EventLog::record(const DashEventType type, const uint8_t* mac, const size_t deviceIx, const int8_t rssi) {
+  if (!ready) {
+    return;
+  }
+
+  // The last write of a full page failed, try again before dropping this.
+  if (index[head].count == EVENT_LOG_RECORDS_PER_PAGE) {
+    flush();
+
+    if (index[head].count == EVENT_LOG_RECORDS_PER_PAGE) {
+      return;
+    }
+  }
+
+  EventLogRecord& record = page[index[head].count];
+  const time_t now = time(NULL);
+
+  memset(&record, 0, sizeof(record));
+  memcpy(record.mac, mac, 6);
+  record.type = type;
+  record.rssi = rssi;
+  record.deviceIx = deviceIx;
+
+  if (now >= EVENT_LOG_MIN_VALID_TIME) {
+    record.time = now;
+  } else {
+    record.time = millis() / 1000;
+    record.flags |= EVENT_LOG_FLAG_UPTIME;
+  }
+
+  indexPage(head, page, index[head].count + 1);
+  stats.records++;
+
+  if (!dirty) {
+    dirty = true;
+    dirtySince = millis();
+  }
+
+  if (index[head].count == EVENT_LOG_RECORDS_PER_PAGE) {
+    flush();
+  }
+}
+
+void EventLog::loop(const unsigned long now) {
+  if (dirty && (now - dirtySince) >= EVENT_LOG_FLUSH_INTERVAL) {
+    flush();
+  }
+}
+
+void EventLog::flush() {
+  if (!ready || !dirty) {
+    return;
+  }
+
+  File f = SPIFFS.open(EVENT_LOG_FILE, "r+");
+
+  if (!f) {
+    stats.writeErrors++;
+    Serial.println(F("ERROR: Couldn't open event log"));
+    return;
+  }
+
+  resolveUptimes();
+
+  const size_t count = index[head].count;
+  const bool written = writePage(f, head, headSeq, page, count);
+  f.close();
+
+  if (!written) {
+    stats.writeErrors++;
+    return;
+  }
+
+  dirty = false;
+
+  if (count == EVENT_LOG_RECORDS_PER_PAGE) {
+    head = (head + 1) % EVENT_LOG_NUM_PAGES;
+    headSeq++;
+    numRestored = 0;
+    index[head].count = 0;
+  }
+}
+
+// Records from before the clock was set can be given a Unix time as long as
+// they're from this boot.
+void EventLog::resolveUptimes() {
+  const time_t now = time(NULL);
+
+  if (now < EVENT_LOG_MIN_VALID_TIME) {
+    return;
+  }
+
+  const uint32_t uptime = millis() / 1000;
+
+  for (size_t i = numRestored; i < index[head].count; i++) {
+    if (page[i].flags & EVENT_LOG_FLAG_UPTIME) {
+      page[i].time = now - (uptime - page[i].time);
+      page[i].flags &= ~EVENT_LOG_FLAG_UPTIME;
+    }
+  }
+
+  indexPage(head, page, index[head].count);
+}
+
+void EventLog::indexPage(const size_t slot, const EventLogRecord* records, const size_t count) {
+  EventLogPageIndex& entry = index[slot];
+
+  entry.minTime = UINT32_MAX;
+  entry.maxTime = 0;
+  entry.count = count;
+
+  for (size_t i = 0; i < count; i++) {
+    if ((records[i].flags & EVENT_LOG_FLAG_UPTIME) == 0) {
+      entry.minTime = std::min(entry.minTime, records[i].time);
+      entry.maxTime = std::max(entry.maxTime, records[i].time);
+    }
+  }
+}
+
+bool EventLog::writePage(File& f, const size_t slot, const uint32_t seq, const EventLogRecord* records, const size_t count) {
+  uint8_t buffer[EVENT_LOG_PAGE_SIZE];
+  EventLogPageHeader* header = reinterpret_cast<EventLogPageHeader*>(buffer);
+
+  memset(buffer, 0, sizeof(buffer));
+  header->magic = EVENT_LOG_MAGIC;
+  header->seq = seq;
+  header->count = count;
+  memcpy(buffer + sizeof(EventLogPageHeader), records, count * sizeof(EventLogRecord));
+
+  if (!f.seek(slot * EVENT_LOG_PAGE_SIZE, SeekSet) || f.write(buffer, sizeof(buffer)) != sizeof(buffer)) {
+    return false;
+  }
+
+  stats.pageWrites++;
+  stats.bytesWritten += sizeof(buffer);
+
+  return true;
+}
+
+bool EventLog::readPage(File& f, const size_t slot, EventLogPageHeader& header, EventLogRecord* records) {
+  if (!f.seek(slot * EVENT_LOG_PAGE_SIZE, SeekSet)
+    || f.read(reinterpret_cast<uint8_t*>(&header), sizeof(header)) != sizeof(header)
+    || header.magic != EVENT_LOG_MAGIC
+    || header.count > EVENT_LOG_RECORDS_PER_PAGE) {
+    return false;
+  }
+
+  const size_t length = header.count * sizeof(EventLogRecord);
+  return f.read(reinterpret_cast<uint8_t*>(records), length) == length;
+}
+
+EventLogQueryStats EventLog::query(const uint32_t from, const uint32_t to, const uint8_t* mac, EventLogVisitor visitor) {
+  EventLogQueryStats result;
+  memset(&result, 0, sizeof(result));
+
+  if (!ready) {
+    return result;
+  }
+
+  const bool timeRange = from > 0 || to < UINT32_MAX;
+  EventLogRecord records[EVENT_LOG_RECORDS_PER_PAGE];
+  EventLogPageHeader header;
+  File f;
+
+  for (size_t i = 1; i <= EVENT_LOG_NUM_PAGES; i++) {
+    const size_t slot = (head + i) % EVENT_LOG_NUM_PAGES;
+    const EventLogPageIndex& entry = index[slot];
+    const EventLogRecord* source = records;
+    size_t count = entry.count;
+
+    if (count == 0 || (timeRange && (entry.maxTime < from || entry.minTime > to))) {
+      result.pagesSkipped++;
+      continue;
+    }
+
+    // The newest page may have records that haven't been written yet.
+    if (slot == head) {
+      source = page;
+    } else {
+      if (!f) {
+        f = SPIFFS.open(EVENT_LOG_FILE, "r");
+      }
+
+      if (!f || !readPage(f, slot, header, records)) {
+        result.pagesSkipped++;
+        continue;
+      }
+
+      count = header.count;
+      result.pagesRead++;
+    }
+
+    for (size_t j = 0; j < count; j++) {
+      if (matches(source[j], timeRange, from, to, mac)) {
+        result.matched++;
+
+        if (!visitor(source[j])) {
+          if (f) {
+            f.close();
+          }
+          return result;
+        }
+      }
+    }
+  }
+
+  if (f) {
+    f.close();
+  }
+
+  return result;
+}
+
+size_t EventLog::capacity() const {
+  return EVENT_LOG_NUM_PAGES * EVENT_LOG_RECORDS_PER_PAGE;
+}
+
+const EventLogStats& EventLog::getStats() const {
+  return stats;
+}
@@ -0,0 +1,121 @@
+#include <Arduino.h>
+#include <FS.h>
+#include <DashEvent.h>
+#include <functional>
+
+#ifndef _EVENT_LOG_H
+#define _EVENT_LOG_H
+
+#define EVENT_LOG_FILE "/events.log"
+
+// SPIFFS pages are 256 bytes, but each starts with a 5 byte header, so a file
+// is stored 251 bytes to a page. Log pages are that size so that rewriting one
+// only rewrites a single SPIFFS page (plus the file's index page).
+#define SPIFFS_PAGE_DATA_SIZE (256 - 5)
+#define EVENT_LOG_PAGE_SIZE SPIFFS_PAGE_DATA_SIZE
+
+#ifndef EVENT_LOG_NUM_PAGES
+#define EVENT_LOG_NUM_PAGES 32
+#endif
+
+// A partially filled page is written out once it's had unwritten records for
+// this long, which bounds what a crash or power cut can lose.
+#ifndef EVENT_LOG_FLUSH_INTERVAL
+#define EVENT_LOG_FLUSH_INTERVAL 60000
+#endif
+
+#define EVENT_LOG_MAGIC 0x444C4F47
+
+// time() returns seconds since boot until SNTP has set the clock.
+#define EVENT_LOG_MIN_VALID_TIME 1500000000
+
+// The record's time is seconds since the boot it happened in.
+#define EVENT_LOG_FLAG_UPTIME 0x01
+
+struct EventLogRecord {
+  // Unix time, or seconds since boot with EVENT_LOG_FLAG_UPTIME if the clock
+  // still wasn't set when the record was written.
+  uint32_t time;
+  uint8_t mac[6];
+  uint8_t type;
+  int8_t rssi;
+  // Position in the device table at the time.
+  uint16_t deviceIx;
+  uint8_t flags;
+  uint8_t reserved;
+};
+
+struct EventLogPageHeader {
+  uint32_t magic;
+  // One higher for every new page, so the highest is the newest.
+  uint32_t seq;
+  uint16_t count;
+  uint8_t reserved[6];
+};
+
+#define EVENT_LOG_RECORDS_PER_PAGE ((EVENT_LOG_PAGE_SIZE - sizeof(EventLogPageHeader)) / sizeof(EventLogRecord))
+
+// Range of Unix times in a page, so queries can skip pages without reading
+// them. Records with EVENT_LOG_FLAG_UPTIME aren't included.
+struct EventLogPageIndex {
+  uint32_t minTime;
+  uint32_t maxTime;
+  uint8_t count;
+};
+
+struct EventLogStats {
+  uint32_t records;
+  uint32_t pageWrites;
+  uint32_t bytesWritten;
+  uint32_t writeErrors;
+};
+
+struct EventLogQueryStats {
+  uint16_t pagesRead;
+  uint16_t pagesSkipped;
+  uint32_t matched;
+};
+
+// Return false to stop the query.
+typedef std::function<bool(const EventLogRecord&)> EventLogVisitor;
+
+// Circular audit log of device events in a fixed-size SPIFFS file. The newest
+// page is kept in RAM and rewritten in place until it fills up, then the
+// next (oldest) page is reused.
+class EventLog {
+public:
+  EventLog();
+
+  // Creates the file if needed, and reads it to rebuild the index.
+  void begin();
+  void record(const DashEventType type, const uint8_t* mac, const size_t deviceIx, const int8_t rssi);
+  void loop(const unsigned long now);
+  void flush();
+
+  // Visits records oldest first. mac may be NULL for any device. Records
+  // without a Unix time only match when there's no time range (from is 0 and
+  // to is UINT32_MAX).
+  EventLogQueryStats query(const uint32_t from, const uint32_t to, const uint8_t* mac, EventLogVisitor visitor);
+
+  size_t capacity() const;
+  const EventLogStats& getStats() const;
+
+private:
+  EventLogPageIndex index[EVENT_LOG_NUM_PAGES];
+  EventLogRecord page[EVENT_LOG_RECORDS_PER_PAGE];
+  size_t head;
+  uint32_t headSeq;
+  // Records in page that were loaded at boot rather than recorded since.
+  size_t numRestored;
+  bool dirty;
+  unsigned long dirtySince;
+  bool ready;
+  EventLogStats stats;
+
+  void resolveUptimes();
+  void indexPage(const size_t slot, const EventLogRecord* records, const size_t count);
+  bool writePage(File& f, const size_t slot, const uint32_t seq, const EventLogRecord* records, const size_t count);
+  bool readPage(File& f, const size_t slot, EventLogPageHeader& header, EventLogRecord* records);
+};
+
+#endif
@@ -0,0 +1,158 @@
+#include <EventPipeline.h>
+#include <algorithm>
+#include <WarmState.h>
+#include <Crc32.h>
+#include <HeapProfiler.h>
+
+const char* DASH_EVENT_NAMES[DASH_NUM_EVENT_TYPES] = {"probe_request", "connected"};
+
+EventPipeline::EventPipeline(Settings& settings)
+  : settings(settings),
+    eventHandler(NULL),
+    deviceEventHandler(NULL)
+{
+  for (size_t i = 0; i < DASH_NUM_EVENT_TYPES; i++) {
+    lastSeenTimes[i] = NULL;
+  }
+
+  resetStats();
+}
+
+EventPipeline::~EventPipeline() {
+  for (size_t i = 0; i < DASH_NUM_EVENT_TYPES; i++) {
+    delete[] lastSeenTimes[i];
+  }
+}
+
+void EventPipeline::onEvent(DashEventHandler handler) {
+  this->eventHandler = handler;
+}
+
+void EventPipeline::onDeviceEvent(DeviceEventHandler handler) {
+  this->deviceEventHandler = handler;
+}
+
+void EventPipeline::resetDevices() {
+  HEAP_SCOPE(HEAP_TAG_EVENTS);
+  // Start every device outside of its debounce window so the first event
+  // after boot isn't swallowed.
+  const unsigned long neverSeen = millis() - settings.debounceThresholdMs - 1;
+
+  for (size_t i = 0; i < DASH_NUM_EVENT_TYPES; i++) {
+    delete[] lastSeenTimes[i];
+
+    lastSeenTimes[i] = new unsigned long[settings.numMonitoredMacs()];
+    std::fill(lastSeenTimes[i], lastSeenTimes[i] + settings.numMonitoredMacs(), neverSeen);
+  }
+}
+
+void EventPipeline::triggerEvent(const DashEventType type, const uint8_t* mac, const int8_t rssi) {
+  HEAP_SCOPE(HEAP_TAG_EVENTS);
+  int macIx = settings.findMonitoredMac(mac);
+  stats.events++;
+
+  if (this->eventHandler) {
+    this->eventHandler(type, mac, macIx);
+  }
+
+  unsigned long timestamp = millis();
+
+  if (macIx == -1) {
+    discovery.record(mac, timestamp);
+  } else if (lastSeenTimes[type] != NULL) {
+    stats.monitoredEvents++;
+
+    if ((timestamp - lastSeenTimes[type][macIx]) > settings.debounceThresholdMs) {
+      if (this->deviceEventHandler) {
+        uint32_t start = micros();
+        this->deviceEventHandler(type, mac, macIx, rssi);
+        uint32_t elapsed = micros() - start;
+
+        stats.publishedEvents++;
+        stats.totalPublishMicros += elapsed;
+        stats.maxPublishMicros = std::max(stats.maxPublishMicros, elapsed);
+      }
+    } else {
+      stats.debouncedEvents++;
+    }
+
+    lastSeenTimes[type][macIx] = timestamp;
+  }
+
+  stats.minFreeHeap = std::min(stats.minFreeHeap, ESP.getFreeHeap());
+}
+
+const EventPipelineStats& EventPipeline::getStats() const {
+  return stats;
+}
+
+DeviceDiscovery& EventPipeline::getDiscovery() {
+  return discovery;
+}
+
+uint32_t EventPipeline::devicesHash() {
+  return Crc32::calculate(settings.monitoredMacs(), settings.numMonitoredMacs() * 6);
+}
+
+size_t EventPipeline::saveState(uint8_t* buffer, const size_t bufferLen) {
+  const size_t numDevices = std::min(
+    settings.numMonitoredMacs(),
+    WarmState::maxDevices(bufferLen, DASH_NUM_EVENT_TYPES)
+  );
+  const unsigned long now = millis();
+
+  uint32_t ages[numDevices * DASH_NUM_EVENT_TYPES + 1];
+  for (size_t i = 0; i < numDevices; i++) {
+    for (size_t j = 0; j < DASH_NUM_EVENT_TYPES; j++) {
+      ages[(i * DASH_NUM_EVENT_TYPES) + j] = lastSeenTimes[j] ? (now - lastSeenTimes[j][i]) : UINT32_MAX;
+    }
+  }
+
+  WarmStateHeader header;
+  header.devicesHash = devicesHash();
+  header.events = stats.events;
+  header.monitoredEvents = stats.monitoredEvents;
+  header.debouncedEvents = stats.debouncedEvents;
+  header.publishedEvents = stats.publishedEvents;
+
+  return WarmState::encode(header, ages, numDevices, DASH_NUM_EVENT_TYPES, buffer, bufferLen);
+}
+
+bool EventPipeline::restoreState(const uint8_t* buffer, const size_t bufferLen) {
+  WarmStateHeader header;
+  const uint32_t* ages;
+
+  if (!WarmState::decode(buffer, bufferLen, DASH_NUM_EVENT_TYPES, header, ages)) {
+    return false;
+  }
+
+  stats.events = header.events;
+  stats.monitoredEvents = header.monitoredEvents;
+  stats.debouncedEvents = header.debouncedEvents;
+  stats.publishedEvents = header.publishedEvents;
+
+  // Ages are only meaningful against the device table they were taken from.
+  if (header.devicesHash != devicesHash()) {
+    return true;
+  }
+
+  const unsigned long now = millis();
+  const size_t numDevices = std::min(static_cast<size_t>(header.numDevices), settings.numMonitoredMacs());
+
+  for (size_t i = 0; i < numDevices; i++) {
+    for (size_t j = 0; j < DASH_NUM_EVENT_TYPES; j++) {
+      const uint32_t age = ages[(i * DASH_NUM_EVENT_TYPES) + j];
+
+      if (lastSeenTimes[j] && age <= settings.debounceThresholdMs) {
+        lastSeenTimes[j][i] = now - age;
+      }
+    }
+  }
+
+  return true;
+}
+
+void EventPipeline::resetStats() {
+  memset(&stats, 0, sizeof(stats));
+  stats.minFreeHeap = ESP.getFreeHeap();
+}
@@ -0,0 +1,58 @@
+#include <Arduino.h>
+#include <functional>
+#include <Settings.h>
+#include <DashEvent.h>
+#include <DeviceDiscovery.h>
+
+#ifndef _EVENT_PIPELINE_H
+#define _EVENT_PIPELINE_H
+
+typedef std::function<void(const DashEventType type, const uint8_t* mac, const int deviceIx)> DashEventHandler;
+typedef std::function<void(const DashEventType type, const uint8_t* mac, const size_t deviceIx, const int8_t rssi)> DeviceEventHandler;
+
+struct EventPipelineStats {
+  uint32_t events;
+  uint32_t monitoredEvents;
+  uint32_t debouncedEvents;
+  uint32_t publishedEvents;
+  uint32_t totalPublishMicros;
+  uint32_t maxPublishMicros;
+  uint32_t minFreeHeap;
+};
+
+// Takes raw WiFi events (probe requests, station connections), debounces the
+// ones from monitored devices and hands them to the registered sinks. Has no
+// dependencies on the WiFi stack itself so the same path can be driven from
+// recorded or synthetic traffic.
+class EventPipeline {
+public:
+  EventPipeline(Settings& settings);
+  ~EventPipeline();
+
+  void onEvent(DashEventHandler handler);
+  void onDeviceEvent(DeviceEventHandler handler);
+
+  void triggerEvent(const DashEventType type, const uint8_t* mac, const int8_t rssi = 0);
+  void resetDevices();
+
+  const EventPipelineStats& getStats() const;
+  void resetStats();
+
+  DeviceDiscovery& getDiscovery();
+
+  // Snapshot of debounce state and counters, see WarmState.
+  size_t saveState(uint8_t* buffer, const size_t bufferLen);
+  bool restoreState(const uint8_t* buffer, const size_t bufferLen);
+
+private:
+  Settings& settings;
+  DashEventHandler eventHandler;
+  DeviceEventHandler deviceEventHandler;
+  unsigned long* lastSeenTimes[DASH_NUM_EVENT_TYPES];
+  EventPipelineStats stats;
+  DeviceDiscovery discovery;
+
+  uint32_t devicesHash();
+};
+
+#endif
@@ -0,0 +1,43 @@
+#include <EventRing.h>
+
+EventRing::EventRing(const size_t capacity)
+  : records(new DashEventRecord[capacity]),
+    _capacity(capacity),
+    nextSeq(1)
+{ }
+
+EventRing::~EventRing() {
+  delete[] records;
+}
+
+uint32_t EventRing::push(const DashEventType type, const uint8_t* mac, const uint8_t flags) {
+  DashEventRecord& record = records[nextSeq % _capacity];
+
+  record.seq = nextSeq;
+  record.timestamp = millis();
+  memcpy(record.mac, mac, 6);
+  record.type = type;
+  record.flags = flags;
+
+  return nextSeq++;
+}
+
+uint32_t EventRing::head() const {
+  return nextSeq;
+}
+
+uint32_t EventRing::tail() const {
+  return nextSeq > _capacity ? (nextSeq - _capacity) : 1;
+}
+
+size_t EventRing::capacity() const {
+  return _capacity;
+}
+
+const DashEventRecord* EventRing::get(const uint32_t seq) const {
+  if (seq < tail() || seq >= nextSeq) {
+    return NULL;
+  }
+
+  return &records[seq % _capacity];
+}
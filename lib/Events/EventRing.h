@@ -0,0 +1,46 @@
+#include <Arduino.h>
+#include <DashEvent.h>
+
+#ifndef _EVENT_RING_H
+#define _EVENT_RING_H
+
+#define EVENT_FLAG_MONITORED 0x01
+#define EVENT_FLAG_SYNTHETIC 0x02
+
+struct DashEventRecord {
+  uint32_t seq;
+  uint32_t timestamp;
+  uint8_t mac[6];
+  uint8_t type;
+  uint8_t flags;
+};
+
+// Fixed-capacity ring of recent events. Every event gets a sequence number
+// one higher than the last (starting at 1), so readers can keep a cursor and
+// tell exactly what they've missed once it falls out of the ring.
+class EventRing {
+public:
+  EventRing(const size_t capacity);
+  ~EventRing();
+
+  uint32_t push(const DashEventType type, const uint8_t* mac, const uint8_t flags);
+
+  // Sequence number the next event will get.
+  uint32_t head() const;
+  // Oldest sequence number still held.
+  uint32_t tail() const;
+  size_t capacity() const;
+
+  // Returns NULL if seq hasn't happened yet or has been overwritten.
+  const DashEventRecord* get(const uint32_t seq) const;
+
+private:
+  DashEventRecord* records;
+  size_t _capacity;
+  uint32_t nextSeq;
+
+  EventRing(const EventRing&);
+  EventRing& operator=(const EventRing&);
+};
+
+#endif
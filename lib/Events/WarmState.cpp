@@ -0,0 +1,129 @@
+#include <WarmState.h>
+#include <Crc32.h>
+#include <stddef.h>
+
+#define WARM_STATE_CRC_START (offsetof(WarmStateHeader, crc) + sizeof(uint32_t))
+#define WARM_STATE_PENDING_CRC_START (offsetof(WarmStatePendingHeader, crc) + sizeof(uint32_t))
+
+size_t WarmState::encode(
+  WarmStateHeader& header,
+  const uint32_t* ages,
+  const size_t numDevices,
+  const size_t numEventTypes,
+  uint8_t* buffer,
+  const size_t bufferLen
+) {
+  if (bufferLen < sizeof(WarmStateHeader)) {
+    return 0;
+  }
+
+  const size_t rowSize = numEventTypes * sizeof(uint32_t);
+  const size_t fittingDevices = maxDevices(bufferLen, numEventTypes);
+  const size_t devicesToWrite = numDevices < fittingDevices ? numDevices : fittingDevices;
+  const size_t length = sizeof(WarmStateHeader) + (devicesToWrite * rowSize);
+
+  header.magic = WARM_STATE_MAGIC;
+  header.length = length;
+  header.numDevices = devicesToWrite;
+
+  memcpy(buffer + sizeof(WarmStateHeader), ages, devicesToWrite * rowSize);
+  memcpy(buffer, &header, sizeof(WarmStateHeader));
+
+  header.crc = checksum(buffer, length);
+  memcpy(buffer + offsetof(WarmStateHeader, crc), &header.crc, sizeof(header.crc));
+
+  return length;
+}
+
+size_t WarmState::maxDevices(const size_t bufferLen, const size_t numEventTypes) {
+  if (bufferLen < sizeof(WarmStateHeader)) {
+    return 0;
+  }
+
+  return (bufferLen - sizeof(WarmStateHeader)) / (numEventTypes * sizeof(uint32_t));
+}
+
+bool WarmState::decode(
+  const uint8_t* buffer,
+  const size_t bufferLen,
+  const size_t numEventTypes,
+  WarmStateHeader& header,
+  const uint32_t*& ages
+) {
+  if (bufferLen < sizeof(WarmStateHeader)) {
+    return false;
+  }
+
+  memcpy(&header, buffer, sizeof(WarmStateHeader));
+
+  if (header.magic != WARM_STATE_MAGIC
+    || header.length > bufferLen
+    || header.length != sizeof(WarmStateHeader) + (header.numDevices * numEventTypes * sizeof(uint32_t))
+    || header.crc != checksum(buffer, header.length)) {
+    return false;
+  }
+
+  ages = reinterpret_cast<const uint32_t*>(buffer + sizeof(WarmStateHeader));
+  return true;
+}
+
+size_t WarmState::encodePending(const CapturedEvent* events, const size_t numEvents, uint8_t* buffer, const size_t bufferLen) {
+  // RTC memory is written in 4-byte blocks, so the length is rounded up.
+  const size_t usableLen = bufferLen & ~static_cast<size_t>(3);
+
+  if (usableLen < sizeof(WarmStatePendingHeader)) {
+    return 0;
+  }
+
+  const size_t fittingEvents = (usableLen - sizeof(WarmStatePendingHeader)) / sizeof(CapturedEvent);
+  const size_t eventsToWrite = numEvents < fittingEvents ? numEvents : fittingEvents;
+  const size_t length = sizeof(WarmStatePendingHeader) + (eventsToWrite * sizeof(CapturedEvent));
+  const size_t paddedLength = (length + 3) & ~static_cast<size_t>(3);
+
+  WarmStatePendingHeader header;
+  header.magic = WARM_STATE_PENDING_MAGIC;
+  header.length = paddedLength;
+  header.numEvents = eventsToWrite;
+
+  memset(buffer, 0, paddedLength);
+  memcpy(buffer, &header, sizeof(header));
+  memcpy(buffer + sizeof(header), events, eventsToWrite * sizeof(CapturedEvent));
+
+  header.crc = Crc32::calculate(buffer + WARM_STATE_PENDING_CRC_START, paddedLength - WARM_STATE_PENDING_CRC_START);
+  memcpy(buffer + offsetof(WarmStatePendingHeader, crc), &header.crc, sizeof(header.crc));
+
+  return paddedLength;
+}
+
+bool WarmState::decodePending(
+  const uint8_t* buffer,
+  const size_t bufferLen,
+  const CapturedEvent*& events,
+  size_t& numEvents,
+  size_t& length
+) {
+  WarmStatePendingHeader header;
+
+  if (bufferLen < sizeof(header)) {
+    return false;
+  }
+
+  memcpy(&header, buffer, sizeof(header));
+
+  if (header.magic != WARM_STATE_PENDING_MAGIC
+    || header.length > bufferLen
+    || header.length < sizeof(header) + (header.numEvents * sizeof(CapturedEvent))
+    || header.crc != Crc32::calculate(buffer + WARM_STATE_PENDING_CRC_START, header.length - WARM_STATE_PENDING_CRC_START)) {
+    return false;
+  }
+
+  events = reinterpret_cast<const CapturedEvent*>(buffer + sizeof(header));
+  numEvents = header.numEvents;
+  length = header.length;
+
+  return true;
+}
+
+uint32_t WarmState::checksum(const uint8_t* buffer, const size_t length) {
+  return Crc32::calculate(buffer + WARM_STATE_CRC_START, length - WARM_STATE_CRC_START);
+}
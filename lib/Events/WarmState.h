@@ -0,0 +1,79 @@
+#include <Arduino.h>
+#include <CaptureQueue.h>
+
+#ifndef _WARM_STATE_H
+#define _WARM_STATE_H
+
+#define WARM_STATE_MAGIC 0x44535731
+#define WARM_STATE_PENDING_MAGIC 0x44535750
+
+struct WarmStateHeader {
+  uint32_t magic;
+  // CRC-32 of everything following this field, including the device ages.
+  uint32_t crc;
+  uint16_t length;
+  uint16_t numDevices;
+  // CRC-32 of the monitored MAC table the ages belong to.
+  uint32_t devicesHash;
+  uint32_t events;
+  uint32_t monitoredEvents;
+  uint32_t debouncedEvents;
+  uint32_t publishedEvents;
+};
+
+struct WarmStatePendingHeader {
+  uint32_t magic;
+  // CRC-32 of everything following this field, including the events.
+  uint32_t crc;
+  uint16_t length;
+  uint16_t numEvents;
+};
+
+// Compact, checksummed snapshot of debounce state and counters that can be
+// kept across a soft restart. Layout is the header followed by numDevices
+// rows of per-event-type ages (milliseconds since the device was last seen).
+class WarmState {
+public:
+  // Returns the number of bytes written, always a multiple of 4. Devices that
+  // don't fit in buffer are left out. Returns 0 if not even the header fits.
+  static size_t encode(
+    WarmStateHeader& header,
+    const uint32_t* ages,
+    const size_t numDevices,
+    const size_t numEventTypes,
+    uint8_t* buffer,
+    const size_t bufferLen
+  );
+
+  static size_t maxDevices(const size_t bufferLen, const size_t numEventTypes);
+
+  // Events that are still waiting to be published get their own section,
+  // laid out as the header followed by numEvents CapturedEvents. Same return
+  // value as encode(); events that don't fit are left out.
+  static size_t encodePending(const CapturedEvent* events, const size_t numEvents, uint8_t* buffer, const size_t bufferLen);
+
+  // On success, events points into buffer and length is the size of the
+  // section.
+  static bool decodePending(
+    const uint8_t* buffer,
+    const size_t bufferLen,
+    const CapturedEvent*& events,
+    size_t& numEvents,
+    size_t& length
+  );
+
+  // Validates magic, length and checksum. On success, ages points into
+  // buffer.
+  static bool decode(
+    const uint8_t* buffer,
+    const size_t bufferLen,
+    const size_t numEventTypes,
+    WarmStateHeader& header,
+    const uint32_t*& ages
+  );
+
+private:
+  static uint32_t checksum(const uint8_t* buffer, const size_t length);
+};
+
+#endif
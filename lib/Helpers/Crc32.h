@@ -0,0 +1,29 @@
+#include <Arduino.h>
+
+#ifndef _CRC32_H
+#define _CRC32_H
+
+class Crc32 {
+public:
+  // Bitwise CRC-32 (IEEE 802.3). Slower than a table-driven version, but the
+  // inputs here are small and it needs no table in RAM or flash.
+  static uint32_t update(uint32_t crc, const uint8_t* data, size_t len) {
+    crc = ~crc;
+
+    for (size_t i = 0; i < len; i++) {
+      crc ^= data[i];
+
+      for (size_t j = 0; j < 8; j++) {
+        crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+      }
+    }
+
+    return ~crc;
+  }
+
+  static uint32_t calculate(const uint8_t* data, size_t len) {
+    return update(0, data, len);
+  }
+};
+
+#endif
@@ -6,15 +6,19 @@
 class IntParsing {
 public:
   static void bytesToHexStr(const uint8_t* bytes, const size_t len, char* buffer, size_t maxLen, const char sep = ' ') {
+    static const char HEX_DIGITS[] = "0123456789ABCDEF";
     char* p = buffer;
 
     for (size_t i = 0; i < len && (p - buffer) < (maxLen - 3); i++) {
-      p += sprintf(p, "%02X", bytes[i]);
+      *p++ = HEX_DIGITS[bytes[i] >> 4];
+      *p++ = HEX_DIGITS[bytes[i] & 0x0F];
 
       if (i < (len - 1)) {
-        p += sprintf(p, "%c", sep);
+        *p++ = sep;
       }
     }
+
+    *p = 0;
   }
 
   static void parseDelimitedBytes(const char* s, uint8_t* buffer, const size_t bufferLen, const char delimiter = ':') {
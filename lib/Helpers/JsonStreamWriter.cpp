@@ -0,0 +1,124 @@
+#include <JsonStreamWriter.h>
+
+JsonStreamWriter::JsonStreamWriter(Print& out)
+  : out(out),
+    nonEmpty(0),
+    depth(0),
+    afterKey(false)
+{ }
+
+void JsonStreamWriter::beforeValue() {
+  if (afterKey) {
+    afterKey = false;
+    return;
+  }
+
+  const uint32_t bit = 1 << depth;
+
+  if (nonEmpty & bit) {
+    out.write(',');
+  }
+
+  nonEmpty |= bit;
+}
+
+void JsonStreamWriter::writeString(const char* s) {
+  out.write('"');
+
+  for (const char* p = s; *p; p++) {
+    const char c = *p;
+
+    if (c == '"' || c == '\\') {
+      out.write('\\');
+      out.write(c);
+    } else if (static_cast<uint8_t>(c) < 0x20) {
+      char escaped[7];
+      sprintf(escaped, "\\u%04X", c);
+      out.print(escaped);
+    } else {
+      out.write(c);
+    }
+  }
+
+  out.write('"');
+}
+
+JsonStreamWriter& JsonStreamWriter::beginObject() {
+  beforeValue();
+  out.write('{');
+  nonEmpty &= ~(1 << ++depth);
+  return *this;
+}
+
+JsonStreamWriter& JsonStreamWriter::endObject() {
+  out.write('}');
+  depth--;
+  return *this;
+}
+
+JsonStreamWriter& JsonStreamWriter::beginArray() {
+  beforeValue();
+  out.write('[');
+  nonEmpty &= ~(1 << ++depth);
+  return *this;
+}
+
+JsonStreamWriter& JsonStreamWriter::endArray() {
+  out.write(']');
+  depth--;
+  return *this;
+}
+
+JsonStreamWriter& JsonStreamWriter::key(const char* key) {
+  beforeValue();
+  writeString(key);
+  out.write(':');
+  afterKey = true;
+  return *this;
+}
+
+JsonStreamWriter& JsonStreamWriter::value(const char* value) {
+  beforeValue();
+  writeString(value);
+  return *this;
+}
+
+JsonStreamWriter& JsonStreamWriter::value(const String& value) {
+  return this->value(value.c_str());
+}
+
+JsonStreamWriter& JsonStreamWriter::value(bool value) {
+  beforeValue();
+  out.print(value ? F("true") : F("false"));
+  return *this;
+}
+
+JsonStreamWriter& JsonStreamWriter::value(int value) {
+  beforeValue();
+  out.print(value);
+  return *this;
+}
+
+JsonStreamWriter& JsonStreamWriter::value(unsigned int value) {
+  beforeValue();
+  out.print(value);
+  return *this;
+}
+
+JsonStreamWriter& JsonStreamWriter::value(long value) {
+  beforeValue();
+  out.print(value);
+  return *this;
+}
+
+JsonStreamWriter& JsonStreamWriter::value(unsigned long value) {
+  beforeValue();
+  out.print(value);
+  return *this;
+}
+
+JsonStreamWriter& JsonStreamWriter::nullValue() {
+  beforeValue();
+  out.print(F("null"));
+  return *this;
+}
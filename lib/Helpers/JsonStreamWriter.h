@@ -0,0 +1,43 @@
+#include <Arduino.h>
+
+#ifndef _JSON_STREAM_WRITER_H
+#define _JSON_STREAM_WRITER_H
+
+// Writes JSON straight to a Print as it's generated, without building a
+// document in memory first. Nesting depth is limited to 32.
+class JsonStreamWriter {
+public:
+  JsonStreamWriter(Print& out);
+
+  JsonStreamWriter& beginObject();
+  JsonStreamWriter& endObject();
+  JsonStreamWriter& beginArray();
+  JsonStreamWriter& endArray();
+  JsonStreamWriter& key(const char* key);
+
+  JsonStreamWriter& value(const char* value);
+  JsonStreamWriter& value(const String& value);
+  JsonStreamWriter& value(bool value);
+  JsonStreamWriter& value(int value);
+  JsonStreamWriter& value(unsigned int value);
+  JsonStreamWriter& value(long value);
+  JsonStreamWriter& value(unsigned long value);
+  JsonStreamWriter& nullValue();
+
+  template <typename T>
+  JsonStreamWriter& field(const char* k, T v) {
+    key(k);
+    return value(v);
+  }
+
+private:
+  Print& out;
+  uint32_t nonEmpty;
+  uint8_t depth;
+  bool afterKey;
+
+  void beforeValue();
+  void writeString(const char* s);
+};
+
+#endif
@@ -0,0 +1,46 @@
+#include <OuiLookup.h>
+#include <oui_table.h>
+
+PGM_P OuiLookup::findVendor(const uint8_t* mac) {
+  if (mac[0] & 0x02) {
+    return NULL;
+  }
+
+  const uint32_t oui = (static_cast<uint32_t>(mac[0]) << 16)
+    | (static_cast<uint32_t>(mac[1]) << 8)
+    | mac[2];
+
+  // Binary search reading each probe straight from flash.
+  size_t lo = 0;
+  size_t hi = OUI_TABLE_SIZE;
+
+  while (lo < hi) {
+    const size_t mid = (lo + hi) / 2;
+    const uint32_t entry = pgm_read_dword(&OUI_ENTRIES[mid]);
+    const uint32_t entryOui = entry >> 8;
+
+    if (entryOui == oui) {
+      const uint16_t offset = pgm_read_word(&OUI_VENDOR_OFFSETS[entry & 0xFF]);
+      return OUI_VENDORS + offset;
+    } else if (entryOui < oui) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  return NULL;
+}
+
+bool OuiLookup::findVendor(const uint8_t* mac, char* buffer, size_t bufferLen) {
+  PGM_P vendor = findVendor(mac);
+
+  if (vendor == NULL || bufferLen == 0) {
+    return false;
+  }
+
+  strncpy_P(buffer, vendor, bufferLen - 1);
+  buffer[bufferLen - 1] = 0;
+
+  return true;
+}
@@ -0,0 +1,19 @@
+#include <Arduino.h>
+
+#ifndef _OUI_LOOKUP_H
+#define _OUI_LOOKUP_H
+
+// Vendor names are truncated to 24 characters by .build_oui.py.
+#define OUI_MAX_VENDOR_LENGTH 25
+
+class OuiLookup {
+public:
+  // Returns a pointer into flash (use the _P string functions), or NULL if the
+  // vendor isn't known or the address is locally administered (randomized).
+  static PGM_P findVendor(const uint8_t* mac);
+
+  // Copies the vendor name into buffer. Returns false if it isn't known.
+  static bool findVendor(const uint8_t* mac, char* buffer, size_t bufferLen);
+};
+
+#endif
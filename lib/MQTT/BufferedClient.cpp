@@ -0,0 +1,126 @@
+#include <BufferedClient.h>
+
+BufferedClient::BufferedClient(Client& client)
+  : client(client),
+    length(0),
+    bufferedSince(0),
+    failed(false)
+{
+  memset(&stats, 0, sizeof(stats));
+}
+
+int BufferedClient::connect(IPAddress ip, uint16_t port) {
+  // Anything left over was meant for the last connection.
+  length = 0;
+  failed = false;
+  return client.connect(ip, port);
+}
+
+int BufferedClient::connect(const char* host, uint16_t port) {
+  length = 0;
+  failed = false;
+  return client.connect(host, port);
+}
+
+size_t BufferedClient::write(uint8_t b) {
+  return write(&b, 1);
+}
+
+size_t BufferedClient::write(const uint8_t* buf, size_t size) {
+  stats.writes++;
+
+  if (length > 0 && (length + size > sizeof(buffer) || (millis() - bufferedSince) >= MQTT_WRITE_MAX_DELAY)) {
+    flushBuffer();
+  }
+
+  if (failed) {
+    return 0;
+  }
+
+  // Too big to buffer, and there's nothing to coalesce it with anyway.
+  if (size > sizeof(buffer)) {
+    return send(buf, size) ? size : 0;
+  }
+
+  if (length == 0) {
+    bufferedSince = millis();
+  }
+
+  memcpy(buffer + length, buf, size);
+  length += size;
+
+  return size;
+}
+
+int BufferedClient::available() {
+  flushBuffer();
+  return client.available();
+}
+
+int BufferedClient::read() {
+  flushBuffer();
+  return client.read();
+}
+
+int BufferedClient::read(uint8_t* buf, size_t size) {
+  flushBuffer();
+  return client.read(buf, size);
+}
+
+int BufferedClient::peek() {
+  flushBuffer();
+  return client.peek();
+}
+
+bool BufferedClient::flush(unsigned int maxWaitMs) {
+  flushBuffer();
+  return client.flush(maxWaitMs);
+}
+
+bool BufferedClient::stop(unsigned int maxWaitMs) {
+  // e.g. a DISCONNECT packet.
+  flushBuffer();
+  return client.stop(maxWaitMs);
+}
+
+uint8_t BufferedClient::connected() {
+  return !failed && client.connected();
+}
+
+BufferedClient::operator bool() {
+  return static_cast<bool>(client);
+}
+
+bool BufferedClient::flushBuffer() {
+  if (length > 0 && !failed) {
+    send(buffer, length);
+  }
+  length = 0;
+
+  return !failed;
+}
+
+void BufferedClient::loop() {
+  if (length > 0 && (millis() - bufferedSince) >= MQTT_WRITE_MAX_DELAY) {
+    flushBuffer();
+  }
+}
+
+bool BufferedClient::send(const uint8_t* buf, size_t size) {
+  const size_t written = client.write(buf, size);
+
+  stats.flushes++;
+  stats.bytes += written;
+
+  if (written != size) {
+    stats.failures++;
+    failed = true;
+    return false;
+  }
+
+  return true;
+}
+
+const BufferedClientStats& BufferedClient::getStats() const {
+  return stats;
+}
@@ -0,0 +1,72 @@
+#include <Arduino.h>
+#include <Client.h>
+
+#ifndef _BUFFERED_CLIENT_H
+#define _BUFFERED_CLIENT_H
+
+// Writes are collected here and sent to the transport together, so a burst
+// of publishes goes out as one TCP segment (or TLS record) rather than one
+// per packet. Defaults to a segment's worth at the usual MSS.
+#ifndef MQTT_WRITE_BUFFER_SIZE
+#define MQTT_WRITE_BUFFER_SIZE 1460
+#endif
+
+// Longest anything sits in the buffer, in ms.
+#ifndef MQTT_WRITE_MAX_DELAY
+#define MQTT_WRITE_MAX_DELAY 20
+#endif
+
+struct BufferedClientStats {
+  // Writes by the MQTT client, about one per packet.
+  uint32_t writes;
+  // Writes to the transport.
+  uint32_t flushes;
+  uint32_t bytes;
+  uint32_t failures;
+};
+
+// Client that coalesces writes to another Client. The buffer is flushed when
+// it would overflow, when MQTT_WRITE_MAX_DELAY has passed, and before anything
+// is read, since the other side can't answer what it hasn't received.
+//
+// Once a write to the transport fails, the connection is treated as broken
+// until the next connect(): writes return 0, flushBuffer() returns false, and
+// connected() is false so the MQTT client reconnects.
+class BufferedClient : public Client {
+public:
+  BufferedClient(Client& client);
+
+  virtual int connect(IPAddress ip, uint16_t port) override;
+  virtual int connect(const char* host, uint16_t port) override;
+  virtual size_t write(uint8_t b) override;
+  virtual size_t write(const uint8_t* buf, size_t size) override;
+  virtual int available() override;
+  virtual int read() override;
+  virtual int read(uint8_t* buf, size_t size) override;
+  virtual int peek() override;
+  virtual bool flush(unsigned int maxWaitMs = 0) override;
+  virtual bool stop(unsigned int maxWaitMs = 0) override;
+  virtual uint8_t connected() override;
+  virtual operator bool() override;
+
+  // Sends anything buffered. Returns false if this or any earlier transport
+  // write since the last connect() failed, in which case the buffered data is
+  // dropped.
+  bool flushBuffer();
+  // Flushes if the buffer has been waiting longer than MQTT_WRITE_MAX_DELAY.
+  void loop();
+
+  const BufferedClientStats& getStats() const;
+
+private:
+  Client& client;
+  uint8_t buffer[MQTT_WRITE_BUFFER_SIZE];
+  size_t length;
+  unsigned long bufferedSince;
+  bool failed;
+  BufferedClientStats stats;
+
+  bool send(const uint8_t* buf, size_t size);
+};
+
+#endif
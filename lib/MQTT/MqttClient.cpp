@@ -4,26 +4,83 @@
 #include <IntParsing.h>
 #include <ArduinoJson.h>
 #include <WiFiClient.h>
+#include <FS.h>
+#include <ESP8266WiFi.h>
+#include <HeapProfiler.h>
+
+#ifndef DASH_DISABLE_MQTT_TLS
+// Lives outside of MqttClient so that the client recreated when settings are
+// applied can resume the last session rather than doing a full handshake.
+static BearSSL::Session tlsSession;
+#endif
 
 MqttClient::MqttClient(Settings& settings)
   : settings(settings),
-    lastConnectAttempt(0)
+    lastConnectAttempt(0),
+    numSubscriptions(0),
+    messageHandler(NULL)
+#ifndef DASH_DISABLE_MQTT_TLS
+    , secureClient(NULL),
+    trustAnchors(NULL),
+    fragmentLengthProbed(false)
+#endif
 {
+  memset(&stats, 0, sizeof(stats));
+
   String strDomain = settings.mqttServer();
   this->domain = new char[strDomain.length() + 1];
   strcpy(this->domain, strDomain.c_str());
 
-  this->mqttClient = new PubSubClient(tcpClient);
+  this->tcpClient = createTransport();
+  // Writes are coalesced by bufferedClient, Nagle would only hold them up.
+  this->tcpClient->setNoDelay(true);
+  this->bufferedClient = new BufferedClient(*tcpClient);
+  this->mqttClient = new PubSubClient(*bufferedClient);
 }
 
 MqttClient::~MqttClient() {
   mqttClient->disconnect();
-  delete this->domain;
+  delete mqttClient;
+  delete bufferedClient;
+  delete tcpClient;
+#ifndef DASH_DISABLE_MQTT_TLS
+  delete trustAnchors;
+#endif
+  delete[] this->domain;
+}
+
+WiFiClient* MqttClient::createTransport() {
+#ifndef DASH_DISABLE_MQTT_TLS
+  if (settings.mqttTls) {
+    stats.tls = true;
+    secureClient = new BearSSL::WiFiClientSecure();
+    secureClient->setSession(&tlsSession);
+
+    if (strlen(settings.mqttTlsFingerprint()) > 0) {
+      secureClient->setFingerprint(settings.mqttTlsFingerprint());
+    } else if (SPIFFS.exists(MQTT_CA_CERT_FILE)) {
+      File f = SPIFFS.open(MQTT_CA_CERT_FILE, "r");
+      String pem = f.readString();
+      f.close();
+
+      trustAnchors = new BearSSL::X509List(pem.c_str());
+      secureClient->setTrustAnchors(trustAnchors);
+    } else {
+      // With nothing to verify against, every handshake fails. That's on
+      // purpose: the broker is never trusted blindly.
+      Serial.println(F("ERROR: MQTT TLS needs a fingerprint or a CA certificate"));
+    }
+
+    return secureClient;
+  }
+#endif
+
+  return new WiFiClient();
 }
 
 void MqttClient::begin() {
 #ifdef MQTT_DEBUG
-  const char* server = settings._mqttServer.c_str();
+  const char* server = settings.mqttServerWithPort();
   printf(
     "MqttClient - Connecting to: %s\n",
     server
@@ -40,6 +97,18 @@ void MqttClient::begin() {
 }
 
 bool MqttClient::connect() {
+#ifndef DASH_DISABLE_MQTT_TLS
+  // Costs a handshake of its own, so it's only done once per broker.
+  if (secureClient && !fragmentLengthProbed) {
+    fragmentLengthProbed = true;
+
+    if (BearSSL::WiFiClientSecure::probeMaxFragmentLength(this->domain, settings.mqttPort(), MQTT_TLS_BUFFER_SIZE)) {
+      secureClient->setBufferSizes(MQTT_TLS_BUFFER_SIZE, MQTT_TLS_BUFFER_SIZE);
+      stats.reducedTlsBuffers = true;
+    }
+  }
+#endif
+
   char nameBuffer[30];
   sprintf_P(nameBuffer, PSTR("dash-stadium-%u"), ESP.getChipId());
 
@@ -47,11 +116,11 @@ bool MqttClient::connect() {
     Serial.println(F("MqttClient - connecting"));
 #endif
 
-  if (settings.mqttUsername.length() > 0) {
+  if (strlen(settings.mqttUsername()) > 0) {
     return mqttClient->connect(
       nameBuffer,
-      settings.mqttUsername.c_str(),
-      settings.mqttPassword.c_str()
+      settings.mqttUsername(),
+      settings.mqttPassword()
     );
   } else {
     return mqttClient->connect(nameBuffer);
@@ -59,18 +128,29 @@ bool MqttClient::connect() {
 }
 
 void MqttClient::reconnect() {
+  // Nothing to connect through yet. Not counted as an attempt, so the first
+  // one happens as soon as the station interface comes up.
+  if (WiFi.status() != WL_CONNECTED) {
+    return;
+  }
+
   if (lastConnectAttempt > 0 && (millis() - lastConnectAttempt) < MQTT_CONNECTION_ATTEMPT_FREQUENCY) {
     return;
   }
 
   if (! mqttClient->connected()) {
+    const unsigned long start = millis();
+
     if (connect()) {
+      stats.connects++;
+      stats.lastConnectMillis = millis() - start;
       subscribe();
 
 #ifdef MQTT_DEBUG
       Serial.println(F("MqttClient - Successfully connected to MQTT server"));
 #endif
     } else {
+      stats.failures++;
       Serial.println(F("ERROR: Failed to connect to MQTT server"));
     }
   }
@@ -79,32 +159,101 @@ void MqttClient::reconnect() {
 }
 
 void MqttClient::handleClient() {
+  HEAP_SCOPE(HEAP_TAG_MQTT);
   reconnect();
   mqttClient->loop();
+  bufferedClient->loop();
 }
 
-void MqttClient::sendUpdate(const char* eventType, const char* macAddr, const char* deviceAlias) {
-  String topic = settings.mqttTopicPattern;
-
-  if (topic.length() == 0) {
-    return;
-  }
+bool MqttClient::flush() {
+  return bufferedClient->flushBuffer();
+}
 
-  topic.replace(":event_type", eventType);
-  topic.replace(":mac_addr", macAddr);
-  topic.replace(":device_alias", deviceAlias);
+bool MqttClient::connected() {
+  return mqttClient->connected();
+}
 
+bool MqttClient::sendUpdate(const char* topic, const char* payload) {
+  HEAP_SCOPE(HEAP_TAG_MQTT);
 #ifdef MQTT_DEBUG
-  printf("MqttClient - publishing update to %s: %s\n", topic.c_str(), DASH_MQTT_PAYLOAD);
+  printf("MqttClient - publishing update to %s: %s\n", topic, payload);
 #endif
 
-  mqttClient->publish(topic.c_str(), DASH_MQTT_PAYLOAD);
+  return mqttClient->publish(topic, payload);
+}
+
+bool MqttClient::publish(const char* topic, const char* payload, const bool retained) {
+  HEAP_SCOPE(HEAP_TAG_MQTT);
+  return mqttClient->publish(topic, payload, retained);
+}
+
+bool MqttClient::publish(const char* topic, const uint8_t* payload, const size_t length) {
+  HEAP_SCOPE(HEAP_TAG_MQTT);
+  return mqttClient->publish(topic, payload, length);
+}
+
+bool MqttClient::addSubscription(const char* topic) {
+  for (size_t i = 0; i < numSubscriptions; i++) {
+    if (subscriptions[i] == topic) {
+      return true;
+    }
+  }
+
+  if (numSubscriptions == MQTT_MAX_SUBSCRIPTIONS) {
+    Serial.println(F("ERROR: Too many MQTT subscriptions"));
+    return false;
+  }
+
+  subscriptions[numSubscriptions++] = topic;
+
+  if (mqttClient->connected()) {
+    mqttClient->subscribe(topic);
+  }
+
+  return true;
+}
+
+void MqttClient::removeSubscription(const char* topic) {
+  for (size_t i = 0; i < numSubscriptions; i++) {
+    if (subscriptions[i] == topic) {
+      subscriptions[i] = subscriptions[--numSubscriptions];
+      subscriptions[numSubscriptions] = String();
+
+      if (mqttClient->connected()) {
+        mqttClient->unsubscribe(topic);
+      }
+
+      return;
+    }
+  }
+}
+
+void MqttClient::refreshSubscription(const char* topic) {
+  if (mqttClient->connected()) {
+    mqttClient->subscribe(topic);
+  }
+}
+
+const MqttConnectionStats& MqttClient::getStats() const {
+  return stats;
+}
+
+const BufferedClientStats& MqttClient::getWriteStats() const {
+  return bufferedClient->getStats();
+}
+
+void MqttClient::onMessage(MqttMessageHandler handler) {
+  this->messageHandler = handler;
 }
 
 void MqttClient::subscribe() {
-  // PubSubClient won't connect unless we subscribe to something...
-  mqttClient->subscribe("fake_topic_12349081209348");
+  for (size_t i = 0; i < numSubscriptions; i++) {
+    mqttClient->subscribe(subscriptions[i].c_str());
+  }
 }
 
 void MqttClient::publishCallback(char* topic, byte* payload, int length) {
+  if (this->messageHandler) {
+    this->messageHandler(topic, payload, length);
+  }
 }
@@ -1,16 +1,45 @@
 #include <Settings.h>
 #include <PubSubClient.h>
 #include <WiFiClient.h>
+#include <BufferedClient.h>
+
+#ifndef DASH_DISABLE_MQTT_TLS
+#include <WiFiClientSecureBearSSL.h>
+#endif
 
 #ifndef MQTT_CONNECTION_ATTEMPT_FREQUENCY
 #define MQTT_CONNECTION_ATTEMPT_FREQUENCY 5000
 #endif
 
+#ifndef MQTT_MAX_SUBSCRIPTIONS
+#define MQTT_MAX_SUBSCRIPTIONS 4
+#endif
+
+// BearSSL's receive buffer has to hold a full 16K TLS record unless the
+// broker agrees to a smaller max fragment length, in which case both buffers
+// shrink to this.
+#ifndef MQTT_TLS_BUFFER_SIZE
+#define MQTT_TLS_BUFFER_SIZE 1024
+#endif
+
 #define DASH_MQTT_PAYLOAD "1"
+// Sent instead for events injected with POST /debug/inject.
+#define DASH_MQTT_SYNTHETIC_PAYLOAD "synthetic"
 
 #ifndef _MQTT_CLIENT_H
 #define _MQTT_CLIENT_H
 
+typedef std::function<void(const char* topic, const uint8_t* payload, const size_t length)> MqttMessageHandler;
+
+struct MqttConnectionStats {
+  uint32_t connects;
+  uint32_t failures;
+  // How long the last successful connect took, TLS handshake included.
+  uint32_t lastConnectMillis;
+  bool tls;
+  bool reducedTlsBuffers;
+};
+
 class MqttClient {
 public:
   MqttClient(Settings& settings);
@@ -19,16 +48,46 @@ public:
   void begin();
   void handleClient();
   void reconnect();
-  void sendUpdate(const char* eventType, const char* macAddr, const char* deviceAlias);
+  bool sendUpdate(const char* topic, const char* payload = DASH_MQTT_PAYLOAD);
+  bool connected();
+  bool publish(const char* topic, const char* payload, const bool retained = false);
+  bool publish(const char* topic, const uint8_t* payload, const size_t length);
+  // Publishes are buffered briefly so that a burst goes out in one write.
+  // Call after one to send what's buffered right away. Returns false if
+  // anything published since the last successful flush may not have been sent.
+  bool flush();
+
+  // Subscriptions are kept across reconnects. Adding one that already exists
+  // is a no-op.
+  bool addSubscription(const char* topic);
+  void removeSubscription(const char* topic);
+  // Subscribing again makes the broker resend the topic's retained message.
+  void refreshSubscription(const char* topic);
+  void onMessage(MqttMessageHandler handler);
+
+  const MqttConnectionStats& getStats() const;
+  const BufferedClientStats& getWriteStats() const;
 
 private:
-  WiFiClient tcpClient;
+  // Either plain TCP or secureClient.
+  WiFiClient* tcpClient;
+  BufferedClient* bufferedClient;
+  MqttConnectionStats stats;
   PubSubClient* mqttClient;
   Settings& settings;
   char* domain;
   unsigned long lastConnectAttempt;
+  String subscriptions[MQTT_MAX_SUBSCRIPTIONS];
+  size_t numSubscriptions;
+  MqttMessageHandler messageHandler;
+#ifndef DASH_DISABLE_MQTT_TLS
+  BearSSL::WiFiClientSecure* secureClient;
+  BearSSL::X509List* trustAnchors;
+  bool fragmentLengthProbed;
+#endif
 
   bool connect();
+  WiFiClient* createTransport();
   void subscribe();
   void publishCallback(char* topic, byte* payload, int length);
 };
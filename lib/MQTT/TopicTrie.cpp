@@ -0,0 +1,190 @@
+#include <TopicTrie.h>
+
+TopicTrie::TopicTrie() {
+  root.level = NULL;
+  root.children = NULL;
+  root.next = NULL;
+  root.handler = NULL;
+}
+
+TopicTrie::~TopicTrie() {
+  destroy(root.children);
+}
+
+void TopicTrie::destroy(TopicTrieNode* node) {
+  while (node != NULL) {
+    TopicTrieNode* next = node->next;
+
+    destroy(node->children);
+    delete[] node->level;
+    delete node;
+
+    node = next;
+  }
+}
+
+void TopicTrie::on(const char* pattern, TopicHandler handler) {
+  TopicTrieNode* node = &root;
+  const char* level = pattern;
+
+  while (true) {
+    const char* end = strchr(level, '/');
+    const size_t length = end ? (end - level) : strlen(level);
+
+    node = child(node, level, length, true);
+
+    if (end == NULL) {
+      break;
+    }
+
+    level = end + 1;
+  }
+
+  node->handler = handler;
+}
+
+TopicTrieNode* TopicTrie::child(TopicTrieNode* parent, const char* level, const size_t length, const bool create) {
+  TopicTrieNode* node = parent->children;
+
+  while (node != NULL) {
+    if (strlen(node->level) == length && strncmp(node->level, level, length) == 0) {
+      return node;
+    }
+
+    node = node->next;
+  }
+
+  if (!create) {
+    return NULL;
+  }
+
+  node = new TopicTrieNode();
+  node->level = new char[length + 1];
+  memcpy(node->level, level, length);
+  node->level[length] = 0;
+  node->children = NULL;
+  node->handler = NULL;
+
+  // Kept in insertion order so lookups are deterministic.
+  node->next = NULL;
+  TopicTrieNode** tail = &parent->children;
+  while (*tail != NULL) {
+    tail = &(*tail)->next;
+  }
+  *tail = node;
+
+  return node;
+}
+
+bool TopicTrie::dispatch(const char* topic, const uint8_t* payload, const size_t length) const {
+  const size_t topicLength = strlen(topic);
+
+  if (topicLength >= TOPIC_TRIE_MAX_TOPIC_LENGTH) {
+    return false;
+  }
+
+  // Split a copy of the topic into levels in place. A second, untouched copy
+  // backs the "#" remainder.
+  char buffer[TOPIC_TRIE_MAX_TOPIC_LENGTH * 2];
+  char* levelsBuffer = buffer;
+  char* restBuffer = buffer + TOPIC_TRIE_MAX_TOPIC_LENGTH;
+  memcpy(levelsBuffer, topic, topicLength + 1);
+  memcpy(restBuffer, topic, topicLength + 1);
+
+  char* levels[TOPIC_TRIE_MAX_DEPTH];
+  size_t numLevels = 0;
+  char* p = levelsBuffer;
+
+  while (true) {
+    if (numLevels == TOPIC_TRIE_MAX_DEPTH) {
+      return false;
+    }
+
+    levels[numLevels++] = p;
+    p = strchr(p, '/');
+
+    if (p == NULL) {
+      break;
+    }
+
+    *p++ = 0;
+  }
+
+  TopicMatch result;
+  result.topic = topic;
+  result.numWildcards = 0;
+  result.rest = NULL;
+
+  const TopicTrieNode* node = match(&root, levels, numLevels, 0, result);
+
+  if (node == NULL) {
+    return false;
+  }
+
+  // levels[] point into the first copy; translate the remainder to the
+  // second, which still has its separators.
+  if (result.rest != NULL) {
+    result.rest = restBuffer + (result.rest - levelsBuffer);
+  }
+
+  node->handler(result, payload, length);
+  return true;
+}
+
+const TopicTrieNode* TopicTrie::match(const TopicTrieNode* node, char** levels, const size_t numLevels, const size_t depth, TopicMatch& result) {
+  if (depth == numLevels) {
+    if (node->handler) {
+      return node;
+    }
+
+    // "a/#" matches "a" too, with nothing for the remainder.
+    for (const TopicTrieNode* child = node->children; child != NULL; child = child->next) {
+      if (strcmp(child->level, "#") == 0 && child->handler) {
+        const char* last = levels[numLevels - 1];
+        result.rest = last + strlen(last);
+        return child;
+      }
+    }
+
+    return NULL;
+  }
+
+  const char* level = levels[depth];
+  const TopicTrieNode* exact = NULL;
+  const TopicTrieNode* single = NULL;
+  const TopicTrieNode* multi = NULL;
+
+  for (const TopicTrieNode* child = node->children; child != NULL; child = child->next) {
+    if (strcmp(child->level, "+") == 0) {
+      single = child;
+    } else if (strcmp(child->level, "#") == 0) {
+      multi = child;
+    } else if (strcmp(child->level, level) == 0) {
+      exact = child;
+    }
+  }
+
+  const TopicTrieNode* found = NULL;
+
+  if (exact != NULL) {
+    found = match(exact, levels, numLevels, depth + 1, result);
+  }
+
+  if (found == NULL && single != NULL) {
+    const size_t numWildcards = result.numWildcards;
+    result.wildcards[result.numWildcards++] = level;
+
+    found = match(single, levels, numLevels, depth + 1, result);
+
+    if (found == NULL) {
+      result.numWildcards = numWildcards;
+    }
+  }
+
+  if (found == NULL && multi != NULL && multi->handler) {
+    result.rest = level;
+    found = multi;
+  }
+
+  return found;
+}
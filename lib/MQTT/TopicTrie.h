@@ -0,0 +1,57 @@
+#include <Arduino.h>
+#include <functional>
+
+#ifndef _TOPIC_TRIE_H
+#define _TOPIC_TRIE_H
+
+#ifndef TOPIC_TRIE_MAX_DEPTH
+#define TOPIC_TRIE_MAX_DEPTH 10
+#endif
+
+#ifndef TOPIC_TRIE_MAX_TOPIC_LENGTH
+#define TOPIC_TRIE_MAX_TOPIC_LENGTH 128
+#endif
+
+struct TopicMatch {
+  const char* topic;
+  // Topic levels matched by "+" in the pattern, in order.
+  const char* wildcards[TOPIC_TRIE_MAX_DEPTH];
+  size_t numWildcards;
+  // Whatever a trailing "#" matched, or NULL.
+  const char* rest;
+};
+
+typedef std::function<void(const TopicMatch& match, const uint8_t* payload, const size_t length)> TopicHandler;
+
+struct TopicTrieNode {
+  char* level;
+  TopicTrieNode* children;
+  TopicTrieNode* next;
+  TopicHandler handler;
+};
+
+// Routes MQTT messages to handlers by topic. Patterns use MQTT filter syntax:
+// "+" matches one level and "#" matches everything after it, including
+// nothing ("a/#" matches "a"). Patterns are split into a tree of levels once
+// when they're added, so a dispatch walks each level of the topic once
+// instead of testing every pattern. Exact levels take precedence over "+",
+// which takes precedence over "#".
+class TopicTrie {
+public:
+  TopicTrie();
+  ~TopicTrie();
+
+  void on(const char* pattern, TopicHandler handler);
+
+  // Returns false if no pattern matched.
+  bool dispatch(const char* topic, const uint8_t* payload, const size_t length) const;
+
+private:
+  TopicTrieNode root;
+
+  static TopicTrieNode* child(TopicTrieNode* parent, const char* level, const size_t length, const bool create);
+  static const TopicTrieNode* match(const TopicTrieNode* node, char** levels, const size_t numLevels, const size_t depth, TopicMatch& match);
+  static void destroy(TopicTrieNode* node);
+};
+
+#endif
@@ -0,0 +1,91 @@
+#include <HyperLogLog.h>
+#include <math.h>
+
+HyperLogLog::HyperLogLog() {
+  clear();
+}
+
+void HyperLogLog::clear() {
+  memset(_registers, 0, sizeof(_registers));
+}
+
+uint64_t HyperLogLog::hash(const uint8_t* mac) {
+  uint64_t h = 0;
+
+  for (size_t i = 0; i < 6; i++) {
+    h = (h << 8) | mac[i];
+  }
+
+  // MurmurHash3's 64-bit finalizer. MACs are far from uniform (a handful of
+  // vendor prefixes, sequential serials), so every input bit has to affect
+  // every output bit.
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+
+  return h;
+}
+
+void HyperLogLog::add(const uint8_t* mac) {
+  addHash(hash(mac));
+}
+
+void HyperLogLog::addHash(const uint64_t hash) {
+  const size_t ix = hash >> (64 - HLL_PRECISION);
+  const uint64_t rest = hash << HLL_PRECISION;
+
+  // Position of the first set bit after the index bits.
+  uint8_t rank = 1;
+  while (rank <= (64 - HLL_PRECISION) && (rest & (1ULL << (64 - rank))) == 0) {
+    rank++;
+  }
+
+  if (rank > _registers[ix]) {
+    _registers[ix] = rank;
+  }
+}
+
+uint32_t HyperLogLog::estimate() const {
+  const double m = HLL_NUM_REGISTERS;
+  const double alpha = 0.7213 / (1.0 + 1.079 / m);
+
+  double sum = 0;
+  size_t zeros = 0;
+
+  for (size_t i = 0; i < HLL_NUM_REGISTERS; i++) {
+    sum += ldexp(1.0, -_registers[i]);
+
+    if (_registers[i] == 0) {
+      zeros++;
+    }
+  }
+
+  double estimate = alpha * m * m / sum;
+
+  // The raw estimate is biased for small counts, where linear counting on
+  // the empty registers does better. With a 64-bit hash there's no large
+  // range correction to make.
+  if (estimate <= 2.5 * m && zeros > 0) {
+    estimate = m * log(m / zeros);
+  }
+
+  return static_cast<uint32_t>(estimate + 0.5);
+}
+
+void HyperLogLog::merge(const HyperLogLog& other) {
+  merge(other._registers);
+}
+
+void HyperLogLog::merge(const uint8_t* registers) {
+  for (size_t i = 0; i < HLL_NUM_REGISTERS; i++) {
+    if (registers[i] > _registers[i]) {
+      _registers[i] = registers[i];
+    }
+  }
+}
+
+const uint8_t* HyperLogLog::registers() const {
+  return _registers;
+}
@@ -0,0 +1,38 @@
+#include <Arduino.h>
+
+#ifndef _HYPER_LOG_LOG_H
+#define _HYPER_LOG_LOG_H
+
+// 2^p registers of one byte each. At p = 10 a sketch is 1KB and estimates are
+// within 1.04 / sqrt(1024) = 3.25% of the true count (one standard error),
+// from a handful of devices up to far more than a chip can hear.
+#ifndef HLL_PRECISION
+#define HLL_PRECISION 10
+#endif
+
+#define HLL_NUM_REGISTERS (1 << HLL_PRECISION)
+
+// Estimates the number of distinct MACs added, in fixed memory. Two sketches
+// built with the same precision merge into the sketch of the union of their
+// inputs, so counts from several nodes combine without double counting.
+class HyperLogLog {
+public:
+  HyperLogLog();
+
+  void add(const uint8_t* mac);
+  void addHash(const uint64_t hash);
+  void clear();
+  uint32_t estimate() const;
+
+  void merge(const HyperLogLog& other);
+  // registers must be HLL_NUM_REGISTERS long, as from registers().
+  void merge(const uint8_t* registers);
+  const uint8_t* registers() const;
+
+  static uint64_t hash(const uint8_t* mac);
+
+private:
+  uint8_t _registers[HLL_NUM_REGISTERS];
+};
+
+#endif
@@ -0,0 +1,53 @@
+#include <OccupancyCounter.h>
+
+const char* OccupancyCounter::WINDOW_NAMES[OCCUPANCY_NUM_WINDOWS] = {"minute", "hour"};
+const uint32_t OccupancyCounter::WINDOW_LENGTHS[OCCUPANCY_NUM_WINDOWS] = {60000, 3600000};
+
+OccupancyCounter::OccupancyCounter()
+  : windowHandler(NULL)
+{
+  for (size_t i = 0; i < OCCUPANCY_NUM_WINDOWS; i++) {
+    windows[i].start = 0;
+    windows[i].lastEstimate = 0;
+  }
+}
+
+void OccupancyCounter::onWindowClosed(OccupancyWindowHandler handler) {
+  this->windowHandler = handler;
+}
+
+void OccupancyCounter::record(const uint8_t* mac, const unsigned long now) {
+  loop(now);
+
+  const uint64_t hash = HyperLogLog::hash(mac);
+
+  for (size_t i = 0; i < OCCUPANCY_NUM_WINDOWS; i++) {
+    windows[i].sketch.addHash(hash);
+  }
+}
+
+void OccupancyCounter::loop(const unsigned long now) {
+  for (size_t i = 0; i < OCCUPANCY_NUM_WINDOWS; i++) {
+    OccupancyWindowState& state = windows[i];
+    const uint32_t length = WINDOW_LENGTHS[i];
+
+    if ((now - state.start) < length) {
+      continue;
+    }
+
+    state.lastEstimate = state.sketch.estimate();
+
+    if (this->windowHandler) {
+      this->windowHandler(static_cast<OccupancyWindow>(i), state.sketch, state.start);
+    }
+
+    state.sketch.clear();
+
+    // Skip over any windows that passed with no calls at all.
+    state.start += ((now - state.start) / length) * length;
+  }
+}
+
+const OccupancyWindowState& OccupancyCounter::window(const OccupancyWindow window) const {
+  return windows[window];
+}
@@ -0,0 +1,47 @@
+#include <Arduino.h>
+#include <functional>
+#include <HyperLogLog.h>
+
+#ifndef _OCCUPANCY_COUNTER_H
+#define _OCCUPANCY_COUNTER_H
+
+enum OccupancyWindow {
+  OCCUPANCY_MINUTE = 0,
+  OCCUPANCY_HOUR = 1,
+  OCCUPANCY_NUM_WINDOWS
+};
+
+// Called with the finished sketch when a window closes, before it's cleared.
+typedef std::function<void(const OccupancyWindow window, const HyperLogLog& sketch, const unsigned long windowStart)> OccupancyWindowHandler;
+
+struct OccupancyWindowState {
+  HyperLogLog sketch;
+  unsigned long start;
+  // Estimate for the last window that closed.
+  uint32_t lastEstimate;
+};
+
+// Counts distinct devices seen per minute and per hour, using one
+// HyperLogLog per window (2KB in all). Windows are aligned to when counting
+// started, not to wall clock time, which the node doesn't have.
+class OccupancyCounter {
+public:
+  static const char* WINDOW_NAMES[OCCUPANCY_NUM_WINDOWS];
+  static const uint32_t WINDOW_LENGTHS[OCCUPANCY_NUM_WINDOWS];
+
+  OccupancyCounter();
+
+  void onWindowClosed(OccupancyWindowHandler handler);
+
+  void record(const uint8_t* mac, const unsigned long now);
+  // Closes windows that are over even if nothing was recorded.
+  void loop(const unsigned long now);
+
+  const OccupancyWindowState& window(const OccupancyWindow window) const;
+
+private:
+  OccupancyWindowState windows[OCCUPANCY_NUM_WINDOWS];
+  OccupancyWindowHandler windowHandler;
+};
+
+#endif
@@ -0,0 +1,114 @@
+#include <TaskScheduler.h>
+#include <algorithm>
+
+TaskScheduler::TaskScheduler()
+  : _numTasks(0),
+    triggered(false),
+    _sleptMillis(0)
+{ }
+
+int TaskScheduler::addTask(const char* name, TaskPriority priority, uint32_t interval, uint32_t budgetMicros, TaskFn fn) {
+  if (_numTasks == SCHEDULER_MAX_TASKS) {
+    Serial.print(F("ERROR: No room for task, raise SCHEDULER_MAX_TASKS: "));
+    Serial.println(name);
+    return -1;
+  }
+
+  const size_t id = _numTasks;
+  Task& task = tasks[id];
+  task.name = name;
+  task.priority = priority;
+  task.interval = interval;
+  task.budgetMicros = budgetMicros;
+  task.nextRun = millis();
+  task.fn = fn;
+  memset(&task.stats, 0, sizeof(task.stats));
+
+  size_t ix = _numTasks;
+  while (ix > 0 && tasks[order[ix - 1]].priority > priority) {
+    order[ix] = order[ix - 1];
+    ix--;
+  }
+  order[ix] = id;
+
+  _numTasks++;
+
+  return id;
+}
+
+void TaskScheduler::trigger(const int taskId) {
+  if (taskId < 0 || static_cast<size_t>(taskId) >= _numTasks) {
+    return;
+  }
+
+  tasks[taskId].nextRun = millis();
+  triggered = true;
+
+  // Wakes loop() out of delay() early.
+  esp_schedule();
+}
+
+void TaskScheduler::loop() {
+  unsigned long now = millis();
+  size_t i = 0;
+
+  while (i < _numTasks) {
+    Task& task = tasks[order[i]];
+
+    if (static_cast<long>(now - task.nextRun) >= 0) {
+      triggered = false;
+      run(task, now);
+      now = millis();
+
+      // Something more urgent may have come in while that ran.
+      if (triggered) {
+        i = 0;
+        continue;
+      }
+    }
+
+    i++;
+  }
+
+  long sleepFor = SCHEDULER_MAX_SLEEP;
+  for (size_t j = 0; j < _numTasks; j++) {
+    sleepFor = std::min(sleepFor, static_cast<long>(tasks[j].nextRun - now));
+  }
+
+  if (sleepFor > 0 && !triggered) {
+    delay(sleepFor);
+    _sleptMillis += sleepFor;
+  } else {
+    yield();
+  }
+}
+
+void TaskScheduler::run(Task& task, const unsigned long now) {
+  // Set first so a task that triggers itself while running isn't pushed
+  // back a whole interval.
+  task.nextRun = now + task.interval;
+
+  const uint32_t start = micros();
+  task.fn();
+  const uint32_t elapsed = micros() - start;
+
+  task.stats.runs++;
+  task.stats.totalMicros += elapsed;
+  task.stats.maxMicros = std::max(task.stats.maxMicros, elapsed);
+
+  if (elapsed > task.budgetMicros) {
+    task.stats.overruns++;
+  }
+}
+
+size_t TaskScheduler::numTasks() const {
+  return _numTasks;
+}
+
+const Task& TaskScheduler::getTask(const size_t ix) const {
+  return tasks[ix];
+}
+
+uint32_t TaskScheduler::sleptMillis() const {
+  return _sleptMillis;
+}
@@ -0,0 +1,76 @@
+#include <Arduino.h>
+#include <functional>
+
+#ifndef _TASK_SCHEDULER_H
+#define _TASK_SCHEDULER_H
+
+#ifndef SCHEDULER_MAX_TASKS
+#define SCHEDULER_MAX_TASKS 12
+#endif
+
+// Longest the scheduler will sleep when nothing is due. Bounds the latency of
+// work it can't be woken for, like incoming TCP data.
+#ifndef SCHEDULER_MAX_SLEEP
+#define SCHEDULER_MAX_SLEEP 20
+#endif
+
+// Lower runs first.
+enum TaskPriority {
+  TASK_PRIORITY_CAPTURE = 0,
+  TASK_PRIORITY_SINKS = 1,
+  TASK_PRIORITY_NETWORK = 2,
+  TASK_PRIORITY_MAINTENANCE = 3
+};
+
+typedef std::function<void(void)> TaskFn;
+
+struct TaskStats {
+  uint32_t runs;
+  uint32_t totalMicros;
+  uint32_t maxMicros;
+  // Runs that took longer than the task's budget.
+  uint32_t overruns;
+};
+
+struct Task {
+  const char* name;
+  TaskPriority priority;
+  uint32_t interval;
+  uint32_t budgetMicros;
+  unsigned long nextRun;
+  TaskFn fn;
+  TaskStats stats;
+};
+
+// Cooperative scheduler for loop(). Due tasks run in priority order, and a
+// pass starts over from the top whenever a task is triggered, so capture work
+// never waits behind HTTP. When nothing is due, it sleeps until the next
+// deadline; trigger() wakes it early.
+class TaskScheduler {
+public:
+  TaskScheduler();
+
+  // Returns the task id, or -1 if there's no room.
+  int addTask(const char* name, TaskPriority priority, uint32_t interval, uint32_t budgetMicros, TaskFn fn);
+
+  // Makes a task due now. Safe to call from WiFi event callbacks.
+  void trigger(const int taskId);
+
+  void loop();
+
+  size_t numTasks() const;
+  const Task& getTask(const size_t ix) const;
+  uint32_t sleptMillis() const;
+
+private:
+  Task tasks[SCHEDULER_MAX_TASKS];
+  // Task ids sorted by priority.
+  uint8_t order[SCHEDULER_MAX_TASKS];
+  size_t _numTasks;
+  volatile bool triggered;
+  uint32_t _sleptMillis;
+
+  void run(Task& task, const unsigned long now);
+};
+
+#endif
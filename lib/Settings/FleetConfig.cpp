@@ -0,0 +1,150 @@
+#include <FleetConfig.h>
+
+FleetConfig::FleetConfig(Settings& settings)
+  : settings(settings)
+{ }
+
+FleetApplyResult FleetConfig::apply(const char* topic, const uint8_t* payload, const size_t length, uint8_t& changed) {
+  changed = 0;
+
+  DynamicJsonBuffer jsonBuffer;
+  // Parsed in place, so it needs a writable, terminated copy.
+  char* json = static_cast<char*>(jsonBuffer.alloc(length + 1));
+
+  if (json == NULL) {
+    return FLEET_INVALID;
+  }
+
+  memcpy(json, payload, length);
+  json[length] = 0;
+
+  JsonObject& message = jsonBuffer.parseObject(json);
+
+  if (!message.success() || !message.containsKey("version")) {
+    return FLEET_INVALID;
+  }
+
+  const uint32_t version = message["version"];
+
+  if (version <= settings.fleetVersion) {
+    return FLEET_STALE;
+  }
+
+  if (strcmp(topic, FLEET_CONFIG_TOPIC) == 0) {
+    return applyConfig(message, version, changed);
+  } else {
+    return applyDelta(message, version, changed, jsonBuffer);
+  }
+}
+
+FleetApplyResult FleetConfig::applyConfig(JsonObject& message, const uint32_t version, uint8_t& changed) {
+  JsonObject& changes = message["settings"];
+
+  if (!changes.success()) {
+    return FLEET_INVALID;
+  }
+
+  // Fleet settings themselves are per-node.
+  changes.remove("fleet_enabled");
+  changes.remove("fleet_version");
+
+  settings.patch(changes);
+  changed = FLEET_CHANGED_FIELDS;
+
+  if (changes.containsKey("monitored_macs")) {
+    changed |= FLEET_CHANGED_DEVICES;
+  }
+
+  changes["fleet_version"] = version;
+  settings.fleetVersion = version;
+  settings.touch();
+  settings.saveChanges(changes);
+
+  return FLEET_APPLIED;
+}
+
+FleetApplyResult FleetConfig::applyDelta(JsonObject& message, const uint32_t version, uint8_t& changed, JsonBuffer& jsonBuffer) {
+  if (version != settings.fleetVersion + 1) {
+    return FLEET_GAP;
+  }
+
+  JsonArray& ops = message["ops"];
+
+  if (!ops.success()) {
+    return FLEET_INVALID;
+  }
+
+  JsonObject& changes = jsonBuffer.createObject();
+  uint8_t mac[6];
+
+  // Field changes go first so they can be applied in a single rebuild.
+  for (JsonArray::iterator it = ops.begin(); it != ops.end(); ++it) {
+    JsonObject& op = *it;
+
+    if (op["op"] == "set") {
+      const char* field = op["field"];
+
+      if (field == NULL || strcmp(field, "fleet_enabled") == 0 || strcmp(field, "fleet_version") == 0) {
+        continue;
+      }
+
+      changes[field] = op["value"];
+      changed |= FLEET_CHANGED_FIELDS;
+    }
+  }
+
+  if (changed) {
+    settings.patch(changes);
+
+    if (changes.containsKey("monitored_macs")) {
+      changed |= FLEET_CHANGED_DEVICES;
+    }
+  }
+
+  for (JsonArray::iterator it = ops.begin(); it != ops.end(); ++it) {
+    JsonObject& op = *it;
+    const char* macStr = op["mac"];
+
+    if (macStr == NULL || !Settings::parseMac(macStr, mac)) {
+      continue;
+    }
+
+    if (op["op"] == "add_device") {
+      const char* alias = op["alias"];
+
+      if (settings.addMonitoredMac(mac, alias ? alias : "")) {
+        changed |= FLEET_CHANGED_DEVICES;
+      }
+    } else if (op["op"] == "remove_device") {
+      if (settings.removeMonitoredMac(mac)) {
+        changed |= FLEET_CHANGED_DEVICES;
+      }
+    }
+  }
+
+  commit(changes, version, changed, jsonBuffer);
+
+  return FLEET_APPLIED;
+}
+
+void FleetConfig::commit(JsonObject& changes, const uint32_t version, const uint8_t changed, JsonBuffer& jsonBuffer) {
+  if (changed & FLEET_CHANGED_DEVICES) {
+    JsonArray& macs = changes.createNestedArray("monitored_macs");
+    settings.serializeMonitoredMacs(macs, jsonBuffer);
+  }
+
+  changes["fleet_version"] = version;
+  settings.fleetVersion = version;
+  settings.touch();
+  settings.saveChanges(changes);
+}
+
+void FleetConfig::formatStatus(char* topic, String& payload) const {
+  sprintf_P(topic, PSTR("%sstatus/%08X"), FLEET_TOPIC_PREFIX, static_cast<unsigned>(ESP.getChipId()));
+
+  payload = "{\"version\":";
+  payload += settings.fleetVersion;
+  payload += ",\"generation\":";
+  payload += settings.generation();
+  payload += '}';
+}
@@ -0,0 +1,59 @@
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <Settings.h>
+
+#ifndef _FLEET_CONFIG_H
+#define _FLEET_CONFIG_H
+
+// <prefix>config carries a retained full document:
+//   {"version": 12, "settings": {<same keys as PUT /settings>}}
+// <prefix>delta carries the change from the previous version:
+//   {"version": 13, "ops": [
+//     {"op": "add_device", "mac": "AA:BB:CC:DD:EE:FF", "alias": "doorbell"},
+//     {"op": "remove_device", "mac": "AA:BB:CC:DD:EE:FF"},
+//     {"op": "set", "field": "mqtt_topic_pattern", "value": "..."}
+//   ]}
+// Each node reports the version it's at, retained, to <prefix>status/<chip id>.
+#ifndef FLEET_TOPIC_PREFIX
+#define FLEET_TOPIC_PREFIX "dash_stadium/fleet/"
+#endif
+
+#define FLEET_CONFIG_TOPIC FLEET_TOPIC_PREFIX "config"
+#define FLEET_DELTA_TOPIC FLEET_TOPIC_PREFIX "delta"
+#define FLEET_STATUS_TOPIC_LENGTH (sizeof(FLEET_TOPIC_PREFIX) + 16)
+
+enum FleetApplyResult {
+  FLEET_APPLIED,
+  // Already at this version or newer.
+  FLEET_STALE,
+  // A delta arrived for a version we can't apply it to. The retained
+  // document has to be fetched again.
+  FLEET_GAP,
+  FLEET_INVALID
+};
+
+// What an applied update touched, so the caller can redo only what's needed.
+enum FleetChange {
+  FLEET_CHANGED_DEVICES = 1 << 0,
+  FLEET_CHANGED_FIELDS = 1 << 1
+};
+
+// Applies versioned config documents and deltas from the fleet topics to
+// Settings, and journals them like a PUT /settings would.
+class FleetConfig {
+public:
+  FleetConfig(Settings& settings);
+
+  FleetApplyResult apply(const char* topic, const uint8_t* payload, const size_t length, uint8_t& changed);
+
+  void formatStatus(char* topic, String& payload) const;
+
+private:
+  Settings& settings;
+
+  FleetApplyResult applyConfig(JsonObject& message, const uint32_t version, uint8_t& changed);
+  FleetApplyResult applyDelta(JsonObject& message, const uint32_t version, uint8_t& changed, JsonBuffer& jsonBuffer);
+  void commit(JsonObject& changes, const uint32_t version, const uint8_t changed, JsonBuffer& jsonBuffer);
+};
+
+#endif
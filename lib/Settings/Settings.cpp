@@ -4,11 +4,41 @@
 #include <algorithm>
 #include <ESP8266WiFi.h>
 #include <IntParsing.h>
-
-#define PORT_POSITION(s) ( s.indexOf(':') )
+#include <Crc32.h>
+#include <HeapProfiler.h>
+
+#ifdef DASH_BAKED_CONFIG
+#include <baked_config.h>
+
+static_assert(BAKED_CONFIG_NUM_STRINGS == SETTINGS_NUM_STRING_FIELDS, "baked_config.h is out of date, rerun .build_config.py");
+#endif
+
+const char* Settings::FIELD_KEYS[SETTINGS_NUM_STRING_FIELDS] = {
+  "admin_username",
+  "admin_password",
+  "mqtt_server",
+  "mqtt_username",
+  "mqtt_password",
+  "mqtt_topic_pattern",
+  "mqtt_tls_fingerprint",
+  "ap_name",
+  "ap_password"
+};
+
+static const uint8_t FIELD_CHANGES[SETTINGS_NUM_STRING_FIELDS] = {
+  SETTINGS_CHANGED_AUTH,
+  SETTINGS_CHANGED_AUTH,
+  SETTINGS_CHANGED_MQTT,
+  SETTINGS_CHANGED_MQTT,
+  SETTINGS_CHANGED_MQTT,
+  SETTINGS_CHANGED_TOPICS,
+  SETTINGS_CHANGED_MQTT,
+  SETTINGS_CHANGED_AP,
+  SETTINGS_CHANGED_AP
+};
 
 bool Settings::hasAuthSettings() {
-  return adminUsername.length() > 0 && adminPassword.length() > 0;
+  return strlen(adminUsername()) > 0 && strlen(adminPassword()) > 0;
 }
 
 void Settings::deserialize(Settings& settings, String json) {
@@ -18,45 +48,128 @@ void Settings::deserialize(Settings& settings, String json) {
 }
 
 void Settings::patch(JsonObject& parsedSettings) {
+  HEAP_SCOPE(HEAP_TAG_SETTINGS);
   if (parsedSettings.success()) {
-    this->setIfPresent(parsedSettings, "admin_username", adminUsername);
-    this->setIfPresent(parsedSettings, "admin_password", adminPassword);
-    this->setIfPresent(parsedSettings, "mqtt_server", _mqttServer);
-    this->setIfPresent(parsedSettings, "mqtt_username", mqttUsername);
-    this->setIfPresent(parsedSettings, "mqtt_password", mqttPassword);
-    this->setIfPresent(parsedSettings, "mqtt_topic_pattern", mqttTopicPattern);
-    this->setIfPresent(parsedSettings, "ap_name", apName);
-    this->setIfPresent(parsedSettings, "ap_password", apPassword);
+    const char* values[SETTINGS_NUM_STRING_FIELDS];
+
+    for (size_t i = 0; i < SETTINGS_NUM_STRING_FIELDS; i++) {
+      if (parsedSettings.containsKey(FIELD_KEYS[i])) {
+        const char* value = parsedSettings[FIELD_KEYS[i]];
+        values[i] = value ? value : "";
+      } else {
+        values[i] = get(static_cast<SettingsField>(i));
+      }
+    }
+
+    this->setIfPresent(parsedSettings, "mqtt_tls", mqttTls, SETTINGS_CHANGED_MQTT);
     this->setIfPresent(parsedSettings, "debounce_threshold_ms", debounceThresholdMs);
+    this->setIfPresent(parsedSettings, "cluster_claim_window_ms", clusterClaimWindowMs, SETTINGS_CHANGED_CLUSTER);
+    this->setIfPresent(parsedSettings, "fleet_enabled", fleetEnabled, SETTINGS_CHANGED_FLEET);
+    this->setIfPresent(parsedSettings, "fleet_version", fleetVersion);
 
     if (parsedSettings.containsKey("monitored_macs")) {
       JsonArray& macs = parsedSettings["monitored_macs"];
 
-      if (this->monitoredMacs != NULL) {
-        delete this->monitoredMacs;
-        delete this->deviceAliases;
+      rebuild(values, macs.size(), [&macs](const size_t ix, uint8_t* mac) -> const char* {
+        JsonArray& config = macs[ix];
+
+        if (!config.success()) {
+          return "";
+        }
+
+        if (mac) {
+          const char* s = config[0];
+          parseMac(s ? s : "", mac);
+        }
+
+        const char* alias = config[1];
+        return alias ? alias : "";
+      });
+    } else {
+      rebuild(values, numMonitoredMacs(), NULL);
+    }
+  }
+}
+
+void Settings::rebuild(const char* const* values, const size_t numDevices, DeviceSource devices) {
+  // Keep the current device table unless a new one was provided.
+  if (!devices) {
+    devices = [this](const size_t ix, uint8_t* mac) -> const char* {
+      if (mac) {
+        memcpy(mac, monitoredMac(ix), 6);
       }
+      return deviceAlias(ix);
+    };
+  }
 
-      this->numMonitoredMacs = macs.size();
-      this->monitoredMacs = new uint8_t[this->numMonitoredMacs * 6];
-      this->deviceAliases = new String[this->numMonitoredMacs];
+  size_t poolSize = 0;
 
-      for (size_t i = 0; i < this->numMonitoredMacs; i++) {
-        JsonArray& config = macs[i];
+  for (size_t i = 0; i < SETTINGS_NUM_STRING_FIELDS; i++) {
+    poolSize += strlen(values[i]) + 1;
+  }
 
-        if (!config.success()) {
-          continue;
-        }
+  for (size_t i = 0; i < numDevices; i++) {
+    poolSize += strlen(devices(i, NULL)) + 1;
+  }
+
+  // values and devices may point into the current arena, so it has to stay
+  // alive until the new one is filled.
+  SettingsArena next(SETTINGS_NUM_STRING_FIELDS, numDevices, poolSize);
+
+  for (size_t i = 0; i < SETTINGS_NUM_STRING_FIELDS; i++) {
+    next.setString(i, values[i]);
+  }
 
-        const char* s = config[0];
-        parseMac(s, this->monitoredMacs+(i*6));
-        this->deviceAliases[i] = config.get<String>(1);
+  for (size_t i = 0; i < numDevices; i++) {
+    uint8_t* mac = next.mac(i);
+    memset(mac, 0, 6);
+    next.setAlias(i, devices(i, mac));
+  }
+
+  for (size_t i = 0; i < SETTINGS_NUM_STRING_FIELDS; i++) {
+    if (strcmp(arena.string(i), next.string(i)) != 0) {
+      changes |= FIELD_CHANGES[i];
+    }
+  }
+
+  if (arena.numDevices() != numDevices
+    || (numDevices > 0 && memcmp(arena.macs(), next.macs(), numDevices * 6) != 0)) {
+    changes |= SETTINGS_CHANGED_DEVICES;
+  } else {
+    for (size_t i = 0; i < numDevices; i++) {
+      if (strcmp(arena.alias(i), next.alias(i)) != 0) {
+        changes |= SETTINGS_CHANGED_ALIASES;
+        break;
       }
     }
   }
+
+  arena.swap(next);
+  _generation++;
+}
+
+uint8_t Settings::takeChanges(const uint8_t mask) {
+  const uint8_t taken = changes & mask;
+  changes &= ~mask;
+  return taken;
 }
 
 void Settings::load(Settings& settings) {
+  HEAP_SCOPE(HEAP_TAG_SETTINGS);
+  const uint32_t start = micros();
+
+  // A compaction was interrupted between removing the old snapshot and moving
+  // the new one into place.
+  if (!SPIFFS.exists(SETTINGS_FILE) && SPIFFS.exists(SETTINGS_SNAPSHOT_TMP_FILE)) {
+    SPIFFS.rename(SETTINGS_SNAPSHOT_TMP_FILE, SETTINGS_FILE);
+  }
+
+#ifdef DASH_BAKED_CONFIG
+  settings.loadBaked();
+#endif
+
+  // With a baked config, this file only exists once runtime changes have
+  // been compacted into it.
   if (SPIFFS.exists(SETTINGS_FILE)) {
     File f = SPIFFS.open(SETTINGS_FILE, "r");
     String settingsContents = f.readStringUntil(SETTINGS_TERMINATOR);
@@ -64,8 +177,121 @@ void Settings::load(Settings& settings) {
 
     deserialize(settings, settingsContents);
   } else {
+#ifndef DASH_BAKED_CONFIG
     settings.save();
+#endif
   }
+
+  settings.replayJournal();
+  settings.loadMicros = micros() - start;
+}
+
+#ifdef DASH_BAKED_CONFIG
+void Settings::loadBaked() {
+  arena.load_P(BAKED_CONFIG_ARENA, BAKED_CONFIG_ARENA_SIZE, BAKED_CONFIG_NUM_STRINGS, BAKED_CONFIG_NUM_DEVICES);
+  _generation++;
+  changes = SETTINGS_CHANGED_ALL;
+
+  mqttTls = BAKED_CONFIG_MQTT_TLS;
+  debounceThresholdMs = BAKED_CONFIG_DEBOUNCE_THRESHOLD_MS;
+  clusterClaimWindowMs = BAKED_CONFIG_CLUSTER_CLAIM_WINDOW_MS;
+  fleetEnabled = BAKED_CONFIG_FLEET_ENABLED;
+  fleetVersion = BAKED_CONFIG_FLEET_VERSION;
+}
+#endif
+
+void Settings::replayJournal() {
+  if (!SPIFFS.exists(SETTINGS_JOURNAL_FILE)) {
+    journalSize = 0;
+    return;
+  }
+
+  File f = SPIFFS.open(SETTINGS_JOURNAL_FILE, "r");
+  journalSize = f.size();
+  bool corrupt = false;
+
+  while (f.available()) {
+    String record = f.readStringUntil('\n');
+    int sep = record.indexOf(' ');
+
+    if (sep == -1) {
+      corrupt = true;
+      break;
+    }
+
+    const char* json = record.c_str() + sep + 1;
+    uint32_t crc = IntParsing::strToHex<uint32_t>(record.c_str(), sep);
+
+    // A record that was cut short by a power loss won't match its checksum.
+    // Nothing after it can be trusted.
+    if (crc != Crc32::calculate(reinterpret_cast<const uint8_t*>(json), strlen(json))) {
+      corrupt = true;
+      break;
+    }
+
+    DynamicJsonBuffer jsonBuffer;
+    JsonObject& changes = jsonBuffer.parseObject(json);
+    patch(changes);
+  }
+
+  f.close();
+
+  // Otherwise new records would be appended after the garbage and never be
+  // replayed. Folding in what was good gets rid of it.
+  if (corrupt) {
+    Serial.println(F("Settings journal is corrupt, compacting without remaining records"));
+    compact();
+  }
+}
+
+void Settings::saveChanges(JsonObject& changes) {
+  HEAP_SCOPE(HEAP_TAG_SETTINGS);
+  String json;
+  changes.printTo(json);
+
+  char crc[10];
+  sprintf(crc, "%08X ", Crc32::calculate(reinterpret_cast<const uint8_t*>(json.c_str()), json.length()));
+
+  String record = crc;
+  record += json;
+  record += '\n';
+
+  File f = SPIFFS.open(SETTINGS_JOURNAL_FILE, "a");
+
+  if (!f) {
+    Serial.println(F("Opening settings journal failed"));
+    save();
+  } else {
+    f.write(reinterpret_cast<const uint8_t*>(record.c_str()), record.length());
+    journalSize = f.size();
+    f.close();
+  }
+}
+
+bool Settings::needsCompaction() {
+  return journalSize > SETTINGS_JOURNAL_COMPACT_THRESHOLD;
+}
+
+void Settings::compact() {
+  HEAP_SCOPE(HEAP_TAG_SETTINGS);
+  File f = SPIFFS.open(SETTINGS_SNAPSHOT_TMP_FILE, "w");
+
+  if (!f) {
+    Serial.println(F("Opening settings snapshot failed"));
+    return;
+  }
+
+  serialize(f);
+  f.close();
+
+  // Each step leaves something load() can recover from: the journal is only
+  // removed once the snapshot it was folded into is in place, and replaying
+  // it over that snapshot again is harmless.
+  SPIFFS.remove(SETTINGS_FILE);
+  SPIFFS.rename(SETTINGS_SNAPSHOT_TMP_FILE, SETTINGS_FILE);
+  SPIFFS.remove(SETTINGS_JOURNAL_FILE);
+
+  journalSize = 0;
 }
 
 String Settings::toJson(const bool prettyPrint) {
@@ -90,31 +316,18 @@ void Settings::serialize(Stream& stream, const bool prettyPrint) {
   DynamicJsonBuffer jsonBuffer;
   JsonObject& root = jsonBuffer.createObject();
 
-  root["admin_username"] = this->adminUsername;
-  root["admin_password"] = this->adminPassword;
-  root["mqtt_server"] = this->_mqttServer;
-  root["mqtt_username"] = this->mqttUsername;
-  root["mqtt_password"] = this->mqttPassword;
-  root["mqtt_topic_pattern"] = this->mqttTopicPattern;
-  root["ap_name"] = this->apName;
-  root["ap_password"] = this->apPassword;
+  for (size_t i = 0; i < SETTINGS_NUM_STRING_FIELDS; i++) {
+    root[FIELD_KEYS[i]] = get(static_cast<SettingsField>(i));
+  }
+  root["mqtt_tls"] = this->mqttTls;
   root["debounce_threshold_ms"] = this->debounceThresholdMs;
+  root["cluster_claim_window_ms"] = this->clusterClaimWindowMs;
+  root["fleet_enabled"] = this->fleetEnabled;
+  root["fleet_version"] = this->fleetVersion;
 
-  if (this->monitoredMacs) {
-    JsonArray& macs = jsonBuffer.createArray();
-    char macBuffer[25];
-    memset(macBuffer, 0, 25);
-
-    for (size_t i = 0; i < this->numMonitoredMacs; i++) {
-      JsonArray& config = jsonBuffer.createArray();
-      formatMac(this->monitoredMacs+(6*i), macBuffer);
-      config.add(String(macBuffer));
-      config.add(String(this->deviceAliases[i]));
-
-      macs.add(config);
-    }
-    root["monitored_macs"] = macs;
-  }
+  JsonArray& macs = jsonBuffer.createArray();
+  serializeMonitoredMacs(macs, jsonBuffer);
+  root["monitored_macs"] = macs;
 
   if (prettyPrint) {
     root.prettyPrintTo(stream);
@@ -123,62 +336,198 @@ void Settings::serialize(Stream& stream, const bool prettyPrint) {
   }
 }
 
+void Settings::serialize(JsonStreamWriter& json, const bool redactSecrets) {
+  char macBuffer[25];
+
+  json.beginObject();
+
+  for (size_t i = 0; i < SETTINGS_NUM_STRING_FIELDS; i++) {
+    const SettingsField field = static_cast<SettingsField>(i);
+
+    if (!redactSecrets || !isSecret(field)) {
+      json.field(FIELD_KEYS[i], get(field));
+    }
+  }
+
+  json.field("mqtt_tls", mqttTls);
+  json.field("debounce_threshold_ms", debounceThresholdMs);
+  json.field("cluster_claim_window_ms", clusterClaimWindowMs);
+  json.field("fleet_enabled", fleetEnabled);
+  json.field("fleet_version", fleetVersion);
+
+  json.key("monitored_macs").beginArray();
+  for (size_t i = 0; i < numMonitoredMacs(); i++) {
+    formatMac(monitoredMac(i), macBuffer);
+    json.beginArray()
+      .value(macBuffer)
+      .value(deviceAlias(i))
+      .endArray();
+  }
+  json.endArray();
+
+  json.endObject();
+}
+
+bool Settings::isBaked() {
+#ifdef DASH_BAKED_CONFIG
+  return true;
+#else
+  return false;
+#endif
+}
+
+bool Settings::isSecret(const SettingsField field) {
+  return field == SETTING_ADMIN_PASSWORD
+    || field == SETTING_MQTT_PASSWORD
+    || field == SETTING_AP_PASSWORD;
+}
+
 String Settings::mqttServer() {
-  int pos = PORT_POSITION(_mqttServer);
+  const char* server = mqttServerWithPort();
+  const char* port = strchr(server, ':');
 
-  if (pos == -1) {
-    return _mqttServer;
+  if (port == NULL) {
+    return String(server);
   } else {
-    return _mqttServer.substring(0, pos);
+    return String(server).substring(0, port - server);
   }
 }
 
 uint16_t Settings::mqttPort() {
-  int pos = PORT_POSITION(_mqttServer);
+  const char* port = strchr(mqttServerWithPort(), ':');
 
-  if (pos == -1) {
+  if (port == NULL) {
     return DEFAULT_MQTT_PORT;
   } else {
-    return atoi(_mqttServer.c_str() + pos + 1);
+    return atoi(port + 1);
   }
 }
 
 void Settings::setupSoftAP() {
-  if (apPassword.length() > 0) {
-    WiFi.softAP(apName.c_str(), apPassword.c_str());
+  if (strlen(apPassword()) > 0) {
+    WiFi.softAP(apName(), apPassword());
   } else {
-    WiFi.softAP(apName.c_str());
+    WiFi.softAP(apName());
   }
 }
 
 int Settings::findMonitoredMac(const uint8_t *mac) {
-  if (this->monitoredMacs == NULL) {
-    return -1;
+  const uint8_t* monMac = monitoredMacs();
+
+  for (size_t i = 0; i < numMonitoredMacs(); i++, monMac += 6) {
+    if (memcmp(mac, monMac, 6) == 0) {
+      return i;
+    }
   }
 
-  for (size_t i = 0; i < this->numMonitoredMacs; i++) {
-    bool found = true;
-    uint8_t* monMac = this->monitoredMacs+(i*6);
+  return -1;
+}
 
-    for (size_t j = 0; j < 6; j++) {
-      if (mac[j] != monMac[j]) {
-        found = false;
-        break;
+bool Settings::addMonitoredMac(const uint8_t* mac, const char* alias) {
+  const int existingIx = findMonitoredMac(mac);
+
+  if (existingIx != -1 && strcmp(deviceAlias(existingIx), alias) == 0) {
+    return false;
+  }
+
+  const size_t numDevices = numMonitoredMacs();
+  const char* values[SETTINGS_NUM_STRING_FIELDS];
+  currentValues(values);
+
+  rebuild(
+    values,
+    existingIx == -1 ? numDevices + 1 : numDevices,
+    [this, mac, alias, existingIx, numDevices](const size_t ix, uint8_t* buffer) -> const char* {
+      if (ix == numDevices || static_cast<int>(ix) == existingIx) {
+        if (buffer) {
+          memcpy(buffer, mac, 6);
+        }
+        return alias;
+      }
+
+      if (buffer) {
+        memcpy(buffer, monitoredMac(ix), 6);
       }
+      return deviceAlias(ix);
     }
+  );
 
-    if (found) {
-      return i;
+  return true;
+}
+
+bool Settings::removeMonitoredMac(const uint8_t* mac) {
+  const int removedIx = findMonitoredMac(mac);
+
+  if (removedIx == -1) {
+    return false;
+  }
+
+  const char* values[SETTINGS_NUM_STRING_FIELDS];
+  currentValues(values);
+
+  rebuild(
+    values,
+    numMonitoredMacs() - 1,
+    [this, removedIx](const size_t ix, uint8_t* buffer) -> const char* {
+      const size_t sourceIx = static_cast<int>(ix) < removedIx ? ix : ix + 1;
+
+      if (buffer) {
+        memcpy(buffer, monitoredMac(sourceIx), 6);
+      }
+      return deviceAlias(sourceIx);
     }
+  );
+
+  return true;
+}
+
+void Settings::serializeMonitoredMacs(JsonArray& macs, JsonBuffer& jsonBuffer) {
+  char macBuffer[25];
+  memset(macBuffer, 0, 25);
+
+  for (size_t i = 0; i < numMonitoredMacs(); i++) {
+    JsonArray& config = jsonBuffer.createArray();
+    formatMac(monitoredMac(i), macBuffer);
+    config.add(jsonBuffer.strdup(macBuffer));
+    config.add(deviceAlias(i));
+
+    macs.add(config);
   }
+}
 
-  return -1;
+void Settings::saveMonitoredMacs() {
+  DynamicJsonBuffer jsonBuffer;
+  JsonObject& changes = jsonBuffer.createObject();
+
+  JsonArray& macs = changes.createNestedArray("monitored_macs");
+  serializeMonitoredMacs(macs, jsonBuffer);
+
+  saveChanges(changes);
+}
+
+void Settings::currentValues(const char** values) const {
+  for (size_t i = 0; i < SETTINGS_NUM_STRING_FIELDS; i++) {
+    values[i] = get(static_cast<SettingsField>(i));
+  }
 }
 
 void Settings::formatMac(const uint8_t* mac, char* buffer) {
   IntParsing::bytesToHexStr(mac, 6, buffer, 25, ':');
 }
 
-void Settings::parseMac(const char *s, uint8_t *buffer) {
+bool Settings::parseMac(const char *s, uint8_t *buffer) {
+  memset(buffer, 0, 6);
+
+  if (strlen(s) != 17) {
+    return false;
+  }
+
+  for (size_t i = 0; i < 17; i++) {
+    if ((i % 3 == 2) ? (s[i] != ':') : !isxdigit(s[i])) {
+      return false;
+    }
+  }
+
   IntParsing::parseDelimitedBytes(s, buffer, 6, ':');
+  return true;
 }
@@ -1,6 +1,9 @@
 #include <Arduino.h>
 #include <StringStream.h>
 #include <ArduinoJson.h>
+#include <functional>
+#include <SettingsArena.h>
+#include <JsonStreamWriter.h>
 
 #ifndef _SETTINGS_H_INCLUDED
 #define _SETTINGS_H_INCLUDED
@@ -19,18 +22,70 @@
 #define SETTINGS_FILE  "/config.json"
 #define SETTINGS_TERMINATOR '\0'
 
+// Changes are appended here as "<crc32> <json patch>" lines and replayed on top
+// of SETTINGS_FILE at boot. Once the journal grows past the threshold it gets
+// folded back into SETTINGS_FILE.
+#define SETTINGS_JOURNAL_FILE "/config.journal"
+#define SETTINGS_SNAPSHOT_TMP_FILE "/config.json.tmp"
+
+#ifndef SETTINGS_JOURNAL_COMPACT_THRESHOLD
+#define SETTINGS_JOURNAL_COMPACT_THRESHOLD 4096
+#endif
+
 #define DEFAULT_MQTT_PORT 1883
 
+// PEM trust anchors for the MQTT broker. Used when TLS is enabled and no
+// fingerprint is configured.
+#define MQTT_CA_CERT_FILE "/mqtt_ca.pem"
+
+enum SettingsField {
+  SETTING_ADMIN_USERNAME = 0,
+  SETTING_ADMIN_PASSWORD,
+  SETTING_MQTT_SERVER,
+  SETTING_MQTT_USERNAME,
+  SETTING_MQTT_PASSWORD,
+  SETTING_MQTT_TOPIC_PATTERN,
+  SETTING_MQTT_TLS_FINGERPRINT,
+  SETTING_AP_NAME,
+  SETTING_AP_PASSWORD,
+  SETTINGS_NUM_STRING_FIELDS
+};
+
+// Which subsystems a settings change affects, so applying it can leave the
+// rest running. Debounce threshold and fleet version are read live and don't
+// have a bit.
+enum SettingsChange {
+  SETTINGS_CHANGED_AUTH = 1 << 0,
+  SETTINGS_CHANGED_MQTT = 1 << 1,
+  SETTINGS_CHANGED_TOPICS = 1 << 2,
+  SETTINGS_CHANGED_DEVICES = 1 << 3,
+  SETTINGS_CHANGED_ALIASES = 1 << 4,
+  SETTINGS_CHANGED_AP = 1 << 5,
+  SETTINGS_CHANGED_CLUSTER = 1 << 6,
+  SETTINGS_CHANGED_FLEET = 1 << 7,
+  SETTINGS_CHANGED_ALL = 0xFF
+};
+
 class Settings {
 public:
+  // Called once per device, first to size the new arena (mac is NULL) and
+  // then to fill it. Returns the device alias.
+  typedef std::function<const char*(const size_t ix, uint8_t* mac)> DeviceSource;
+
   Settings() :
-    adminUsername(""),
-    adminPassword(""),
-    apName("DashStadium"),
-    apPassword("qu3c2ER9Ddl"),
-    numMonitoredMacs(0),
-    monitoredMacs(NULL)
-  { }
+    mqttTls(false),
+    debounceThresholdMs(0),
+    clusterClaimWindowMs(0),
+    fleetEnabled(false),
+    fleetVersion(0),
+    loadMicros(0),
+    journalSize(0),
+    _generation(0),
+    changes(SETTINGS_CHANGED_ALL)
+  {
+    const char* values[SETTINGS_NUM_STRING_FIELDS] = { "", "", "", "", "", "", "", "DashStadium", "qu3c2ER9Ddl" };
+    rebuild(values, 0, NULL);
+  }
 
   ~Settings() {
   }
@@ -39,8 +94,12 @@ public:
   static void load(Settings& settings);
 
   void save();
+  void saveChanges(JsonObject& changes);
+  bool needsCompaction();
+  void compact();
   String toJson(const bool prettyPrint = true);
   void serialize(Stream& stream, const bool prettyPrint = false);
+  void serialize(JsonStreamWriter& json, const bool redactSecrets);
   void patch(JsonObject& obj);
 
   String mqttServer();
@@ -48,31 +107,84 @@ public:
   void setupSoftAP();
   bool hasAuthSettings();
 
-  String adminUsername;
-  String adminPassword;
-  String _mqttServer;
-  String mqttUsername;
-  String mqttPassword;
-  String mqttTopicPattern;
-  String apName;
-  String apPassword;
-
-  uint8_t* monitoredMacs;
-  String* deviceAliases;
-  size_t numMonitoredMacs;
+  inline const char* get(const SettingsField field) const { return arena.string(field); }
+  inline const char* adminUsername() const { return get(SETTING_ADMIN_USERNAME); }
+  inline const char* adminPassword() const { return get(SETTING_ADMIN_PASSWORD); }
+  inline const char* mqttServerWithPort() const { return get(SETTING_MQTT_SERVER); }
+  inline const char* mqttUsername() const { return get(SETTING_MQTT_USERNAME); }
+  inline const char* mqttPassword() const { return get(SETTING_MQTT_PASSWORD); }
+  inline const char* mqttTopicPattern() const { return get(SETTING_MQTT_TOPIC_PATTERN); }
+  inline const char* mqttTlsFingerprint() const { return get(SETTING_MQTT_TLS_FINGERPRINT); }
+  inline const char* apName() const { return get(SETTING_AP_NAME); }
+  inline const char* apPassword() const { return get(SETTING_AP_PASSWORD); }
+
+  inline size_t numMonitoredMacs() const { return arena.numDevices(); }
+  inline const uint8_t* monitoredMacs() const { return arena.macs(); }
+  inline const uint8_t* monitoredMac(const size_t ix) const { return arena.mac(ix); }
+  inline const char* deviceAlias(const size_t ix) const { return arena.alias(ix); }
+
+  // Bumped every time the arena is rebuilt, so views into it can tell when
+  // they've gone stale. Also bumped by touch().
+  inline uint32_t generation() const { return _generation; }
+  // For changes to plain fields made without a rebuild, e.g. fleetVersion, so
+  // that anything rendered from settings is redone.
+  inline void touch() { _generation++; }
+  inline size_t arenaSize() const { return arena.size(); }
+  // Returns the SettingsChange bits in mask that were set since they were
+  // last taken, and clears them. Everything starts out changed.
+  uint8_t takeChanges(const uint8_t mask = SETTINGS_CHANGED_ALL);
+
+  bool mqttTls;
   uint32_t debounceThresholdMs;
+  // Cluster mode is enabled when this is non-zero, see ClaimTracker.
+  uint32_t clusterClaimWindowMs;
+  // Follow the fleet config topics, see FleetConfig.
+  bool fleetEnabled;
+  uint32_t fleetVersion;
+  // How long load() took.
+  uint32_t loadMicros;
 
   int findMonitoredMac(const uint8_t* mac);
-
-  static void parseMac(const char* s, uint8_t* buffer);
+  // Both return false if nothing changed. Adding a device that's already
+  // monitored updates its alias.
+  bool addMonitoredMac(const uint8_t* mac, const char* alias);
+  bool removeMonitoredMac(const uint8_t* mac);
+  void serializeMonitoredMacs(JsonArray& macs, JsonBuffer& jsonBuffer);
+  // Journals the current device table.
+  void saveMonitoredMacs();
+
+  // Expects aa:bb:cc:dd:ee:ff. Returns false, leaving buffer zeroed, if s
+  // isn't in that form.
+  static bool parseMac(const char* s, uint8_t* buffer);
   static void formatMac(const uint8_t* mac, char* buffer);
 
+  static const char* FIELD_KEYS[SETTINGS_NUM_STRING_FIELDS];
+  static bool isSecret(const SettingsField field);
+  // True if built with DASH_BAKED_CONFIG.
+  static bool isBaked();
+
 protected:
+  SettingsArena arena;
+  size_t journalSize;
+  uint32_t _generation;
+  uint8_t changes;
+
+  void replayJournal();
+#ifdef DASH_BAKED_CONFIG
+  void loadBaked();
+#endif
+  void currentValues(const char** values) const;
+  void rebuild(const char* const* values, const size_t numDevices, DeviceSource devices);
 
   template <typename T>
-  void setIfPresent(JsonObject& obj, const char* key, T& var) {
+  void setIfPresent(JsonObject& obj, const char* key, T& var, const uint8_t change = 0) {
     if (obj.containsKey(key)) {
-      var = obj.get<T>(key);
+      const T value = obj.get<T>(key);
+
+      if (value != var) {
+        var = value;
+        changes |= change;
+      }
     }
   }
 };
@@ -0,0 +1,101 @@
+#include <SettingsArena.h>
+#include <utility>
+
+SettingsArena::SettingsArena()
+  : block(NULL),
+    blockSize(0),
+    _numStrings(0),
+    _numDevices(0),
+    poolOffset(0),
+    poolCursor(0)
+{ }
+
+SettingsArena::SettingsArena(const size_t numStrings, const size_t numDevices, const size_t poolSize)
+  : _numStrings(numStrings),
+    _numDevices(numDevices),
+    poolCursor(0)
+{
+  poolOffset = ((numStrings + numDevices) * sizeof(uint16_t)) + (numDevices * 6);
+  blockSize = poolOffset + poolSize;
+  block = new uint8_t[blockSize];
+  memset(block, 0, poolOffset);
+}
+
+SettingsArena::~SettingsArena() {
+  delete[] block;
+}
+
+void SettingsArena::swap(SettingsArena& other) {
+  std::swap(block, other.block);
+  std::swap(blockSize, other.blockSize);
+  std::swap(_numStrings, other._numStrings);
+  std::swap(_numDevices, other._numDevices);
+  std::swap(poolOffset, other.poolOffset);
+  std::swap(poolCursor, other.poolCursor);
+}
+
+void SettingsArena::load_P(PGM_VOID_P image, const size_t size, const size_t numStrings, const size_t numDevices) {
+  delete[] block;
+
+  _numStrings = numStrings;
+  _numDevices = numDevices;
+  poolOffset = ((numStrings + numDevices) * sizeof(uint16_t)) + (numDevices * 6);
+  blockSize = size;
+  poolCursor = size - poolOffset;
+  block = new uint8_t[blockSize];
+  memcpy_P(block, image, size);
+}
+
+uint16_t* SettingsArena::offsets() const {
+  return reinterpret_cast<uint16_t*>(block);
+}
+
+uint16_t SettingsArena::append(const char* value) {
+  const uint16_t offset = poolCursor;
+  const size_t length = strlen(value) + 1;
+
+  memcpy(block + poolOffset + poolCursor, value, length);
+  poolCursor += length;
+
+  return offset;
+}
+
+const char* SettingsArena::string(const size_t ix) const {
+  if (ix >= _numStrings) {
+    return "";
+  }
+
+  return reinterpret_cast<const char*>(block + poolOffset + offsets()[ix]);
+}
+
+size_t SettingsArena::numDevices() const {
+  return _numDevices;
+}
+
+const uint8_t* SettingsArena::macs() const {
+  return block + ((_numStrings + _numDevices) * sizeof(uint16_t));
+}
+
+const uint8_t* SettingsArena::mac(const size_t ix) const {
+  return macs() + (ix * 6);
+}
+
+uint8_t* SettingsArena::mac(const size_t ix) {
+  return block + ((_numStrings + _numDevices) * sizeof(uint16_t)) + (ix * 6);
+}
+
+const char* SettingsArena::alias(const size_t ix) const {
+  return reinterpret_cast<const char*>(block + poolOffset + offsets()[_numStrings + ix]);
+}
+
+size_t SettingsArena::size() const {
+  return blockSize;
+}
+
+void SettingsArena::setString(const size_t ix, const char* value) {
+  offsets()[ix] = append(value);
+}
+
+void SettingsArena::setAlias(const size_t ix, const char* value) {
+  offsets()[_numStrings + ix] = append(value);
+}
@@ -0,0 +1,52 @@
+#include <Arduino.h>
+
+#ifndef _SETTINGS_ARENA_H
+#define _SETTINGS_ARENA_H
+
+// Holds every string setting and the monitored device table in one block, so a
+// settings change costs exactly one allocation and one free instead of one per
+// field. Block layout:
+//
+//   uint16_t stringOffsets[numStrings]
+//   uint16_t aliasOffsets[numDevices]
+//   uint8_t  macs[numDevices * 6]
+//   char     pool[]
+//
+// Strings are appended to the pool in the order they're set.
+class SettingsArena {
+public:
+  SettingsArena();
+  SettingsArena(const size_t numStrings, const size_t numDevices, const size_t poolSize);
+  ~SettingsArena();
+
+  void swap(SettingsArena& other);
+  // Replaces the contents with a prebuilt block in flash.
+  void load_P(PGM_VOID_P image, const size_t size, const size_t numStrings, const size_t numDevices);
+
+  const char* string(const size_t ix) const;
+  size_t numDevices() const;
+  const uint8_t* macs() const;
+  const uint8_t* mac(const size_t ix) const;
+  const char* alias(const size_t ix) const;
+  size_t size() const;
+
+  void setString(const size_t ix, const char* value);
+  uint8_t* mac(const size_t ix);
+  void setAlias(const size_t ix, const char* value);
+
+private:
+  uint8_t* block;
+  size_t blockSize;
+  size_t _numStrings;
+  size_t _numDevices;
+  size_t poolOffset;
+  size_t poolCursor;
+
+  SettingsArena(const SettingsArena&);
+  SettingsArena& operator=(const SettingsArena&);
+
+  uint16_t* offsets() const;
+  uint16_t append(const char* value);
+};
+
+#endif
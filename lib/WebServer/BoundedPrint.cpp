@@ -0,0 +1,40 @@
+#include <BoundedPrint.h>
+
+BoundedPrint::BoundedPrint(const size_t capacity)
+  : buffer(new uint8_t[capacity]),
+    capacity(capacity),
+    used(0),
+    overflow(false)
+{ }
+
+BoundedPrint::~BoundedPrint() {
+  delete[] buffer;
+}
+
+size_t BoundedPrint::write(uint8_t c) {
+  return write(&c, 1);
+}
+
+size_t BoundedPrint::write(const uint8_t* data, size_t size) {
+  if (overflow || size > capacity - used) {
+    overflow = true;
+    return 0;
+  }
+
+  memcpy(buffer + used, data, size);
+  used += size;
+
+  return size;
+}
+
+const uint8_t* BoundedPrint::data() const {
+  return buffer;
+}
+
+size_t BoundedPrint::length() const {
+  return used;
+}
+
+bool BoundedPrint::overflowed() const {
+  return overflow;
+}
@@ -0,0 +1,28 @@
+#include <Arduino.h>
+
+#ifndef _BOUNDED_PRINT_H
+#define _BOUNDED_PRINT_H
+
+// Collects output into a fixed size buffer. Once something doesn't fit, the
+// rest is dropped and overflowed() says so, so the caller can send it some
+// other way instead.
+class BoundedPrint : public Print {
+public:
+  BoundedPrint(const size_t capacity);
+  ~BoundedPrint();
+
+  virtual size_t write(uint8_t c);
+  virtual size_t write(const uint8_t* buffer, size_t size);
+
+  const uint8_t* data() const;
+  size_t length() const;
+  bool overflowed() const;
+
+private:
+  uint8_t* buffer;
+  size_t capacity;
+  size_t used;
+  bool overflow;
+};
+
+#endif
@@ -0,0 +1,66 @@
+#include <ChunkedPrint.h>
+#include <algorithm>
+
+ChunkedPrint::ChunkedPrint(WiFiClient client)
+  : client(client),
+    length(0)
+{ }
+
+void ChunkedPrint::begin(const int code, const char* contentType) {
+  char header[160];
+  snprintf_P(
+    header,
+    sizeof(header),
+    PSTR("HTTP/1.1 %d %s\r\nContent-Type: %s\r\nTransfer-Encoding: chunked\r\nConnection: close\r\n\r\n"),
+    code,
+    code == 200 ? "OK" : "Error",
+    contentType
+  );
+  client.write(reinterpret_cast<const uint8_t*>(header), strlen(header));
+}
+
+void ChunkedPrint::end() {
+  flushChunk();
+  client.write(reinterpret_cast<const uint8_t*>("0\r\n\r\n"), 5);
+}
+
+size_t ChunkedPrint::write(uint8_t c) {
+  if (length == HTTP_CHUNK_SIZE) {
+    flushChunk();
+  }
+
+  buffer[length++] = c;
+  return 1;
+}
+
+size_t ChunkedPrint::write(const uint8_t* data, size_t size) {
+  size_t written = 0;
+
+  while (written < size) {
+    if (length == HTTP_CHUNK_SIZE) {
+      flushChunk();
+    }
+
+    const size_t n = std::min(size - written, HTTP_CHUNK_SIZE - length);
+    memcpy(buffer + length, data + written, n);
+    length += n;
+    written += n;
+  }
+
+  return written;
+}
+
+void ChunkedPrint::flushChunk() {
+  if (length == 0) {
+    return;
+  }
+
+  char chunkHeader[8];
+  sprintf(chunkHeader, "%X\r\n", static_cast<unsigned int>(length));
+
+  client.write(reinterpret_cast<const uint8_t*>(chunkHeader), strlen(chunkHeader));
+  client.write(buffer, length);
+  client.write(reinterpret_cast<const uint8_t*>("\r\n"), 2);
+
+  length = 0;
+}
@@ -0,0 +1,31 @@
+#include <Arduino.h>
+#include <WiFiClient.h>
+
+#ifndef _CHUNKED_PRINT_H
+#define _CHUNKED_PRINT_H
+
+#ifndef HTTP_CHUNK_SIZE
+#define HTTP_CHUNK_SIZE 256
+#endif
+
+// Sends an HTTP/1.1 response with Transfer-Encoding: chunked, buffering
+// output into fixed size chunks. Response size is independent of free heap.
+class ChunkedPrint : public Print {
+public:
+  ChunkedPrint(WiFiClient client);
+
+  void begin(const int code, const char* contentType);
+  void end();
+
+  virtual size_t write(uint8_t c);
+  virtual size_t write(const uint8_t* buffer, size_t size);
+
+private:
+  WiFiClient client;
+  uint8_t buffer[HTTP_CHUNK_SIZE];
+  size_t length;
+
+  void flushChunk();
+};
+
+#endif
@@ -4,7 +4,12 @@
 #include <Settings.h>
 #include <DashStadiumHttpServer.h>
 #include <TokenIterator.h>
+#include <OuiLookup.h>
+#include <algorithm>
+#include <ChunkedPrint.h>
+#include <BoundedPrint.h>
 #include <index.html.gz.h>
+#include <HeapProfiler.h>
 
 void DashStadiumHttpServer::begin() {
   applySettings(settings);
@@ -14,18 +19,60 @@ void DashStadiumHttpServer::begin() {
     [this](){ handleFirmwareUpload(); },
     [this](){ handleFirmwareIncrement(); }
   );
-  server.on("/about", [this]() { handleAbout(); });
-  server.on("/settings", HTTP_GET, [this]() { serveFile(SETTINGS_FILE); });
+  server.on("/about", [this]() {
+    sendCachedJson(CACHED_ABOUT, ABOUT_CACHE_MAX_AGE, [this](JsonStreamWriter& json) { writeAbout(json); });
+  });
+  server.on("/settings", HTTP_GET, [this]() {
+    sendCachedJson(CACHED_SETTINGS, 0, [this](JsonStreamWriter& json) { settings.serialize(json, true); });
+  });
   server.on("/settings", HTTP_PUT, [this]() { handleUpdateSettings(); });
+  server.on("/mqtt_ca", HTTP_GET, handleServeFile(MQTT_CA_CERT_FILE, "text/plain"));
+  server.on("/mqtt_ca", HTTP_POST,
+    [this]() { server.send_P(200, TEXT_PLAIN, PSTR("success")); },
+    handleUpdateFile(MQTT_CA_CERT_FILE)
+  );
+  server.on("/devices", HTTP_GET, [this]() {
+    sendCachedJson(CACHED_DEVICES, 0, [this](JsonStreamWriter& json) { writeDevices(json); });
+  });
+  server.on("/discovered", HTTP_GET, [this]() {
+    sendJsonStream([this](JsonStreamWriter& json) { writeDiscovered(json); });
+  });
+  server.on("/events", HTTP_GET, [this]() { handleListEvents(); });
+  server.on("/events/stream", HTTP_GET, [this]() { handleEventStream(); });
+#ifdef DASH_HEAP_PROFILE
+  server.on("/debug/heap", HTTP_GET, [this]() {
+    sendJsonStream([this](JsonStreamWriter& json) { writeHeapProfile(json); });
+  });
+#endif
+
+  const char* collectedHeaders[] = { "Last-Event-ID" };
+  server.collectHeaders(collectedHeaders, 1);
+
+  eventStream.onRender(
+    [this](const DashEventRecord& record, char* buffer, size_t length) {
+      return renderEvent(record, buffer, length);
+    }
+  );
 
-  server.begin();
+#ifndef DASH_DISABLE_WEBSOCKETS
+  server.on("/ws/clients", HTTP_GET, [this]() {
+    sendJsonStream([this](JsonStreamWriter& json) { writeWsClients(json); });
+  });
 
   wsServer.onEvent(
     [this](uint8_t num, WStype_t type, uint8_t * payload, size_t length) {
       handleWsEvent(num, type, payload, length);
     }
   );
+  wsServer.onRender(
+    [this](const DashEventRecord& record, char* buffer, size_t length) {
+      return renderEvent(record, buffer, length);
+    }
+  );
   wsServer.begin();
+#endif
+
+  server.begin();
 }
 
 void DashStadiumHttpServer::handleFirmwareIncrement() {
@@ -67,50 +114,262 @@ void DashStadiumHttpServer::handleFirmwareUpload() {
     );
   }
 
+  if (this->restartHandler) {
+    this->restartHandler();
+  }
+
   ESP.restart();
 }
 
 void DashStadiumHttpServer::handleClient() {
-  server.handleClient();
-  wsServer.loop();
+  {
+    HEAP_SCOPE(HEAP_TAG_HTTP);
+    server.handleClient();
+    handlePendingPolls();
+  }
+#ifndef DASH_DISABLE_WEBSOCKETS
+  {
+    HEAP_SCOPE(HEAP_TAG_WEBSOCKETS);
+    wsServer.loop();
+  }
+#endif
+  {
+    HEAP_SCOPE(HEAP_TAG_EVENT_STREAM);
+    eventStream.loop();
+  }
 }
 
 void DashStadiumHttpServer::on(const char* path, HTTPMethod method, ESP8266WebServer::THandlerFunction handler) {
   server.on(path, method, handler);
 }
 
+bool DashStadiumHttpServer::hasArg(const char* name) {
+  return server.hasArg(name);
+}
+
+String DashStadiumHttpServer::arg(const char* name) {
+  return server.arg(name);
+}
+
+void DashStadiumHttpServer::send(int code, const char* contentType, const String& content) {
+  server.send(code, contentType, content);
+}
+
+bool DashStadiumHttpServer::authenticationRequired() {
+  return server.authenticationRequired();
+}
+
 void DashStadiumHttpServer::applySettings(Settings& settings) {
   if (settings.hasAuthSettings()) {
-    server.requireAuthentication(settings.adminUsername, settings.adminPassword);
+    server.requireAuthentication(settings.adminUsername(), settings.adminPassword());
   } else {
     server.disableAuthentication();
   }
 }
 
 void DashStadiumHttpServer::onSettingsSaved(SettingsSavedHandler handler) {
-  if (settings.hasAuthSettings()) {
-    server.requireAuthentication(settings.adminUsername, settings.adminPassword);
-  } else {
-    server.disableAuthentication();
-  }
-  
   this->settingsSavedHandler = handler;
 }
 
-void DashStadiumHttpServer::handleAbout() {
-  DynamicJsonBuffer buffer;
-  JsonObject& response = buffer.createObject();
+void DashStadiumHttpServer::onRestart(RestartHandler handler) {
+  this->restartHandler = handler;
+}
+
+#ifdef DASH_HEAP_PROFILE
+void DashStadiumHttpServer::writeHeapProfile(JsonStreamWriter& json) {
+  // Snapshot first: writing the response allocates too.
+  HeapTagStats stats[HEAP_NUM_TAGS];
+  for (size_t i = 0; i < HEAP_NUM_TAGS; i++) {
+    stats[i] = HeapProfiler::stats(static_cast<HeapTag>(i));
+  }
 
-  response["version"] = QUOTE(FIRMWARE_VERSION);
-  response["variant"] = QUOTE(FIRMWARE_VARIANT);
-  response["free_heap"] = ESP.getFreeHeap();
-  response["arduino_version"] = ESP.getCoreVersion();
-  response["reset_reason"] = ESP.getResetReason();
+  json.beginObject()
+    .field("free_heap", ESP.getFreeHeap())
+    .field("max_free_block", ESP.getMaxFreeBlockSize())
+    .field("heap_fragmentation", ESP.getHeapFragmentation())
+    .field("allocs", HeapProfiler::numAllocs());
+
+  json.key("tags").beginObject();
+  for (size_t i = 0; i < HEAP_NUM_TAGS; i++) {
+    json.key(HeapProfiler::TAG_NAMES[i]).beginObject()
+      .field("allocs", stats[i].allocs)
+      .field("frees", stats[i].frees)
+      .field("allocated_bytes", stats[i].allocatedBytes)
+      .field("live_blocks", stats[i].liveBlocks)
+      .field("live_bytes", stats[i].liveBytes)
+      .field("peak_live_bytes", stats[i].peakLiveBytes)
+      .endObject();
+  }
+  json.endObject();
+
+  char caller[11];
+  HeapSample sample;
 
-  String body;
-  response.printTo(body);
+  json.key("samples").beginArray();
+  for (size_t i = 0; HeapProfiler::sample(i, sample); i++) {
+    sprintf_P(caller, PSTR("0x%08x"), static_cast<unsigned>(sample.caller));
+
+    json.beginObject()
+      .field("seq", sample.seq)
+      .field("tag", HeapProfiler::TAG_NAMES[sample.tag])
+      .field("size", sample.size)
+      .field("caller", caller)
+      .endObject();
+  }
+  json.endArray();
 
-  server.send(200, APPLICATION_JSON, body);
+  json.endObject();
+}
+#endif
+
+void DashStadiumHttpServer::onAbout(AboutHandler handler) {
+  this->aboutHandler = handler;
+}
+
+void DashStadiumHttpServer::sendJsonStream(JsonRenderer renderer) {
+  ChunkedPrint response(server.client());
+  JsonStreamWriter json(response);
+
+  response.begin(200, APPLICATION_JSON);
+  renderer(json);
+  response.end();
+
+  server.client().stop();
+}
+
+void DashStadiumHttpServer::sendCachedJson(const CachedEndpoint endpoint, const uint32_t maxAge, JsonRenderer renderer) {
+  const uint32_t generation = settings.generation();
+  const CachedResponse* response = responseCache.get(endpoint, generation, maxAge);
+
+  if (response == NULL) {
+    {
+      // Rendering stops being kept once it's over what the cache could hold.
+      BoundedPrint body(RESPONSE_CACHE_MAX_BYTES);
+      JsonStreamWriter json(body);
+
+      renderer(json);
+
+      if (!body.overflowed()) {
+        response = responseCache.put(endpoint, generation, APPLICATION_JSON, body.data(), body.length());
+      }
+    }
+
+    // Too big to cache. It's rendered again, straight to the client in
+    // chunks, rather than held in memory whole.
+    if (response == NULL) {
+      sendJsonStream(renderer);
+      return;
+    }
+  }
+
+  server.client().write(response->data, response->length);
+  server.client().stop();
+}
+
+void DashStadiumHttpServer::writeAbout(JsonStreamWriter& json) {
+  const EventPipelineStats& stats = eventPipeline.getStats();
+
+  json.beginObject()
+    .field("version", QUOTE(FIRMWARE_VERSION))
+    .field("variant", QUOTE(FIRMWARE_VARIANT))
+    .field("free_heap", ESP.getFreeHeap())
+    .field("max_free_block", ESP.getMaxFreeBlockSize())
+    .field("settings_arena_size", settings.arenaSize())
+    .field("settings_generation", settings.generation())
+    .field("settings_load_us", settings.loadMicros)
+    .field("settings_baked", Settings::isBaked())
+    .field("arduino_version", ESP.getCoreVersion())
+    .field("reset_reason", ESP.getResetReason());
+
+  json.key("events").beginObject()
+    .field("total", stats.events)
+    .field("monitored", stats.monitoredEvents)
+    .field("debounced", stats.debouncedEvents)
+    .field("published", stats.publishedEvents)
+    .field("avg_publish_us", stats.publishedEvents > 0 ? (stats.totalPublishMicros / stats.publishedEvents) : 0)
+    .field("max_publish_us", stats.maxPublishMicros)
+    .field("min_free_heap", stats.minFreeHeap)
+    .endObject();
+
+  const ResponseCacheStats& cacheStats = responseCache.getStats();
+  const uint32_t lookups = cacheStats.hits + cacheStats.misses;
+
+  json.key("response_cache").beginObject()
+    .field("hits", cacheStats.hits)
+    .field("misses", cacheStats.misses)
+    .field("hit_rate_pct", lookups > 0 ? (cacheStats.hits * 100 / lookups) : 0)
+    .field("uncacheable", cacheStats.uncacheable)
+    .field("bytes_served", cacheStats.bytesServed)
+    .field("size", responseCache.size())
+    .endObject();
+
+  if (this->aboutHandler) {
+    this->aboutHandler(json);
+  }
+
+  json.endObject();
+}
+
+void DashStadiumHttpServer::writeDevices(JsonStreamWriter& json) {
+  char macBuffer[25];
+  char vendor[OUI_MAX_VENDOR_LENGTH];
+
+  json.beginArray();
+
+  for (size_t i = 0; i < settings.numMonitoredMacs(); i++) {
+    const uint8_t* mac = settings.monitoredMac(i);
+    Settings::formatMac(mac, macBuffer);
+
+    json.beginObject()
+      .field("mac", macBuffer)
+      .field("alias", settings.deviceAlias(i));
+
+    if (OuiLookup::findVendor(mac, vendor, sizeof(vendor))) {
+      json.field("vendor", vendor);
+    }
+
+    json.endObject();
+  }
+
+  json.endArray();
+}
+
+void DashStadiumHttpServer::writeDiscovered(JsonStreamWriter& json) {
+  const DeviceDiscovery& discovery = eventPipeline.getDiscovery();
+  const unsigned long now = millis();
+
+  size_t order[DISCOVERY_MAX_DEVICES];
+  for (size_t i = 0; i < discovery.size(); i++) {
+    order[i] = i;
+  }
+  std::sort(order, order + discovery.size(), [&discovery](size_t a, size_t b) {
+    return discovery.get(a).count > discovery.get(b).count;
+  });
+
+  char macBuffer[25];
+  char vendor[OUI_MAX_VENDOR_LENGTH];
+
+  json.beginArray();
+
+  for (size_t i = 0; i < discovery.size(); i++) {
+    const DiscoveredDevice& discovered = discovery.get(order[i]);
+    Settings::formatMac(discovered.mac, macBuffer);
+
+    json.beginObject()
+      .field("mac", macBuffer)
+      .field("count", discovered.count)
+      .field("error", discovered.error)
+      .field("first_seen_ms_ago", now - discovered.firstSeen)
+      .field("last_seen_ms_ago", now - discovered.lastSeen);
+
+    if (OuiLookup::findVendor(discovered.mac, vendor, sizeof(vendor))) {
+      json.field("vendor", vendor);
+    }
+
+    json.endObject();
+  }
+
+  json.endArray();
 }
 
 ESP8266WebServer::THandlerFunction DashStadiumHttpServer::handleServeFile(
@@ -163,12 +422,14 @@ void DashStadiumHttpServer::handleUpdateSettings() {
 
   if (parsedSettings.success()) {
     settings.patch(parsedSettings);
-    settings.save();
-
-    this->applySettings(settings);
+    settings.saveChanges(parsedSettings);
 
+    // The handler applies whatever changed, credentials included, so they're
+    // only set up again when SETTINGS_CHANGED_AUTH says so.
     if (this->settingsSavedHandler) {
       this->settingsSavedHandler();
+    } else {
+      this->applySettings(settings);
     }
 
     server.send(200, APPLICATION_JSON, "true");
@@ -187,28 +448,192 @@ ESP8266WebServer::THandlerFunction DashStadiumHttpServer::handleServe_P(const ch
   };
 }
 
+#ifndef DASH_DISABLE_WEBSOCKETS
 void DashStadiumHttpServer::handleWsEvent(uint8_t num, WStype_t type, uint8_t *payload, size_t length) {
   switch (type) {
     case WStype_DISCONNECTED:
-      if (numWsClients > 0) {
-        numWsClients--;
-      }
+      wsServer.clientDisconnected(num);
       break;
 
-    case WStype_CONNECTED:
-      numWsClients++;
+    case WStype_CONNECTED: {
+      // Payload is the request URL, which may carry ?since=<seq> to resume.
+      const char* since = strstr(reinterpret_cast<const char*>(payload), "since=");
+      wsServer.clientConnected(num, since ? strtoul(since + 6, NULL, 10) : 0);
       break;
+    }
+  }
+}
+#endif
+
+void DashStadiumHttpServer::handleWifiEvent(const DashEventType type, const uint8_t *macAddr, const bool monitored, const bool synthetic) {
+  const uint8_t flags = (monitored ? EVENT_FLAG_MONITORED : 0) | (synthetic ? EVENT_FLAG_SYNTHETIC : 0);
+
+#ifndef DASH_DISABLE_WEBSOCKETS
+  wsServer.enqueue(type, macAddr, flags);
+#else
+  eventHistory.push(type, macAddr, flags);
+#endif
+}
+
+void DashStadiumHttpServer::handleEventStream() {
+  uint32_t resumeFrom = 0;
+
+  // Last-Event-ID is the last event the client saw, since= the first it wants.
+  if (server.hasHeader("Last-Event-ID") && server.header("Last-Event-ID").length() > 0) {
+    resumeFrom = strtoul(server.header("Last-Event-ID").c_str(), NULL, 10) + 1;
+  } else if (server.hasArg("since")) {
+    resumeFrom = strtoul(server.arg("since").c_str(), NULL, 10);
+  }
+
+  if (!eventStream.add(server.client(), resumeFrom)) {
+    server.send_P(503, TEXT_PLAIN, PSTR("Too many event stream clients"));
+    return;
+  }
+
+  server.detachClient();
+}
+
+void DashStadiumHttpServer::handleListEvents() {
+  const uint32_t since = server.hasArg("since") ? strtoul(server.arg("since").c_str(), NULL, 10) : 0;
+  const size_t limit = server.hasArg("limit") ? server.arg("limit").toInt() : EVENTS_DEFAULT_LIMIT;
+
+  // Without since, or with a backlog to return, answer right away.
+  if (since == 0 || since < eventHistory.head()) {
+    sendEvents(server.detachClient(), since, limit);
+    return;
+  }
+
+  unsigned long timeout = EVENTS_DEFAULT_POLL_TIMEOUT;
+  if (server.hasArg("timeout")) {
+    timeout = std::min(static_cast<unsigned long>(server.arg("timeout").toInt()), static_cast<unsigned long>(EVENTS_MAX_POLL_TIMEOUT));
   }
+
+  for (size_t i = 0; i < EVENTS_MAX_LONG_POLLS; i++) {
+    PendingEventPoll& poll = pendingPolls[i];
+
+    if (!poll.client.connected()) {
+      poll.client = server.detachClient();
+      poll.since = since;
+      poll.limit = limit;
+      poll.deadline = millis() + timeout;
+      return;
+    }
+  }
+
+  // No free slot: answer with the (empty) backlog rather than blocking.
+  sendEvents(server.detachClient(), since, limit);
+}
+
+void DashStadiumHttpServer::handlePendingPolls() {
+  for (size_t i = 0; i < EVENTS_MAX_LONG_POLLS; i++) {
+    PendingEventPoll& poll = pendingPolls[i];
+
+    if (!poll.client.connected()) {
+      continue;
+    }
+
+    if (poll.since < eventHistory.head() || static_cast<long>(millis() - poll.deadline) >= 0) {
+      sendEvents(poll.client, poll.since, poll.limit);
+      poll.client = WiFiClient();
+    }
+  }
+}
+
+void DashStadiumHttpServer::sendEvents(WiFiClient client, uint32_t since, size_t limit) {
+  ChunkedPrint response(client);
+  JsonStreamWriter json(response);
+
+  response.begin(200, APPLICATION_JSON);
+  writeEvents(json, since, limit);
+  response.end();
+
+  client.stop();
 }
 
-void DashStadiumHttpServer::handleWifiEvent(const char *eventType, const uint8_t *macAddr) {
-  if (numWsClients > 0) {
-    char macAddrStr[25];
-    IntParsing::bytesToHexStr(macAddr, 6, macAddrStr, sizeof(macAddrStr), ':');
+void DashStadiumHttpServer::writeEvents(JsonStreamWriter& json, uint32_t since, size_t limit) {
+  const unsigned long now = millis();
+  const uint32_t head = eventHistory.head();
+  const uint32_t tail = eventHistory.tail();
+
+  // Without since, return the most recent events.
+  uint32_t seq = since > 0 ? since : (head > limit ? head - limit : 1);
+  const bool missed = seq < tail;
+  seq = std::max(seq, tail);
+
+  char macBuffer[25];
+
+  json.beginObject()
+    .field("head", head)
+    .field("tail", tail)
+    .field("missed", missed);
+
+  json.key("events").beginArray();
+  for (size_t count = 0; seq < head && count < limit; seq++, count++) {
+    const DashEventRecord* record = eventHistory.get(seq);
+    Settings::formatMac(record->mac, macBuffer);
+
+    json.beginObject()
+      .field("seq", record->seq)
+      .field("event", DASH_EVENT_NAMES[record->type])
+      .field("macAddr", macBuffer)
+      .field("monitored", (record->flags & EVENT_FLAG_MONITORED) != 0)
+      .field("age_ms", now - record->timestamp);
+
+    if (record->flags & EVENT_FLAG_SYNTHETIC) {
+      json.field("synthetic", true);
+    }
+
+    json.endObject();
+  }
+  json.endArray();
+
+  json.field("next", seq);
+  json.endObject();
+}
+
+size_t DashStadiumHttpServer::renderEvent(const DashEventRecord& record, char* buffer, size_t length) {
+  char macAddrStr[25];
+  IntParsing::bytesToHexStr(record.mac, 6, macAddrStr, sizeof(macAddrStr), ':');
+
+  char vendor[OUI_MAX_VENDOR_LENGTH];
+  if (!OuiLookup::findVendor(record.mac, vendor, sizeof(vendor))) {
+    vendor[0] = 0;
+  }
 
-    char msg[100];
-    sprintf(msg, "{\"event\":\"%s\",\"macAddr\":\"%s\"}", eventType, macAddrStr);
+  int written = snprintf(
+    buffer,
+    length,
+    "{\"seq\":%u,\"event\":\"%s\",\"macAddr\":\"%s\",\"vendor\":\"%s\",\"monitored\":%s%s}",
+    static_cast<unsigned int>(record.seq),
+    DASH_EVENT_NAMES[record.type],
+    macAddrStr,
+    vendor,
+    (record.flags & EVENT_FLAG_MONITORED) ? "true" : "false",
+    (record.flags & EVENT_FLAG_SYNTHETIC) ? ",\"synthetic\":true" : ""
+  );
+
+  return std::min(static_cast<size_t>(written), length - 1);
+}
+
+#ifndef DASH_DISABLE_WEBSOCKETS
+void DashStadiumHttpServer::writeWsClients(JsonStreamWriter& json) {
+  json.beginArray();
 
-    wsServer.broadcastTXT(msg);
+  for (uint8_t i = 0; i < WEBSOCKETS_SERVER_CLIENT_MAX; i++) {
+    const WsClientStats& client = wsServer.clientStats(i);
+
+    if (!client.connected) {
+      continue;
+    }
+
+    json.beginObject()
+      .field("num", i)
+      .field("queue_depth", wsServer.queueDepth(i))
+      .field("sent", client.sent)
+      .field("dropped", client.dropped)
+      .endObject();
   }
+
+  json.endArray();
 }
+#endif
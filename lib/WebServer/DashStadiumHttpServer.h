@@ -1,31 +1,94 @@
 #include <WebServer.h>
 #include <Settings.h>
-#include <WebSocketsServer.h>
+#include <EventPipeline.h>
+#include <EventStream.h>
+
+// Define to drop the port 81 WebSocket server and its per-client buffers.
+// Events are still available from GET /events/stream.
+#ifndef DASH_DISABLE_WEBSOCKETS
+#include <QueuedWebSocketsServer.h>
+#endif
+#include <JsonStreamWriter.h>
+#include <ResponseCache.h>
 
 #ifndef _MILIGHT_HTTP_SERVER
 #define _MILIGHT_HTTP_SERVER
 
 #define MAX_DOWNLOAD_ATTEMPTS 3
 
+// Number of recent events kept for GET /events and WebSocket resume. Each one
+// costs sizeof(DashEventRecord) (16 bytes).
+#ifndef EVENT_HISTORY_SIZE
+#define EVENT_HISTORY_SIZE 64
+#endif
+
+#define EVENTS_MAX_LONG_POLLS 2
+#define EVENTS_DEFAULT_LIMIT 32
+#define EVENTS_DEFAULT_POLL_TIMEOUT 25000
+#define EVENTS_MAX_POLL_TIMEOUT 60000
+
+// GET /about carries live counters, so a cached copy is only reused briefly.
+#ifndef ABOUT_CACHE_MAX_AGE
+#define ABOUT_CACHE_MAX_AGE 1000
+#endif
+
+struct PendingEventPoll {
+  WiFiClient client;
+  uint32_t since;
+  size_t limit;
+  unsigned long deadline;
+};
+
 typedef std::function<void(void)> SettingsSavedHandler;
+typedef std::function<void(void)> RestartHandler;
+typedef std::function<void(JsonStreamWriter&)> JsonRenderer;
+// Adds fields to the GET /about response object.
+typedef std::function<void(JsonStreamWriter&)> AboutHandler;
 
 const char TEXT_PLAIN[] PROGMEM = "text/plain";
 const char APPLICATION_JSON[] = "application/json";
 
 class DashStadiumHttpServer {
 public:
-  DashStadiumHttpServer(Settings& settings)
+  DashStadiumHttpServer(Settings& settings, EventPipeline& eventPipeline)
     : server(WebServer(80)),
-      wsServer(WebSocketsServer(81)),
+      eventHistory(EVENT_HISTORY_SIZE),
+#ifndef DASH_DISABLE_WEBSOCKETS
+      wsServer(81, eventHistory),
+#endif
+      eventStream(eventHistory),
       settings(settings),
-      settingsSavedHandler(NULL)
+      eventPipeline(eventPipeline),
+      settingsSavedHandler(NULL),
+      restartHandler(NULL),
+      aboutHandler(NULL)
   { }
 
   void begin();
   void handleClient();
   void on(const char* path, HTTPMethod method, ESP8266WebServer::THandlerFunction handler);
+  // Arguments of the current request, for handlers added with on().
+  bool hasArg(const char* name);
+  String arg(const char* name);
+  void send(int code, const char* contentType, const String& content);
+  // Whether requests are actually being checked for admin credentials.
+  bool authenticationRequired();
   void onSettingsSaved(SettingsSavedHandler handler);
-  void handleWifiEvent(const char* eventType, const uint8_t* macAddr);
+  // Picks up the admin credentials. Called by the saved handler when they've
+  // changed, over the web or from elsewhere (e.g. fleet config).
+  void applySettings(Settings& settings);
+  void onRestart(RestartHandler handler);
+  void onAbout(AboutHandler handler);
+  void handleWifiEvent(const DashEventType type, const uint8_t* macAddr, const bool monitored, const bool synthetic = false);
+
+  // Same document as GET /about.
+  void writeAbout(JsonStreamWriter& json);
+  // Streams the rendered JSON as the response to the current request.
+  void sendJsonStream(JsonRenderer renderer);
+  // Serves the cached response for endpoint if it was rendered at the current
+  // settings generation (and within maxAge ms, if nonzero). Otherwise renders
+  // it, caches it, and sends it with a Content-Length.
+  void sendCachedJson(const CachedEndpoint endpoint, const uint32_t maxAge, JsonRenderer renderer);
 
 protected:
   ESP8266WebServer::THandlerFunction handleServeFile(
@@ -36,21 +99,45 @@ protected:
   bool serveFile(const char* file, const char* contentType = "text/html");
   ESP8266WebServer::THandlerFunction handleUpdateFile(const char* filename);
   ESP8266WebServer::THandlerFunction handleServe_P(const char* data, size_t length);
-  void applySettings(Settings& settings);
 
-  void handleAbout();
+  void writeDevices(JsonStreamWriter& json);
+  void writeDiscovered(JsonStreamWriter& json);
+#ifndef DASH_DISABLE_WEBSOCKETS
+  void writeWsClients(JsonStreamWriter& json);
+#endif
+  void writeEvents(JsonStreamWriter& json, uint32_t since, size_t limit);
+#ifdef DASH_HEAP_PROFILE
+  void writeHeapProfile(JsonStreamWriter& json);
+#endif
+
+  void handleListEvents();
+  void handlePendingPolls();
+  void sendEvents(WiFiClient client, uint32_t since, size_t limit);
+
   void handleUpdateSettings();
   void handleFirmwareUpload();
   void handleFirmwareIncrement();
 
+#ifndef DASH_DISABLE_WEBSOCKETS
   void handleWsEvent(uint8_t num, WStype_t type, uint8_t * payload, size_t length);
+#endif
+  void handleEventStream();
+  size_t renderEvent(const DashEventRecord& record, char* buffer, size_t length);
 
   WebServer server;
-  WebSocketsServer wsServer;
+  EventRing eventHistory;
+#ifndef DASH_DISABLE_WEBSOCKETS
+  QueuedWebSocketsServer wsServer;
+#endif
+  EventStream eventStream;
   Settings& settings;
+  EventPipeline& eventPipeline;
   SettingsSavedHandler settingsSavedHandler;
+  RestartHandler restartHandler;
+  AboutHandler aboutHandler;
   File updateFile;
-  size_t numWsClients;
+  PendingEventPoll pendingPolls[EVENTS_MAX_LONG_POLLS];
+  ResponseCache responseCache;
 
 };
 
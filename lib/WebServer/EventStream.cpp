@@ -0,0 +1,105 @@
+#include <EventStream.h>
+#include <algorithm>
+
+EventStream::EventStream(EventRing& events)
+  : events(events),
+    renderer(NULL)
+{ }
+
+void EventStream::onRender(TEventRenderer renderer) {
+  this->renderer = renderer;
+}
+
+bool EventStream::add(WiFiClient client, uint32_t resumeFrom) {
+  for (size_t i = 0; i < SSE_MAX_CLIENTS; i++) {
+    Client& slot = clients[i];
+
+    if (slot.client.connected()) {
+      continue;
+    }
+
+    client.print(F(
+      "HTTP/1.1 200 OK\r\n"
+      "Content-Type: text/event-stream\r\n"
+      "Cache-Control: no-cache\r\n"
+      "Connection: keep-alive\r\n"
+      "\r\n"
+      "retry: 2000\n\n"
+    ));
+
+    slot.client = client;
+    slot.cursor = (resumeFrom == 0 || resumeFrom > events.head())
+      ? events.head()
+      : std::max(resumeFrom, events.tail());
+    slot.lastWrite = millis();
+    slot.lastProgress = millis();
+
+    return true;
+  }
+
+  return false;
+}
+
+void EventStream::loop() {
+  for (size_t i = 0; i < SSE_MAX_CLIENTS; i++) {
+    Client& client = clients[i];
+
+    if (client.client.connected()) {
+      drain(client);
+    }
+  }
+}
+
+void EventStream::drain(Client& client) {
+  const unsigned long now = millis();
+  char message[SSE_MAX_MESSAGE_LENGTH];
+
+  // Events that fell out of the ring are gone. The client can tell from the
+  // gap in IDs.
+  client.cursor = std::max(client.cursor, events.tail());
+
+  while (client.cursor < events.head()) {
+    const DashEventRecord* record = events.get(client.cursor);
+    int length = snprintf(message, sizeof(message), "id: %u\ndata: ", static_cast<unsigned int>(record->seq));
+
+    if (renderer) {
+      length += renderer(*record, message + length, sizeof(message) - length - 2);
+    }
+    message[length++] = '\n';
+    message[length++] = '\n';
+
+    if (client.client.availableForWrite() < static_cast<size_t>(length)) {
+      break;
+    }
+
+    client.client.write(reinterpret_cast<const uint8_t*>(message), length);
+    client.cursor++;
+    client.lastWrite = now;
+    client.lastProgress = now;
+  }
+
+  if (client.cursor < events.head()) {
+    if ((now - client.lastProgress) > SSE_SLOW_CLIENT_TIMEOUT) {
+      client.client.stop();
+    }
+  } else {
+    client.lastProgress = now;
+
+    if ((now - client.lastWrite) > SSE_HEARTBEAT_INTERVAL) {
+      client.client.print(F(": ping\n\n"));
+      client.lastWrite = now;
+    }
+  }
+}
+
+size_t EventStream::numClients() {
+  size_t count = 0;
+
+  for (size_t i = 0; i < SSE_MAX_CLIENTS; i++) {
+    if (clients[i].client.connected()) {
+      count++;
+    }
+  }
+
+  return count;
+}
@@ -0,0 +1,59 @@
+#include <Arduino.h>
+#include <functional>
+#include <WiFiClient.h>
+#include <EventRing.h>
+
+#ifndef _EVENT_STREAM_H
+#define _EVENT_STREAM_H
+
+#ifndef SSE_MAX_CLIENTS
+#define SSE_MAX_CLIENTS 4
+#endif
+
+// Comment lines are sent this often on idle connections so proxies don't
+// time them out.
+#ifndef SSE_HEARTBEAT_INTERVAL
+#define SSE_HEARTBEAT_INTERVAL 15000
+#endif
+
+#ifndef SSE_SLOW_CLIENT_TIMEOUT
+#define SSE_SLOW_CLIENT_TIMEOUT 5000
+#endif
+
+#define SSE_MAX_MESSAGE_LENGTH 192
+
+// Server-Sent Events (text/event-stream) connections fed from an EventRing.
+// A connection is just a held WiFiClient plus a cursor into the ring, so each
+// one costs a few bytes beyond its TCP buffers. Event IDs are ring sequence
+// numbers, which lets browsers resume with Last-Event-ID.
+class EventStream {
+public:
+  typedef std::function<size_t(const DashEventRecord& record, char* buffer, size_t length)> TEventRenderer;
+
+  EventStream(EventRing& events);
+
+  void onRender(TEventRenderer renderer);
+
+  // Sends the response headers and starts streaming from resumeFrom (or only
+  // new events if 0). Returns false if all slots are taken.
+  bool add(WiFiClient client, uint32_t resumeFrom);
+  void loop();
+
+  size_t numClients();
+
+private:
+  struct Client {
+    WiFiClient client;
+    uint32_t cursor;
+    unsigned long lastWrite;
+    unsigned long lastProgress;
+  };
+
+  EventRing& events;
+  TEventRenderer renderer;
+  Client clients[SSE_MAX_CLIENTS];
+
+  void drain(Client& client);
+};
+
+#endif
@@ -0,0 +1,140 @@
+#include <QueuedWebSocketsServer.h>
+#include <algorithm>
+
+QueuedWebSocketsServer::QueuedWebSocketsServer(uint16_t port, EventRing& events)
+  : WebSocketsServer(port),
+    events(events),
+    renderer(NULL)
+{
+  memset(clients, 0, sizeof(clients));
+}
+
+void QueuedWebSocketsServer::onRender(TEventRenderer renderer) {
+  this->renderer = renderer;
+}
+
+void QueuedWebSocketsServer::clientConnected(uint8_t num, uint32_t resumeFrom) {
+  WsClientStats& client = clients[num];
+
+  client.connected = true;
+
+  if (resumeFrom == 0 || resumeFrom > events.head()) {
+    client.cursor = events.head();
+  } else {
+    client.cursor = std::max(resumeFrom, events.tail());
+  }
+
+  client.sent = 0;
+  client.dropped = 0;
+  client.lastProgress = millis();
+}
+
+void QueuedWebSocketsServer::clientDisconnected(uint8_t num) {
+  clients[num].connected = false;
+}
+
+void QueuedWebSocketsServer::enqueue(const DashEventType type, const uint8_t* mac, const uint8_t flags) {
+  // The push below overwrites this event if the ring is full.
+  const uint32_t evictedSeq = events.head() - events.capacity();
+  const DashEventRecord* evicted = events.get(evictedSeq);
+
+  if (evicted != NULL) {
+    for (uint8_t i = 0; i < WEBSOCKETS_SERVER_CLIENT_MAX; i++) {
+      WsClientStats& client = clients[i];
+
+      if (!client.connected || client.cursor > evictedSeq) {
+        continue;
+      }
+
+      if (evicted->flags & EVENT_FLAG_MONITORED) {
+        disconnect(i);
+        client.connected = false;
+      } else {
+        client.cursor = evictedSeq + 1;
+        client.dropped++;
+      }
+    }
+  }
+
+  events.push(type, mac, flags);
+}
+
+void QueuedWebSocketsServer::loop() {
+  WebSocketsServer::loop();
+
+  for (uint8_t i = 0; i < WEBSOCKETS_SERVER_CLIENT_MAX; i++) {
+    if (clients[i].connected) {
+      drain(i);
+    }
+  }
+}
+
+void QueuedWebSocketsServer::drain(uint8_t num) {
+  WsClientStats& client = clients[num];
+
+  if (client.cursor >= events.head()) {
+    client.lastProgress = millis();
+    return;
+  }
+
+  char message[WS_MAX_MESSAGE_LENGTH];
+
+  for (size_t sends = 0; sends < WS_MAX_SENDS_PER_LOOP && client.cursor < events.head(); sends++) {
+    const DashEventRecord* record = events.get(client.cursor);
+
+    if (record == NULL) {
+      client.cursor = events.tail();
+      continue;
+    }
+
+    size_t length = renderer ? renderer(*record, message, sizeof(message)) : 0;
+
+    // Frame header is at most 4 bytes for messages this size.
+    if (availableForWrite(num) < length + 4) {
+      break;
+    }
+
+    if (length > 0) {
+      sendTXT(num, message, length);
+    }
+
+    client.cursor++;
+    client.sent++;
+    client.lastProgress = millis();
+  }
+
+  if (client.cursor < events.head() && (millis() - client.lastProgress) > WS_SLOW_CLIENT_TIMEOUT) {
+    disconnect(num);
+    client.connected = false;
+  }
+}
+
+size_t QueuedWebSocketsServer::availableForWrite(uint8_t num) {
+  WSclient_t* client = &_clients[num];
+
+  if (!clientIsConnected(client)) {
+    return 0;
+  }
+
+  return client->tcp->availableForWrite();
+}
+
+size_t QueuedWebSocketsServer::numClients() const {
+  size_t count = 0;
+
+  for (uint8_t i = 0; i < WEBSOCKETS_SERVER_CLIENT_MAX; i++) {
+    if (clients[i].connected) {
+      count++;
+    }
+  }
+
+  return count;
+}
+
+size_t QueuedWebSocketsServer::queueDepth(uint8_t num) const {
+  return clients[num].connected ? (events.head() - clients[num].cursor) : 0;
+}
+
+const WsClientStats& QueuedWebSocketsServer::clientStats(uint8_t num) const {
+  return clients[num];
+}
@@ -0,0 +1,68 @@
+#include <Arduino.h>
+#include <functional>
+#include <WebSocketsServer.h>
+#include <EventRing.h>
+
+#ifndef _QUEUED_WEBSOCKETS_SERVER_H
+#define _QUEUED_WEBSOCKETS_SERVER_H
+
+// Clients that make no progress on a non-empty queue for this long are
+// disconnected.
+#ifndef WS_SLOW_CLIENT_TIMEOUT
+#define WS_SLOW_CLIENT_TIMEOUT 5000
+#endif
+
+// Upper bound on messages sent to a single client per loop().
+#ifndef WS_MAX_SENDS_PER_LOOP
+#define WS_MAX_SENDS_PER_LOOP 4
+#endif
+
+#define WS_MAX_MESSAGE_LENGTH 160
+
+struct WsClientStats {
+  bool connected;
+  uint32_t cursor;
+  uint32_t sent;
+  uint32_t dropped;
+  unsigned long lastProgress;
+};
+
+// Broadcasts events from an EventRing without ever blocking on a slow client.
+// Each client has its own cursor into the ring, so the ring doubles as a
+// bounded per-client send queue. Messages are only written when the client's
+// TCP window has room for them.
+//
+// When the ring is about to overwrite an event a client hasn't been sent yet,
+// telemetry is dropped for that client. Events from monitored devices are
+// never dropped: the client is disconnected instead.
+class QueuedWebSocketsServer : public WebSocketsServer {
+public:
+  typedef std::function<size_t(const DashEventRecord& record, char* buffer, size_t length)> TEventRenderer;
+
+  QueuedWebSocketsServer(uint16_t port, EventRing& events);
+
+  void onRender(TEventRenderer renderer);
+
+  // Starts the client at resumeFrom if the ring still holds it, otherwise at
+  // the oldest event held. 0 means only send new events.
+  void clientConnected(uint8_t num, uint32_t resumeFrom = 0);
+  void clientDisconnected(uint8_t num);
+
+  // Must be called instead of pushing to the ring directly.
+  void enqueue(const DashEventType type, const uint8_t* mac, const uint8_t flags);
+  void loop();
+
+  size_t numClients() const;
+  size_t queueDepth(uint8_t num) const;
+  const WsClientStats& clientStats(uint8_t num) const;
+
+protected:
+  EventRing& events;
+  TEventRenderer renderer;
+  WsClientStats clients[WEBSOCKETS_SERVER_CLIENT_MAX];
+
+  size_t availableForWrite(uint8_t num);
+  void drain(uint8_t num);
+};
+
+#endif
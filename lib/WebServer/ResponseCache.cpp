@@ -0,0 +1,95 @@
+#include <ResponseCache.h>
+
+ResponseCache::ResponseCache() {
+  for (size_t i = 0; i < CACHED_NUM_ENDPOINTS; i++) {
+    entries[i].data = NULL;
+    entries[i].length = 0;
+  }
+
+  memset(&stats, 0, sizeof(stats));
+}
+
+ResponseCache::~ResponseCache() {
+  clear();
+}
+
+void ResponseCache::evict(const CachedEndpoint endpoint) {
+  delete[] entries[endpoint].data;
+  entries[endpoint].data = NULL;
+  entries[endpoint].length = 0;
+}
+
+void ResponseCache::clear() {
+  for (size_t i = 0; i < CACHED_NUM_ENDPOINTS; i++) {
+    evict(static_cast<CachedEndpoint>(i));
+  }
+}
+
+size_t ResponseCache::size() const {
+  size_t total = 0;
+
+  for (size_t i = 0; i < CACHED_NUM_ENDPOINTS; i++) {
+    total += entries[i].length;
+  }
+
+  return total;
+}
+
+const CachedResponse* ResponseCache::get(const CachedEndpoint endpoint, const uint32_t generation, const uint32_t maxAge) {
+  const CachedResponse& entry = entries[endpoint];
+
+  if (entry.data == NULL
+    || entry.generation != generation
+    || (maxAge > 0 && (millis() - entry.createdAt) > maxAge)) {
+    stats.misses++;
+    return NULL;
+  }
+
+  stats.hits++;
+  stats.bytesServed += entry.length;
+
+  return &entry;
+}
+
+const CachedResponse* ResponseCache::put(const CachedEndpoint endpoint, const uint32_t generation, const char* contentType, const String& body) {
+  return put(endpoint, generation, contentType, reinterpret_cast<const uint8_t*>(body.c_str()), body.length());
+}
+
+const CachedResponse* ResponseCache::put(const CachedEndpoint endpoint, const uint32_t generation, const char* contentType, const uint8_t* body, const size_t bodyLength) {
+  evict(endpoint);
+
+  char header[128];
+  const size_t headerLength = snprintf_P(
+    header,
+    sizeof(header),
+    PSTR("HTTP/1.1 200 OK\r\nContent-Type: %s\r\nContent-Length: %u\r\nConnection: close\r\n\r\n"),
+    contentType,
+    static_cast<unsigned>(bodyLength)
+  );
+  const size_t length = headerLength + bodyLength;
+
+  if (size() + length > RESPONSE_CACHE_MAX_BYTES) {
+    // Stale entries for other endpoints are the first to go.
+    clear();
+
+    if (length > RESPONSE_CACHE_MAX_BYTES) {
+      stats.uncacheable++;
+      return NULL;
+    }
+  }
+
+  CachedResponse& entry = entries[endpoint];
+  entry.data = new uint8_t[length];
+  entry.length = length;
+  entry.generation = generation;
+  entry.createdAt = millis();
+
+  memcpy(entry.data, header, headerLength);
+  memcpy(entry.data + headerLength, body, bodyLength);
+
+  return &entry;
+}
+
+const ResponseCacheStats& ResponseCache::getStats() const {
+  return stats;
+}
@@ -0,0 +1,58 @@
+#include <Arduino.h>
+
+#ifndef _RESPONSE_CACHE_H
+#define _RESPONSE_CACHE_H
+
+#ifndef RESPONSE_CACHE_MAX_BYTES
+#define RESPONSE_CACHE_MAX_BYTES 4096
+#endif
+
+enum CachedEndpoint {
+  CACHED_ABOUT = 0,
+  CACHED_SETTINGS,
+  CACHED_DEVICES,
+  CACHED_NUM_ENDPOINTS
+};
+
+struct CachedResponse {
+  // Complete HTTP response, headers included, so it goes out in one write.
+  uint8_t* data;
+  size_t length;
+  uint32_t generation;
+  unsigned long createdAt;
+};
+
+struct ResponseCacheStats {
+  uint32_t hits;
+  uint32_t misses;
+  // Responses that would have pushed the cache over its budget.
+  uint32_t uncacheable;
+  uint32_t bytesServed;
+};
+
+// Holds rendered responses for read-mostly endpoints. An entry is only valid
+// for the generation it was rendered at (see Settings::generation()), and
+// optionally for a limited time, for responses that include live counters.
+class ResponseCache {
+public:
+  ResponseCache();
+  ~ResponseCache();
+
+  // NULL if there's no valid entry. maxAge of 0 means no time limit.
+  const CachedResponse* get(const CachedEndpoint endpoint, const uint32_t generation, const uint32_t maxAge);
+  // NULL if the response doesn't fit in the cache's budget.
+  const CachedResponse* put(const CachedEndpoint endpoint, const uint32_t generation, const char* contentType, const String& body);
+  const CachedResponse* put(const CachedEndpoint endpoint, const uint32_t generation, const char* contentType, const uint8_t* body, const size_t bodyLength);
+  void clear();
+
+  size_t size() const;
+  const ResponseCacheStats& getStats() const;
+
+private:
+  CachedResponse entries[CACHED_NUM_ENDPOINTS];
+  ResponseCacheStats stats;
+
+  void evict(const CachedEndpoint endpoint);
+};
+
+#endif
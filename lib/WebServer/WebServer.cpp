@@ -15,6 +15,12 @@ void WebServer::disableAuthentication() {
   this->authEnabled = false;
 }
 
+WiFiClient WebServer::detachClient() {
+  WiFiClient client = _currentClient;
+  _currentClient = WiFiClient();
+  return client;
+}
+
 void WebServer::_handleRequest() {
   if (this->authEnabled
     && !this->authenticate(this->username.c_str(), this->password.c_str())) {
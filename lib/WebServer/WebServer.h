@@ -22,6 +22,10 @@ public:
   void requireAuthentication(const String& username, const String& password);
   void disableAuthentication();
 
+  // Takes ownership of the current client away from the server, so that a
+  // handler can keep the connection open after it returns.
+  WiFiClient detachClient();
+
   inline bool clientConnected() {
     return _currentClient && _currentClient.connected();
   }
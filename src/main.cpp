@@ -10,102 +10,961 @@
 #include <TokenIterator.h>
 #include <MqttClient.h>
 #include <DashStadiumHttpServer.h>
+#include <EventPipeline.h>
+#include <DeviceRenderCache.h>
+#include <WarmState.h>
+#include <CaptureQueue.h>
+#include <TaskScheduler.h>
+#include <ClaimTracker.h>
+#include <FleetConfig.h>
+#include <OccupancyCounter.h>
+#include <EventLog.h>
+#include <EventInjector.h>
+#include <TopicTrie.h>
+#include <StringStream.h>
+#include <algorithm>
+#include <time.h>
 
 extern "C" {
 #include <user_interface.h>
 }
 
+// The first 128 bytes of RTC user memory are used by eboot to pass OTA
+// commands, so the snapshot goes after them. Offset is in 4-byte blocks.
+#define WARM_STATE_RTC_OFFSET 32
+#define WARM_STATE_MAX_SIZE 384
+#define WARM_STATE_SAVE_INTERVAL 1000
+
+// How often to retry the saved credentials while the station interface is
+// down. The config portal is only opened when there are none.
+#ifndef WIFI_STA_CONNECT_TIMEOUT
+#define WIFI_STA_CONNECT_TIMEOUT 30000
+#endif
+#define WIFI_CONFIG_PORTAL_TIMEOUT 180
+
+// Commands published to <prefix><chip id>/cmd/... are answered on
+// <prefix><chip id>/resp/<command>.
+#define MQTT_NODE_TOPIC_PREFIX "dash_stadium/nodes/"
+#define MQTT_MAX_ALIAS_LENGTH 64
+
+// Sets the clock for the event log's timestamps. Times are kept in UTC.
+#ifndef NTP_SERVER
+#define NTP_SERVER "pool.ntp.org"
+#endif
+
+// Longest a single capture drain may run before yielding to other tasks.
+#define CAPTURE_DRAIN_BUDGET_US 2000
+
 WiFiEventHandler probeHandler;
 WiFiEventHandler connectedHandler;
 
-enum DashEventType {
-  DASH_EVENT_PROBE_REQUEST = 0,
-  DASH_EVENT_CONNECTED = 1
-};
-static const char* EVENT_NAMES[] = {"probe_request", "connected"};
-
 Settings settings;
 MqttClient* mqttClient = NULL;
-unsigned long* lastSeenTimes[2] = {NULL, NULL};
-DashStadiumHttpServer webServer(settings);
+EventPipeline eventPipeline(settings);
+DeviceRenderCache deviceCache;
+DashStadiumHttpServer webServer(settings, eventPipeline);
+CaptureQueue captureQueue;
+TaskScheduler scheduler;
+int captureTaskId = -1;
+ClaimTracker claimTracker(ESP.getChipId());
+FleetConfig fleetConfig(settings);
+TopicTrie mqttRoutes;
+String nodeTopicPrefix;
+bool settingsReloadPending = false;
+
+// Monitored events that couldn't be published yet because there was no MQTT
+// connection, e.g. while still booting.
+CaptureQueue pendingPublishes;
+// Published, but possibly still in the MQTT client's write buffer.
+CaptureQueue unflushedPublishes;
+
+OccupancyCounter occupancy;
+EventLog eventLog;
+EventInjector injector(captureQueue);
+// Set while a synthetic event is going through the pipeline, so the handlers
+// can tag or skip it.
+bool processingSynthetic = false;
+
+// millis() at each boot milestone, 0 until reached.
+struct BootMetrics {
+  unsigned long captureReady;
+  unsigned long firstCapture;
+  unsigned long staConnected;
+  unsigned long mqttConnected;
+  unsigned long firstPublish;
+} bootMetrics;
+bool configPortalRun = false;
+unsigned long lastStationAttempt = 0;
+
+// How long applying each kind of settings change last took, in microseconds.
+// This is the time the subsystem was down; an MQTT reconnect is on top of it
+// (see mqtt.last_connect_ms).
+struct ApplyMetrics {
+  uint32_t applies;
+  uint8_t lastChanges;
+  uint32_t mqttMicros;
+  uint32_t subscriptionsMicros;
+  uint32_t clusterMicros;
+  uint32_t devicesMicros;
+  uint32_t apMicros;
+  uint32_t authMicros;
+} applyMetrics;
+
+void applySettings();
+
+// Sends what's buffered. If that fails, events published since the last
+// flush are queued to be published again. An earlier automatic flush may have
+// sent some of them already, so those go out twice.
+bool flushPublishes() {
+  const bool sent = mqttClient->flush();
+  CapturedEvent event;
+
+  while (unflushedPublishes.pop(event)) {
+    if (!sent) {
+      pendingPublishes.push(static_cast<DashEventType>(event.type), event.mac, 0);
+    }
+  }
+
+  return sent;
+}
+
+// Returns false only if the publish failed. Without a topic pattern there's
+// nothing to publish, which isn't a failure to retry.
+bool sendDeviceEvent(const DashEventType type, const uint8_t* mac, const size_t deviceIx) {
+  const char* topic = deviceCache.topic(deviceIx, type);
+
+  if (!topic) {
+    return true;
+  }
+
+  if (unflushedPublishes.size() == CAPTURE_QUEUE_SIZE) {
+    flushPublishes();
+  }
+
+  if (!mqttClient->connected() || !mqttClient->sendUpdate(topic)) {
+    return false;
+  }
 
-void triggerEvent(const DashEventType& evtType, const uint8_t* mac) {
-  int macIx = settings.findMonitoredMac(mac);
+  unflushedPublishes.push(type, mac, 0);
 
-  webServer.handleWifiEvent(EVENT_NAMES[evtType], mac);
+  if (bootMetrics.firstPublish == 0) {
+    bootMetrics.firstPublish = millis();
+  }
+  return true;
+}
+
+void publishDeviceEvent(const DashEventType type, const uint8_t* mac, const size_t deviceIx) {
+  if (!mqttClient) {
+    return;
+  }
 
-  if (macIx != -1) {
-    unsigned long timestamp = millis();
+  // Not queued for later, that would skew the run's numbers.
+  if (processingSynthetic) {
+    const char* topic = deviceCache.topic(deviceIx, type);
 
-    if ((lastSeenTimes[evtType][macIx] + settings.debounceThresholdMs) < timestamp) {
-      char formattedMac[25];
-      Settings::formatMac(mac, formattedMac);
-      mqttClient->sendUpdate(EVENT_NAMES[evtType], formattedMac, settings.deviceAliases[macIx].c_str());
+    if (topic && mqttClient->connected() && mqttClient->sendUpdate(topic, DASH_MQTT_SYNTHETIC_PAYLOAD)) {
+      injector.published();
     }
+    return;
+  }
 
-    lastSeenTimes[evtType][macIx] = timestamp;
+  if (!sendDeviceEvent(type, mac, deviceIx)) {
+    pendingPublishes.push(type, mac, 0);
+  }
+}
+
+// Stops at the first failed send, leaving that event at the front of the queue
+// for the next try.
+void flushPendingPublishes() {
+  CapturedEvent event;
+
+  while (mqttClient->connected() && pendingPublishes.peek(event)) {
+    // Looked up again in case the device table changed in the meantime.
+    const int deviceIx = settings.findMonitoredMac(event.mac);
+
+    if (deviceIx != -1 && !sendDeviceEvent(static_cast<DashEventType>(event.type), event.mac, deviceIx)) {
+      break;
+    }
+
+    pendingPublishes.pop(event);
+  }
+  flushPublishes();
+}
+
+void handleDeviceEvent(const DashEventType type, const uint8_t* mac, const size_t deviceIx, const int8_t rssi) {
+  // Other nodes won't see synthetic events, so there's nothing to claim.
+  if (processingSynthetic) {
+    publishDeviceEvent(type, mac, deviceIx);
+    return;
+  }
+
+  eventLog.record(type, mac, deviceIx, rssi);
+
+  // Without a cluster (or a broker to coordinate through), publish right away.
+  if (claimTracker.window() == 0 || !mqttClient || !mqttClient->connected()) {
+    publishDeviceEvent(type, mac, deviceIx);
+    return;
+  }
+
+  if (claimTracker.claimLocal(type, mac, rssi, millis())) {
+    char topic[CLUSTER_CLAIM_TOPIC_LENGTH];
+    char payload[CLUSTER_CLAIM_PAYLOAD_LENGTH];
+
+    claimTracker.formatClaim(type, mac, rssi, topic, payload);
+    mqttClient->publish(topic, payload);
+  }
+}
+
+// The device table is indexed by position, so anything that looks devices up
+// has to be caught up before the next event is processed. Debounce state is
+// only reset if the set of devices changed.
+void applyDeviceChanges(const uint8_t changes) {
+  if (changes & SETTINGS_CHANGED_DEVICES) {
+    eventPipeline.resetDevices();
+  }
+
+  if (changes & (SETTINGS_CHANGED_DEVICES | SETTINGS_CHANGED_ALIASES | SETTINGS_CHANGED_TOPICS)) {
+    deviceCache.rebuild(settings);
+  }
+}
+
+void refreshDevices() {
+  applyDeviceChanges(settings.takeChanges(SETTINGS_CHANGED_DEVICES | SETTINGS_CHANGED_ALIASES | SETTINGS_CHANGED_TOPICS));
+}
+
+void publishResponse(const char* command, JsonRenderer renderer) {
+  String topic = nodeTopicPrefix;
+  topic += "resp/";
+  topic += command;
+
+  String payload;
+  StringStream stream(payload);
+  JsonStreamWriter json(stream);
+  renderer(json);
+
+  mqttClient->publish(topic.c_str(), payload.c_str());
+}
+
+void publishResult(const char* command, const bool ok) {
+  publishResponse(command, [ok](JsonStreamWriter& json) {
+    json.beginObject().field("ok", ok).endObject();
+  });
+}
+
+void handleFleetMessage(const TopicMatch& match, const uint8_t* payload, const size_t length) {
+  uint8_t changed;
+  const FleetApplyResult result = fleetConfig.apply(match.topic, payload, length, changed);
+
+  if (result == FLEET_GAP) {
+    Serial.println(F("Missed a fleet config delta, fetching the full document"));
+    mqttClient->refreshSubscription(FLEET_CONFIG_TOPIC);
+  } else if (result == FLEET_INVALID) {
+    Serial.println(F("ERROR: Invalid fleet config message"));
+  }
+
+  if (changed & FLEET_CHANGED_DEVICES) {
+    refreshDevices();
+  }
+
+  // Might recreate the MQTT client, which can't happen from inside its
+  // callback.
+  if (changed & FLEET_CHANGED_FIELDS) {
+    settingsReloadPending = true;
+  }
+
+  char statusTopic[FLEET_STATUS_TOPIC_LENGTH];
+  String status;
+  fleetConfig.formatStatus(statusTopic, status);
+  mqttClient->publish(statusTopic, status.c_str(), true);
+}
+
+void handleClaimMessage(const TopicMatch& match, const uint8_t* payload, const size_t length) {
+  DashEventType type;
+  uint8_t mac[6];
+  uint32_t nodeId;
+  int8_t rssi;
+
+  if (ClaimTracker::parseClaim(match.topic, payload, length, type, mac, nodeId, rssi)) {
+    claimTracker.recordRemote(type, mac, nodeId, rssi, millis());
+  }
+}
+
+void handleAddDeviceCommand(const TopicMatch& match, const uint8_t* payload, const size_t length) {
+  uint8_t mac[6];
+  char alias[MQTT_MAX_ALIAS_LENGTH];
+  const size_t aliasLength = std::min(length, sizeof(alias) - 1);
+
+  if (!Settings::parseMac(match.wildcards[0], mac)) {
+    publishResult("add_device", false);
+    return;
+  }
+
+  memcpy(alias, payload, aliasLength);
+  alias[aliasLength] = 0;
+
+  const bool changed = settings.addMonitoredMac(mac, alias);
+
+  if (changed) {
+    settings.saveMonitoredMacs();
+    refreshDevices();
+  }
+
+  publishResult("add_device", changed);
+}
+
+void handleRemoveDeviceCommand(const TopicMatch& match, const uint8_t* payload, const size_t length) {
+  uint8_t mac[6];
+
+  if (!Settings::parseMac(match.wildcards[0], mac)) {
+    publishResult("remove_device", false);
+    return;
+  }
+
+  const bool changed = settings.removeMonitoredMac(mac);
+
+  if (changed) {
+    settings.saveMonitoredMacs();
+    refreshDevices();
+  }
+
+  publishResult("remove_device", changed);
+}
+
+// cmd/trigger/<event type> with the device MAC as the payload. Goes through
+// the capture queue like a real event would, but tagged as synthetic so it
+// isn't logged, claimed or mistaken for a real press.
+void handleTriggerCommand(const TopicMatch& match, const uint8_t* payload, const size_t length) {
+  char macStr[18];
+  uint8_t mac[6];
+  bool ok = false;
+
+  if (length == 17) {
+    memcpy(macStr, payload, length);
+    macStr[length] = 0;
+
+    if (Settings::parseMac(macStr, mac)) {
+      for (size_t i = 0; i < DASH_NUM_EVENT_TYPES && !ok; i++) {
+        if (strcmp(match.wildcards[0], DASH_EVENT_NAMES[i]) == 0) {
+          ok = captureQueue.push(static_cast<DashEventType>(i), mac, 0, CAPTURE_FLAG_SYNTHETIC);
+          scheduler.trigger(captureTaskId);
+        }
+      }
+    }
+  }
+
+  publishResult("trigger", ok);
+}
+
+void handleSnapshotCommand(const TopicMatch& match, const uint8_t* payload, const size_t length) {
+  publishResponse("snapshot", [](JsonStreamWriter& json) {
+    json.beginObject();
+    json.key("settings");
+    settings.serialize(json, true);
+    json.field("settings_generation", settings.generation())
+      .field("uptime_ms", millis())
+      .endObject();
+  });
+}
+
+void handleUnknownCommand(const TopicMatch& match, const uint8_t* payload, const size_t length) {
+  publishResponse("error", [&match](JsonStreamWriter& json) {
+    json.beginObject()
+      .field("error", "unknown command")
+      .field("command", match.rest)
+      .endObject();
+  });
+}
+
+void setupMqttRoutes() {
+  char chipId[9];
+  sprintf_P(chipId, PSTR("%08X"), static_cast<unsigned>(ESP.getChipId()));
+
+  nodeTopicPrefix = MQTT_NODE_TOPIC_PREFIX;
+  nodeTopicPrefix += chipId;
+  nodeTopicPrefix += '/';
+
+  const String cmd = nodeTopicPrefix + "cmd/";
+
+  mqttRoutes.on((cmd + "stats").c_str(), [](const TopicMatch& match, const uint8_t* payload, const size_t length) {
+    publishResponse("stats", [](JsonStreamWriter& json) { webServer.writeAbout(json); });
+  });
+  mqttRoutes.on((cmd + "devices/+/add").c_str(), handleAddDeviceCommand);
+  mqttRoutes.on((cmd + "devices/+/remove").c_str(), handleRemoveDeviceCommand);
+  mqttRoutes.on((cmd + "trigger/+").c_str(), handleTriggerCommand);
+  mqttRoutes.on((cmd + "reload").c_str(), [](const TopicMatch& match, const uint8_t* payload, const size_t length) {
+    settingsReloadPending = true;
+    publishResult("reload", true);
+  });
+  mqttRoutes.on((cmd + "snapshot").c_str(), handleSnapshotCommand);
+  mqttRoutes.on((cmd + "#").c_str(), handleUnknownCommand);
+
+  mqttRoutes.on(CLUSTER_CLAIM_TOPIC_PREFIX "+/+", handleClaimMessage);
+  mqttRoutes.on(FLEET_CONFIG_TOPIC, handleFleetMessage);
+  mqttRoutes.on(FLEET_DELTA_TOPIC, handleFleetMessage);
+}
+
+void handleMqttMessage(const char* topic, const uint8_t* payload, const size_t length) {
+  if (!mqttRoutes.dispatch(topic, payload, length)) {
+#ifdef MQTT_DEBUG
+    printf("MqttClient - no route for %s\n", topic);
+#endif
+  }
+}
+
+// Presses still waiting to be published go first, then as much of the
+// pipeline's debounce state as fits after them.
+void saveWarmState() {
+  uint32_t buffer[WARM_STATE_MAX_SIZE / sizeof(uint32_t)];
+  uint8_t* bytes = reinterpret_cast<uint8_t*>(buffer);
+  CapturedEvent pending[CAPTURE_QUEUE_SIZE];
+
+  const size_t numPending = pendingPublishes.copyTo(pending, CAPTURE_QUEUE_SIZE);
+  const size_t pendingLength = WarmState::encodePending(pending, numPending, bytes, sizeof(buffer));
+
+  if (pendingLength == 0) {
+    return;
+  }
+
+  const size_t length = eventPipeline.saveState(bytes + pendingLength, sizeof(buffer) - pendingLength);
+  ESP.rtcUserMemoryWrite(WARM_STATE_RTC_OFFSET, buffer, pendingLength + length);
+}
+
+void restoreWarmState() {
+  // RTC memory holds garbage after a power-on.
+  if (ESP.getResetInfoPtr()->reason == REASON_DEFAULT_RST) {
+    return;
+  }
+
+  uint32_t buffer[WARM_STATE_MAX_SIZE / sizeof(uint32_t)];
+  const uint8_t* bytes = reinterpret_cast<const uint8_t*>(buffer);
+  const CapturedEvent* pending;
+  size_t numPending;
+  size_t pendingLength;
+
+  if (!ESP.rtcUserMemoryRead(WARM_STATE_RTC_OFFSET, buffer, sizeof(buffer))
+    || !WarmState::decodePending(bytes, sizeof(buffer), pending, numPending, pendingLength)) {
+    return;
+  }
+
+  for (size_t i = 0; i < numPending; i++) {
+    pendingPublishes.push(static_cast<DashEventType>(pending[i].type), pending[i].mac, pending[i].rssi);
+  }
+
+  if (eventPipeline.restoreState(bytes + pendingLength, sizeof(buffer) - pendingLength)) {
+    Serial.println(F("Restored warm state"));
   }
 }
 
 void onProbeRequestPrint(const WiFiEventSoftAPModeProbeRequestReceived& evt) {
-  triggerEvent(DASH_EVENT_PROBE_REQUEST, evt.mac);
+  if (bootMetrics.firstCapture == 0) {
+    bootMetrics.firstCapture = millis();
+  }
+
+  captureQueue.push(DASH_EVENT_PROBE_REQUEST, evt.mac, evt.rssi);
+  scheduler.trigger(captureTaskId);
 }
 
 void onStationConnected(const WiFiEventSoftAPModeStationConnected& evt) {
-  triggerEvent(DASH_EVENT_CONNECTED, evt.mac);
+  if (bootMetrics.firstCapture == 0) {
+    bootMetrics.firstCapture = millis();
+  }
+
+  captureQueue.push(DASH_EVENT_CONNECTED, evt.mac, 0);
+  scheduler.trigger(captureTaskId);
 }
 
-void applySettings() {
-  if (settings.mqttServer().length() > 0) {
-    if (mqttClient) {
-      delete mqttClient;
+void drainCaptureQueue() {
+  const uint32_t start = micros();
+  CapturedEvent event;
+
+  while ((micros() - start) < CAPTURE_DRAIN_BUDGET_US && captureQueue.pop(event)) {
+    processingSynthetic = (event.flags & CAPTURE_FLAG_SYNTHETIC) != 0;
+
+    if (event.type == DASH_EVENT_PROBE_REQUEST && !processingSynthetic) {
+      occupancy.record(event.mac, millis());
+    }
+
+    eventPipeline.triggerEvent(static_cast<DashEventType>(event.type), event.mac, event.rssi);
+
+    if (processingSynthetic) {
+      injector.processed();
+      processingSynthetic = false;
     }
+  }
+
+  // Everything published in this pass goes out in one write.
+  if (mqttClient) {
+    flushPublishes();
+  }
+
+  // Didn't finish within budget. Let the other tasks run, then come back.
+  if (captureQueue.size() > 0) {
+    scheduler.trigger(captureTaskId);
+  }
+}
+
+// Publishes the estimate to <node>/occupancy/<window>, and the raw sketch to
+// <node>/occupancy/<window>/sketch so counts from several nodes can be merged.
+void publishOccupancy(const OccupancyWindow window, const HyperLogLog& sketch, const unsigned long windowStart) {
+  if (!mqttClient || !mqttClient->connected()) {
+    return;
+  }
+
+  String topic = nodeTopicPrefix;
+  topic += "occupancy/";
+  topic += OccupancyCounter::WINDOW_NAMES[window];
+
+  String payload;
+  StringStream stream(payload);
+  JsonStreamWriter json(stream);
+  json.beginObject()
+    .field("estimate", occupancy.window(window).lastEstimate)
+    .field("window_start_ms", windowStart)
+    .field("window_ms", OccupancyCounter::WINDOW_LENGTHS[window])
+    .field("precision", HLL_PRECISION)
+    .endObject();
+
+  mqttClient->publish(topic.c_str(), payload.c_str());
+
+  topic += "/sketch";
+  mqttClient->publish(topic.c_str(), sketch.registers(), HLL_NUM_REGISTERS);
+}
 
-    mqttClient = new MqttClient(settings);
-    mqttClient->begin();
+void writeOccupancy(JsonStreamWriter& json) {
+  json.beginObject()
+    .field("precision", HLL_PRECISION)
+    // One standard error, in basis points: 1.04 / sqrt(registers).
+    .field("standard_error_bp", static_cast<unsigned>(10400.0 / sqrt(HLL_NUM_REGISTERS)));
+
+  for (size_t i = 0; i < OCCUPANCY_NUM_WINDOWS; i++) {
+    const OccupancyWindowState& state = occupancy.window(static_cast<OccupancyWindow>(i));
+
+    json.key(OccupancyCounter::WINDOW_NAMES[i]).beginObject()
+      .field("current", state.sketch.estimate())
+      .field("last", state.lastEstimate)
+      .field("window_start_ms", state.start)
+      .field("window_ms", OccupancyCounter::WINDOW_LENGTHS[i])
+      .endObject();
+  }
+
+  json.endObject();
+}
+
+// GET /log?from=&to=&device=, with from and to in Unix time and device a MAC
+// address. All optional.
+void writeEventLog(JsonStreamWriter& json) {
+  const uint32_t start = micros();
+  const uint32_t from = webServer.hasArg("from") ? strtoul(webServer.arg("from").c_str(), NULL, 10) : 0;
+  const uint32_t to = webServer.hasArg("to") ? strtoul(webServer.arg("to").c_str(), NULL, 10) : UINT32_MAX;
+  uint8_t mac[6];
+  char macBuffer[20];
+
+  if (webServer.hasArg("device")) {
+    Settings::parseMac(webServer.arg("device").c_str(), mac);
   }
 
-  if (*lastSeenTimes) {
-    for (size_t i = 0; i < size(EVENT_NAMES); i++) {
-      delete lastSeenTimes[i];
+  json.beginObject();
+  json.key("records").beginArray();
+
+  const EventLogQueryStats stats = eventLog.query(from, to, webServer.hasArg("device") ? mac : NULL,
+    [&json, &macBuffer](const EventLogRecord& record) {
+      Settings::formatMac(record.mac, macBuffer);
+
+      json.beginObject()
+        .field("time", record.time)
+        .field("synced", (record.flags & EVENT_LOG_FLAG_UPTIME) == 0)
+        .field("mac", macBuffer)
+        .field("event", DASH_EVENT_NAMES[record.type])
+        .field("rssi", static_cast<int>(record.rssi))
+        .endObject();
+
+      return true;
+    }
+  );
+
+  json.endArray()
+    .field("pages_read", stats.pagesRead)
+    .field("pages_skipped", stats.pagesSkipped)
+    .field("elapsed_us", micros() - start)
+    .endObject();
+}
+
+void writeInjection(JsonStreamWriter& json) {
+  const InjectionStats& stats = injector.getStats();
+  const unsigned long elapsed = stats.lastProcessedAt - stats.startedAt;
+
+  json.beginObject()
+    .field("running", injector.running())
+    .field("requested", stats.requested)
+    .field("rate", stats.rate)
+    .field("injected", stats.injected)
+    .field("dropped", stats.dropped)
+    .field("processed", stats.processed)
+    .field("published", stats.published)
+    .field("throughput_per_s", (stats.processed > 0 && elapsed > 0) ? static_cast<uint32_t>(static_cast<uint64_t>(stats.processed) * 1000 / elapsed) : 0)
+    .field("avg_latency_us", stats.processed > 0 ? (stats.totalLatencyMicros / stats.processed) : 0)
+    .field("max_latency_us", stats.maxLatencyMicros)
+    .endObject();
+}
+
+// POST /debug/inject with
+// {"macs":["aa:bb:cc:dd:ee:ff"],"event":"probe_request","rate":10,"count":100}
+// where rate is events per second.
+void handleInject() {
+  if (!webServer.authenticationRequired()) {
+    webServer.send(403, APPLICATION_JSON, "\"Requires admin credentials\"");
+    return;
+  }
+
+  DynamicJsonBuffer buffer;
+  JsonObject& request = buffer.parseObject(webServer.arg("plain"));
+  JsonArray& macList = request["macs"];
+  const char* eventName = request["event"];
+  uint8_t macs[INJECT_MAX_MACS][6];
+  size_t numMacs = 0;
+  bool macsValid = true;
+  int type = -1;
+
+  for (size_t i = 0; eventName && i < DASH_NUM_EVENT_TYPES; i++) {
+    if (strcmp(eventName, DASH_EVENT_NAMES[i]) == 0) {
+      type = i;
     }
   }
 
-  for (size_t i = 0; i < size(EVENT_NAMES); i++) {
-    lastSeenTimes[i] = new unsigned long[settings.numMonitoredMacs];
-    memset(lastSeenTimes[i], 0, sizeof(unsigned long)*settings.numMonitoredMacs);
+  if (macList.success()) {
+    for (JsonArray::iterator it = macList.begin(); it != macList.end() && numMacs < INJECT_MAX_MACS; ++it) {
+      const char* mac = it->as<const char*>();
+      macsValid &= Settings::parseMac(mac ? mac : "", macs[numMacs++]);
+    }
+  }
+
+  if (!request.success() || !macsValid || type == -1
+    || !injector.start(macs[0], numMacs, static_cast<DashEventType>(type), request["rate"].as<uint32_t>(), request["count"].as<uint32_t>())) {
+    webServer.send(400, APPLICATION_JSON, "\"Invalid injection request\"");
+    return;
   }
 
+  webServer.sendJsonStream(writeInjection);
+}
+
+void writeRuntimeStats(JsonStreamWriter& json) {
+  json.key("boot").beginObject()
+    .field("capture_ready_ms", bootMetrics.captureReady)
+    .field("first_capture_ms", bootMetrics.firstCapture)
+    .field("sta_connected_ms", bootMetrics.staConnected)
+    .field("mqtt_connected_ms", bootMetrics.mqttConnected)
+    .field("first_publish_ms", bootMetrics.firstPublish)
+    .endObject();
+  json.field("pending_publishes", pendingPublishes.size());
+  json.field("pending_publishes_dropped", pendingPublishes.dropped());
+
+  json.field("capture_queue_dropped", captureQueue.dropped());
+  json.field("idle_ms", scheduler.sleptMillis());
+
+  json.key("tasks").beginArray();
+  for (size_t i = 0; i < scheduler.numTasks(); i++) {
+    const Task& task = scheduler.getTask(i);
+
+    json.beginObject()
+      .field("name", task.name)
+      .field("runs", task.stats.runs)
+      .field("avg_us", task.stats.runs > 0 ? (task.stats.totalMicros / task.stats.runs) : 0)
+      .field("max_us", task.stats.maxMicros)
+      .field("overruns", task.stats.overruns)
+      .endObject();
+  }
+  json.endArray();
+
+  if (mqttClient) {
+    const MqttConnectionStats& mqtt = mqttClient->getStats();
+    const BufferedClientStats& writes = mqttClient->getWriteStats();
+
+    json.key("mqtt").beginObject()
+      .field("tls", mqtt.tls)
+      .field("reduced_tls_buffers", mqtt.reducedTlsBuffers)
+      .field("connects", mqtt.connects)
+      .field("failures", mqtt.failures)
+      .field("last_connect_ms", mqtt.lastConnectMillis)
+      .field("packets_written", writes.writes)
+      .field("transport_writes", writes.flushes)
+      .field("bytes_written", writes.bytes)
+      .field("write_failures", writes.failures)
+      .endObject();
+  }
+
+  const EventLogStats& log = eventLog.getStats();
+  json.key("event_log").beginObject()
+    .field("capacity", eventLog.capacity())
+    .field("records", log.records)
+    .field("page_writes", log.pageWrites)
+    .field("bytes_written", log.bytesWritten)
+    .field("write_errors", log.writeErrors)
+    .endObject();
+
+  json.key("settings_apply").beginObject()
+    .field("applies", applyMetrics.applies)
+    .field("last_changes", applyMetrics.lastChanges)
+    .field("mqtt_us", applyMetrics.mqttMicros)
+    .field("subscriptions_us", applyMetrics.subscriptionsMicros)
+    .field("cluster_us", applyMetrics.clusterMicros)
+    .field("devices_us", applyMetrics.devicesMicros)
+    .field("ap_us", applyMetrics.apMicros)
+    .field("auth_us", applyMetrics.authMicros)
+    .endObject();
+
+  const ClaimStats& claims = claimTracker.getStats();
+  json.key("cluster").beginObject()
+    .field("claim_window_ms", claimTracker.window())
+    .field("claimed", claims.claimed)
+    .field("won", claims.won)
+    .field("yielded", claims.yielded)
+    .field("remote_claims", claims.remoteClaims)
+    .field("evicted", claims.evicted)
+    .endObject();
+}
+
+// The station interface connects in the background. Until it has, the only
+// thing waiting on it is MQTT; capture runs on the soft AP.
+void checkStationConnection() {
+  if (WiFi.status() == WL_CONNECTED) {
+    if (bootMetrics.staConnected == 0) {
+      bootMetrics.staConnected = millis();
+    }
+    return;
+  }
+
+  // Only on the first connection. After that, the SDK keeps reconnecting
+  // on its own.
+  if (bootMetrics.staConnected != 0 || configPortalRun) {
+    return;
+  }
+
+  // The portal blocks, which would stall every other task for minutes, so
+  // it's only worth it when there's nothing to connect with.
+  if (WiFi.SSID().length() > 0) {
+    if (millis() - lastStationAttempt >= WIFI_STA_CONNECT_TIMEOUT) {
+      lastStationAttempt = millis();
+      WiFi.begin();
+    }
+    return;
+  }
+
+  configPortalRun = true;
+
+  // Blocks, and takes over the soft AP, until configured or timed out.
+  WiFiManager wifiManager;
+  wifiManager.setConfigPortalTimeout(WIFI_CONFIG_PORTAL_TIMEOUT);
+  wifiManager.startConfigPortal();
+
+  WiFi.mode(WIFI_AP_STA);
   settings.setupSoftAP();
 }
 
+void setupTasks() {
+  captureTaskId = scheduler.addTask("capture", TASK_PRIORITY_CAPTURE, 100, CAPTURE_DRAIN_BUDGET_US, drainCaptureQueue);
+  scheduler.addTask("mqtt", TASK_PRIORITY_SINKS, 10, 5000, []() {
+    if (mqttClient) {
+      mqttClient->handleClient();
+
+      if (mqttClient->connected()) {
+        if (bootMetrics.mqttConnected == 0) {
+          bootMetrics.mqttConnected = millis();
+        }
+
+        flushPendingPublishes();
+      }
+    }
+  });
+  scheduler.addTask("cluster", TASK_PRIORITY_SINKS, 10, 1000, []() {
+    claimTracker.loop(millis());
+
+    if (mqttClient) {
+      flushPublishes();
+    }
+  });
+  scheduler.addTask("reload", TASK_PRIORITY_SINKS, 100, 50000, []() {
+    if (settingsReloadPending) {
+      settingsReloadPending = false;
+      applySettings();
+    }
+  });
+  scheduler.addTask("http", TASK_PRIORITY_NETWORK, 5, 20000, []() {
+    webServer.handleClient();
+  });
+  scheduler.addTask("settings_compaction", TASK_PRIORITY_MAINTENANCE, 1000, 100000, []() {
+    if (settings.needsCompaction()) {
+      settings.compact();
+    }
+  });
+  scheduler.addTask("occupancy", TASK_PRIORITY_MAINTENANCE, 1000, 20000, []() {
+    occupancy.loop(millis());
+  });
+  scheduler.addTask("wifi", TASK_PRIORITY_MAINTENANCE, 1000, 1000, checkStationConnection);
+  scheduler.addTask("inject", TASK_PRIORITY_NETWORK, 10, 2000, []() {
+    if (injector.loop(millis())) {
+      scheduler.trigger(captureTaskId);
+    }
+  });
+  scheduler.addTask("event_log", TASK_PRIORITY_MAINTENANCE, 1000, 20000, []() {
+    eventLog.loop(millis());
+  });
+  scheduler.addTask("warm_state", TASK_PRIORITY_MAINTENANCE, WARM_STATE_SAVE_INTERVAL, 1000, saveWarmState);
+}
+
+void updateMqttSubscriptions() {
+  if (settings.clusterClaimWindowMs > 0) {
+    mqttClient->addSubscription(CLUSTER_CLAIM_TOPIC_PREFIX "#");
+  } else {
+    mqttClient->removeSubscription(CLUSTER_CLAIM_TOPIC_PREFIX "#");
+  }
+
+  if (settings.fleetEnabled) {
+    mqttClient->addSubscription(FLEET_CONFIG_TOPIC);
+    mqttClient->addSubscription(FLEET_DELTA_TOPIC);
+  } else {
+    mqttClient->removeSubscription(FLEET_CONFIG_TOPIC);
+    mqttClient->removeSubscription(FLEET_DELTA_TOPIC);
+  }
+}
+
+// Only restarts the subsystems affected by what changed since the last call,
+// so e.g. renaming a device doesn't drop the broker connection or the AP.
+void applySettings() {
+  const uint8_t changes = settings.takeChanges();
+  uint32_t start;
+
+  applyMetrics.applies++;
+  applyMetrics.lastChanges = changes;
+
+  if (changes & SETTINGS_CHANGED_MQTT) {
+    start = micros();
+
+    if (mqttClient) {
+      flushPublishes();
+    }
+
+    delete mqttClient;
+    mqttClient = NULL;
+
+    if (settings.mqttServer().length() > 0) {
+      mqttClient = new MqttClient(settings);
+      mqttClient->addSubscription((nodeTopicPrefix + "cmd/#").c_str());
+      updateMqttSubscriptions();
+      mqttClient->onMessage(handleMqttMessage);
+      mqttClient->begin();
+    }
+
+    applyMetrics.mqttMicros = micros() - start;
+  } else if (mqttClient && (changes & (SETTINGS_CHANGED_CLUSTER | SETTINGS_CHANGED_FLEET))) {
+    start = micros();
+    updateMqttSubscriptions();
+    applyMetrics.subscriptionsMicros = micros() - start;
+  }
+
+  if (changes & SETTINGS_CHANGED_CLUSTER) {
+    start = micros();
+    claimTracker.clear();
+    claimTracker.setWindow(settings.clusterClaimWindowMs);
+    applyMetrics.clusterMicros = micros() - start;
+  }
+
+  if (changes & (SETTINGS_CHANGED_DEVICES | SETTINGS_CHANGED_ALIASES | SETTINGS_CHANGED_TOPICS)) {
+    start = micros();
+    applyDeviceChanges(changes);
+    applyMetrics.devicesMicros = micros() - start;
+  }
+
+  if (changes & SETTINGS_CHANGED_AP) {
+    start = micros();
+    settings.setupSoftAP();
+    applyMetrics.apMicros = micros() - start;
+  }
+
+  if (changes & SETTINGS_CHANGED_AUTH) {
+    start = micros();
+    webServer.applySettings(settings);
+    applyMetrics.authMicros = micros() - start;
+  }
+}
+
 void setup() {
   Serial.begin(115200);
   SPIFFS.begin();
   Settings::load(settings);
+  eventLog.begin();
 
-  WiFiManager wifiManager;
-  wifiManager.autoConnect();
+  // Debounce state and unpublished presses have to be back before the first
+  // event is captured, which needs the device table in place. applySettings()
+  // would reset it again otherwise.
+  applyDeviceChanges(settings.takeChanges(SETTINGS_CHANGED_DEVICES | SETTINGS_CHANGED_ALIASES | SETTINGS_CHANGED_TOPICS));
+  restoreWarmState();
 
+  // Capture comes up first. Events are queued until loop() starts, and
+  // published once there's an MQTT connection.
+  setupTasks();
   WiFi.mode(WIFI_AP_STA);
   settings.setupSoftAP();
-
+  // Already up, applySettings() doesn't need to restart it.
+  settings.takeChanges(SETTINGS_CHANGED_AP);
   probeHandler = WiFi.onSoftAPModeProbeRequestReceived(onProbeRequestPrint);
   connectedHandler = WiFi.onSoftAPModeStationConnected(onStationConnected);
+  bootMetrics.captureReady = millis();
+
+  // Reconnects with the credentials the SDK saved, without waiting for it.
+  WiFi.begin();
+  configTime(0, 0, NTP_SERVER);
 
   if (! MDNS.begin("dash-stadium")) {
     Serial.println(F("Error setting up MDNS responder"));
   }
   MDNS.addService("http", "tcp", 80);
 
+  eventPipeline.onEvent([](const DashEventType type, const uint8_t* mac, const int deviceIx) {
+    webServer.handleWifiEvent(type, mac, deviceIx != -1, processingSynthetic);
+  });
+  eventPipeline.onDeviceEvent(handleDeviceEvent);
+  claimTracker.onWon([](const DashEventType type, const uint8_t* mac) {
+    // Looked up again in case the device table changed during the window.
+    const int deviceIx = settings.findMonitoredMac(mac);
+
+    if (deviceIx != -1) {
+      publishDeviceEvent(type, mac, deviceIx);
+    }
+  });
+
   webServer.onSettingsSaved(applySettings);
+  webServer.onRestart([]() {
+    // Anything that doesn't make it out is queued, and kept with the rest.
+    if (mqttClient) {
+      flushPublishes();
+    }
+    saveWarmState();
+    eventLog.flush();
+  });
+  webServer.onAbout(writeRuntimeStats);
+  webServer.on("/occupancy", HTTP_GET, []() {
+    webServer.sendJsonStream(writeOccupancy);
+  });
+  webServer.on("/debug/inject", HTTP_POST, handleInject);
+  webServer.on("/debug/inject", HTTP_GET, []() {
+    webServer.sendJsonStream(writeInjection);
+  });
+  webServer.on("/log", HTTP_GET, []() {
+    uint8_t mac[6];
+
+    if (webServer.hasArg("device") && !Settings::parseMac(webServer.arg("device").c_str(), mac)) {
+      webServer.send(400, APPLICATION_JSON, "\"Invalid device\"");
+      return;
+    }
+
+    webServer.sendJsonStream(writeEventLog);
+  });
+  occupancy.onWindowClosed(publishOccupancy);
   webServer.begin();
+  setupMqttRoutes();
   applySettings();
 }
 
 void loop(){
-  if (mqttClient) {
-    mqttClient->handleClient();
-  }
-  webServer.handleClient();
+  scheduler.loop();
 }
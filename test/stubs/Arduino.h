@@ -0,0 +1,220 @@
+// Just enough of the ESP8266 Arduino core to build the host-portable libraries
+// natively. Time only moves when a test moves it.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <math.h>
+#include <time.h>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <random>
+#include <string>
+
+#ifndef _ARDUINO_STUB_H
+#define _ARDUINO_STUB_H
+
+#define PROGMEM
+#define PGM_P const char*
+#define PGM_VOID_P const void*
+#define PSTR(s) (s)
+#define F(s) (s)
+
+#define pgm_read_byte(addr) (*reinterpret_cast<const uint8_t*>(addr))
+#define pgm_read_word(addr) (*reinterpret_cast<const uint16_t*>(addr))
+#define pgm_read_dword(addr) (*reinterpret_cast<const uint32_t*>(addr))
+#define memcpy_P memcpy
+#define strncpy_P strncpy
+#define strlen_P strlen
+#define snprintf_P snprintf
+
+namespace ArduinoStub {
+  inline uint64_t& clockMicros() {
+    static uint64_t now = 0;
+    return now;
+  }
+
+  inline time_t& wallClock() {
+    static time_t now = 0;
+    return now;
+  }
+
+  inline void setMillis(const unsigned long ms) {
+    clockMicros() = static_cast<uint64_t>(ms) * 1000;
+  }
+
+  inline void advanceMillis(const unsigned long ms) {
+    clockMicros() += static_cast<uint64_t>(ms) * 1000;
+  }
+
+  inline void advanceMicros(const unsigned long us) {
+    clockMicros() += us;
+  }
+
+  // What time() returns, seconds since boot until a test sets it.
+  inline void setTime(const time_t t) {
+    wallClock() = t;
+  }
+
+  inline time_t time(time_t* t) {
+    if (t) {
+      *t = wallClock();
+    }
+    return wallClock();
+  }
+}
+
+inline unsigned long millis() {
+  return ArduinoStub::clockMicros() / 1000;
+}
+
+inline unsigned long micros() {
+  return static_cast<unsigned long>(static_cast<uint32_t>(ArduinoStub::clockMicros()));
+}
+
+inline void delay(const unsigned long ms) {
+  ArduinoStub::advanceMillis(ms);
+}
+
+inline void yield() { }
+inline void esp_schedule() { }
+
+// <time.h> is already in, so this only affects callers.
+#define time(t) ArduinoStub::time(t)
+
+class String : public std::string {
+public:
+  String() { }
+  String(const char* s) : std::string(s ? s : "") { }
+  String(const std::string& s) : std::string(s) { }
+
+  bool startsWith(const char* prefix) const { return compare(0, strlen(prefix), prefix) == 0; }
+  String substring(const size_t from) const { return substr(std::min(from, size())); }
+  String substring(const size_t from, const size_t to) const { return substr(std::min(from, size()), to - std::min(from, to)); }
+  long toInt() const { return atol(c_str()); }
+
+  int indexOf(const char c) const {
+    const size_t ix = find(c);
+    return ix == npos ? -1 : static_cast<int>(ix);
+  }
+
+  void replace(const char* from, const char* to) {
+    const size_t fromLength = strlen(from);
+    const size_t toLength = strlen(to);
+
+    for (size_t ix = find(from); fromLength > 0 && ix != npos; ix = find(from, ix + toLength)) {
+      std::string::replace(ix, fromLength, to);
+    }
+  }
+};
+
+// What String + String gives in the core. Libraries that accept Strings
+// (ArduinoJson) name it.
+class StringSumHelper : public String {
+public:
+  StringSumHelper(const String& s) : String(s) { }
+};
+
+class Print {
+public:
+  virtual ~Print() { }
+
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t* buffer, size_t size) {
+    size_t n = 0;
+    while (n < size && write(buffer[n])) {
+      n++;
+    }
+    return n;
+  }
+
+  size_t write(const char* s) { return write(reinterpret_cast<const uint8_t*>(s), strlen(s)); }
+  size_t print(const char* s) { return write(s); }
+  size_t print(char c) { return write(static_cast<uint8_t>(c)); }
+  size_t print(const String& s) { return write(reinterpret_cast<const uint8_t*>(s.c_str()), s.length()); }
+  size_t print(int n) { return print(static_cast<long>(n)); }
+  size_t print(unsigned int n) { return print(static_cast<unsigned long>(n)); }
+  size_t print(long n) { char b[24]; snprintf(b, sizeof(b), "%ld", n); return write(b); }
+  size_t print(unsigned long n) { char b[24]; snprintf(b, sizeof(b), "%lu", n); return write(b); }
+};
+
+class Stream : public Print {
+public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+  virtual void flush() { }
+
+  size_t readBytes(char* buffer, const size_t length) {
+    size_t n = 0;
+    int c;
+
+    while (n < length && (c = read()) >= 0) {
+      buffer[n++] = c;
+    }
+
+    return n;
+  }
+
+  String readStringUntil(const char terminator) {
+    String s;
+    int c;
+
+    while ((c = read()) >= 0 && c != terminator) {
+      s += static_cast<char>(c);
+    }
+
+    return s;
+  }
+};
+
+namespace ArduinoStub {
+  // Bytes the test has allocated, if it counts them (see CountingHeap.h).
+  inline size_t& heapUsed() {
+    static size_t used = 0;
+    return used;
+  }
+}
+
+#ifndef ESP_STUB_HEAP_SIZE
+#define ESP_STUB_HEAP_SIZE 40000
+#endif
+
+// Free heap is what's left of ESP_STUB_HEAP_SIZE after what's been counted.
+// There's no fragmentation, so the largest free block is all of it.
+class EspClass {
+public:
+  uint32_t getFreeHeap() { return ESP_STUB_HEAP_SIZE - std::min(ArduinoStub::heapUsed(), static_cast<size_t>(ESP_STUB_HEAP_SIZE)); }
+  uint32_t getMaxFreeBlockSize() { return getFreeHeap(); }
+};
+
+namespace ArduinoStub {
+  inline EspClass& esp() {
+    static EspClass esp;
+    return esp;
+  }
+}
+
+#define ESP (ArduinoStub::esp())
+
+class HardwareSerial {
+public:
+  void print(const char* s) { fputs(s, stderr); }
+  void println(const char* s) { fprintf(stderr, "%s\n", s); }
+  void println() { fputc('\n', stderr); }
+};
+
+namespace ArduinoStub {
+  inline HardwareSerial& serial() {
+    static HardwareSerial serial;
+    return serial;
+  }
+}
+
+#define Serial (ArduinoStub::serial())
+
+#endif
@@ -0,0 +1,34 @@
+#include <Arduino.h>
+
+#ifndef _CLIENT_STUB_H
+#define _CLIENT_STUB_H
+
+class IPAddress {
+public:
+  IPAddress() : value(0) { }
+  IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : value((a << 24) | (b << 16) | (c << 8) | d) { }
+
+private:
+  uint32_t value;
+};
+
+// Signatures as of ESP8266 core 3.x.
+class Client {
+public:
+  virtual ~Client() { }
+
+  virtual int connect(IPAddress ip, uint16_t port) = 0;
+  virtual int connect(const char* host, uint16_t port) = 0;
+  virtual size_t write(uint8_t b) = 0;
+  virtual size_t write(const uint8_t* buf, size_t size) = 0;
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int read(uint8_t* buf, size_t size) = 0;
+  virtual int peek() = 0;
+  virtual bool flush(unsigned int maxWaitMs = 0) = 0;
+  virtual bool stop(unsigned int maxWaitMs = 0) = 0;
+  virtual uint8_t connected() = 0;
+  virtual operator bool() = 0;
+};
+
+#endif
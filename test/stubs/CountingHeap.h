@@ -0,0 +1,68 @@
+#include <Arduino.h>
+#include <new>
+
+#ifndef _COUNTING_HEAP_H
+#define _COUNTING_HEAP_H
+
+// Replaces the global operator new and delete so what a test allocates is
+// counted in ArduinoStub::heapUsed(), which ESP.getFreeHeap() is taken from.
+// Defines the operators, so include it from a test's main file only.
+//
+// Only new and delete are seen. Libraries that call malloc directly (the
+// ArduinoJson buffers) aren't counted.
+
+namespace ArduinoStub {
+  inline size_t& heapPeak() {
+    static size_t peak = 0;
+    return peak;
+  }
+
+  // Starts measuring the peak from what's in use now.
+  inline void resetHeapPeak() {
+    heapPeak() = heapUsed();
+  }
+
+  // The size goes in front of the block so it can be given back. Kept at 16
+  // bytes so the pointer handed out keeps malloc's alignment.
+  inline void* countedAlloc(const size_t size) {
+    uint8_t* block = static_cast<uint8_t*>(malloc(size + 16));
+
+    if (block == NULL) {
+      throw std::bad_alloc();
+    }
+
+    *reinterpret_cast<size_t*>(block) = size;
+    heapUsed() += size;
+    heapPeak() = std::max(heapPeak(), heapUsed());
+
+    return block + 16;
+  }
+
+  inline void countedFree(void* ptr) {
+    if (ptr == NULL) {
+      return;
+    }
+
+    uint8_t* block = static_cast<uint8_t*>(ptr) - 16;
+    heapUsed() -= *reinterpret_cast<size_t*>(block);
+    free(block);
+  }
+}
+
+void* operator new(size_t size) {
+  return ArduinoStub::countedAlloc(size);
+}
+
+void* operator new[](size_t size) {
+  return ArduinoStub::countedAlloc(size);
+}
+
+void operator delete(void* ptr) noexcept {
+  ArduinoStub::countedFree(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+  ArduinoStub::countedFree(ptr);
+}
+
+#endif
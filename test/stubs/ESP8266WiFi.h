@@ -0,0 +1,28 @@
+#include <Arduino.h>
+
+#ifndef _ESP8266_WIFI_STUB_H
+#define _ESP8266_WIFI_STUB_H
+
+// Only records what the access point was last set up with.
+class ESP8266WiFiClass {
+public:
+  bool softAP(const char* ssid, const char* passphrase = NULL) {
+    apName = ssid;
+    apPassword = passphrase ? passphrase : "";
+    return true;
+  }
+
+  String apName;
+  String apPassword;
+};
+
+namespace ArduinoStub {
+  inline ESP8266WiFiClass& wifi() {
+    static ESP8266WiFiClass wifi;
+    return wifi;
+  }
+}
+
+#define WiFi (ArduinoStub::wifi())
+
+#endif
@@ -0,0 +1,178 @@
+#include <Arduino.h>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#ifndef _FS_STUB_H
+#define _FS_STUB_H
+
+// SPIFFS stores file contents in the part of each 256 byte page after its 5
+// byte header.
+#define FS_STUB_PAGE_DATA_SIZE (256 - 5)
+
+enum SeekMode {
+  SeekSet = 0,
+  SeekCur = 1,
+  SeekEnd = 2
+};
+
+struct FSStats {
+  uint32_t writes;
+  uint32_t bytesWritten;
+  // Data pages touched by writes, counted once per write. Each is a page
+  // program on the device.
+  uint32_t pagesTouched;
+};
+
+class File : public Stream {
+public:
+  File() : pos(0), stats(NULL) { }
+  File(std::shared_ptr<std::vector<uint8_t> > data, FSStats* stats) : data(data), pos(0), stats(stats) { }
+
+  explicit operator bool() const { return static_cast<bool>(data); }
+
+  size_t size() const {
+    return data->size();
+  }
+
+  bool seek(const size_t offset, const SeekMode mode) {
+    const size_t base = mode == SeekSet ? 0 : (mode == SeekCur ? pos : data->size());
+
+    if (base + offset > data->size()) {
+      return false;
+    }
+
+    pos = base + offset;
+    return true;
+  }
+
+  size_t read(uint8_t* buffer, size_t length) {
+    length = std::min(length, data->size() - pos);
+    memcpy(buffer, data->data() + pos, length);
+    pos += length;
+    return length;
+  }
+
+  virtual int available() {
+    return data->size() - pos;
+  }
+
+  virtual int read() {
+    return pos < data->size() ? (*data)[pos++] : -1;
+  }
+
+  virtual int peek() {
+    return pos < data->size() ? (*data)[pos] : -1;
+  }
+
+  using Print::write;
+
+  virtual size_t write(uint8_t c) {
+    return write(&c, 1);
+  }
+
+  virtual size_t write(const uint8_t* buffer, size_t length) {
+    if (length == 0) {
+      return 0;
+    }
+
+    if (pos + length > data->size()) {
+      data->resize(pos + length);
+    }
+
+    memcpy(data->data() + pos, buffer, length);
+
+    stats->writes++;
+    stats->bytesWritten += length;
+    stats->pagesTouched += ((pos + length - 1) / FS_STUB_PAGE_DATA_SIZE) - (pos / FS_STUB_PAGE_DATA_SIZE) + 1;
+
+    pos += length;
+    return length;
+  }
+
+  void close() {
+    data.reset();
+  }
+
+private:
+  std::shared_ptr<std::vector<uint8_t> > data;
+  size_t pos;
+  FSStats* stats;
+};
+
+// In-memory filesystem. Files are shared between handles, as on SPIFFS.
+class FS {
+public:
+  FS() {
+    clear();
+  }
+
+  bool begin() {
+    return true;
+  }
+
+  bool exists(const char* path) {
+    return files.count(path) > 0;
+  }
+
+  File open(const char* path, const char* mode) {
+    if (mode[0] == 'w') {
+      files[path] = std::make_shared<std::vector<uint8_t> >();
+    } else if (mode[0] == 'a' && !exists(path)) {
+      files[path] = std::make_shared<std::vector<uint8_t> >();
+    }
+
+    if (!exists(path)) {
+      return File();
+    }
+
+    File f(files[path], &_stats);
+
+    if (mode[0] == 'a') {
+      f.seek(0, SeekEnd);
+    }
+
+    return f;
+  }
+
+  bool remove(const char* path) {
+    return files.erase(path) > 0;
+  }
+
+  bool rename(const char* from, const char* to) {
+    if (!exists(from)) {
+      return false;
+    }
+
+    files[to] = files[from];
+    files.erase(from);
+    return true;
+  }
+
+  void clear() {
+    files.clear();
+    resetStats();
+  }
+
+  void resetStats() {
+    memset(&_stats, 0, sizeof(_stats));
+  }
+
+  const FSStats& stats() const {
+    return _stats;
+  }
+
+private:
+  std::map<std::string, std::shared_ptr<std::vector<uint8_t> > > files;
+  FSStats _stats;
+};
+
+inline FS& spiffsStub() {
+  static FS fs;
+  return fs;
+}
+
+#define SPIFFS (spiffsStub())
+
+#endif
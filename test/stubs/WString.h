@@ -0,0 +1,3 @@
+// Everything is declared in the Arduino.h stub, as the core's Arduino.h pulls
+// this in.
+#include <Arduino.h>
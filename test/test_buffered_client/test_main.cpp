@@ -0,0 +1,211 @@
+#include <unity.h>
+#include <BufferedClient.h>
+#include <BufferedClient.cpp>
+#include <vector>
+
+// Transport that records each write, and can be made to fail them.
+class FakeClient : public Client {
+public:
+  FakeClient() : isConnected(false), failWrites(false) { }
+
+  virtual int connect(IPAddress ip, uint16_t port) override { isConnected = true; return 1; }
+  virtual int connect(const char* host, uint16_t port) override { isConnected = true; return 1; }
+  virtual size_t write(uint8_t b) override { return write(&b, 1); }
+
+  virtual size_t write(const uint8_t* buf, size_t size) override {
+    if (failWrites) {
+      return 0;
+    }
+    writes.push_back(std::string(reinterpret_cast<const char*>(buf), size));
+    return size;
+  }
+
+  virtual int available() override { return 0; }
+  virtual int read() override { return -1; }
+  virtual int read(uint8_t* buf, size_t size) override { return 0; }
+  virtual int peek() override { return -1; }
+  virtual bool flush(unsigned int maxWaitMs = 0) override { return true; }
+  virtual bool stop(unsigned int maxWaitMs = 0) override { isConnected = false; return true; }
+  virtual uint8_t connected() override { return isConnected; }
+  virtual operator bool() override { return isConnected; }
+
+  std::string received() const {
+    std::string all;
+    for (size_t i = 0; i < writes.size(); i++) {
+      all += writes[i];
+    }
+    return all;
+  }
+
+  bool isConnected;
+  bool failWrites;
+  std::vector<std::string> writes;
+};
+
+static std::string encodePublish(const std::string& topic, const char* payload) {
+  const size_t remaining = 2 + topic.size() + strlen(payload);
+
+  std::string packet;
+  packet += static_cast<char>(0x30);
+  packet += static_cast<char>(remaining);
+  packet += static_cast<char>(topic.size() >> 8);
+  packet += static_cast<char>(topic.size() & 0xFF);
+  packet += topic;
+  packet += payload;
+  return packet;
+}
+
+// PubSubClient writes each packet in one call. This is a QoS 0 PUBLISH as the
+// node sends them.
+static std::string publishPacket(const size_t n) {
+  char payload[96];
+  snprintf(payload, sizeof(payload), "{\"event\":\"probe_request\",\"alias\":\"kitchen\",\"rssi\":-54,\"seq\":%u}", static_cast<unsigned>(n));
+  return encodePublish("dash_stadium/44:65:0D:01:02:03/probe_request", payload);
+}
+
+// 40 bytes, for a short topic pattern and the default payload.
+static std::string smallPacket(const size_t n) {
+  char payload[24];
+  snprintf(payload, sizeof(payload), "probe_request:%02u", static_cast<unsigned>(n % 100));
+  return encodePublish("dash_stadium/kitchen", payload);
+}
+
+static std::string publish(BufferedClient& client, const size_t n, std::string (*makePacket)(const size_t) = publishPacket) {
+  std::string sent;
+
+  for (size_t i = 0; i < n; i++) {
+    const std::string packet = makePacket(i);
+    TEST_ASSERT_EQUAL(packet.size(), client.write(reinterpret_cast<const uint8_t*>(packet.data()), packet.size()));
+    sent += packet;
+  }
+
+  return sent;
+}
+
+void setUp() {
+  ArduinoStub::setMillis(1000);
+}
+
+void tearDown() { }
+
+void test_burst_coalesced() {
+  FakeClient transport;
+  BufferedClient client(transport);
+  client.connect("broker", 1883);
+
+  const std::string sent = publish(client, 10);
+  TEST_ASSERT_EQUAL(0, transport.writes.size());
+
+  TEST_ASSERT_TRUE(client.flushBuffer());
+  TEST_ASSERT_EQUAL(1, transport.writes.size());
+  TEST_ASSERT_TRUE(sent == transport.received());
+}
+
+void test_large_burst_fills_segments() {
+  FakeClient transport;
+  BufferedClient client(transport);
+  client.connect("broker", 1883);
+
+  const std::string sent = publish(client, 100);
+  client.flushBuffer();
+
+  const size_t packetSize = publishPacket(0).size();
+  const size_t perSegment = MQTT_WRITE_BUFFER_SIZE / packetSize;
+  const size_t expected = (100 + perSegment - 1) / perSegment;
+
+  TEST_ASSERT_EQUAL(expected, transport.writes.size());
+  TEST_ASSERT_EQUAL(100, client.getStats().writes);
+  TEST_ASSERT_EQUAL(expected, client.getStats().flushes);
+  TEST_ASSERT_TRUE(sent == transport.received());
+
+  for (size_t i = 0; i < transport.writes.size(); i++) {
+    TEST_ASSERT_LESS_OR_EQUAL(MQTT_WRITE_BUFFER_SIZE, transport.writes[i].size());
+  }
+
+  char message[96];
+  snprintf(message, sizeof(message), "100 publishes of %u bytes: %u transport writes",
+    static_cast<unsigned>(packetSize), static_cast<unsigned>(transport.writes.size()));
+  TEST_MESSAGE(message);
+}
+
+void test_small_packets_fill_segments() {
+  FakeClient transport;
+  BufferedClient client(transport);
+  client.connect("broker", 1883);
+
+  TEST_ASSERT_EQUAL(40, smallPacket(0).size());
+
+  const std::string sent = publish(client, 100, smallPacket);
+  client.flushBuffer();
+
+  TEST_ASSERT_EQUAL(3, transport.writes.size());
+  TEST_ASSERT_TRUE(sent == transport.received());
+}
+
+void test_lone_write_sent_after_max_delay() {
+  FakeClient transport;
+  BufferedClient client(transport);
+  client.connect("broker", 1883);
+
+  publish(client, 1);
+
+  ArduinoStub::advanceMillis(MQTT_WRITE_MAX_DELAY - 1);
+  client.loop();
+  TEST_ASSERT_EQUAL(0, transport.writes.size());
+
+  ArduinoStub::advanceMillis(1);
+  client.loop();
+  TEST_ASSERT_EQUAL(1, transport.writes.size());
+}
+
+// Reading means waiting on the broker, which can't answer what it hasn't
+// been sent.
+void test_read_sends_buffer_first() {
+  FakeClient transport;
+  BufferedClient client(transport);
+  client.connect("broker", 1883);
+
+  publish(client, 2);
+  client.available();
+  TEST_ASSERT_EQUAL(1, transport.writes.size());
+}
+
+void test_failed_write_breaks_connection_until_reconnect() {
+  FakeClient transport;
+  BufferedClient client(transport);
+  client.connect("broker", 1883);
+
+  publish(client, 3);
+  transport.failWrites = true;
+
+  TEST_ASSERT_FALSE(client.flushBuffer());
+  TEST_ASSERT_FALSE(client.connected());
+  TEST_ASSERT_EQUAL(1, client.getStats().failures);
+
+  // Nothing more is accepted, so the caller knows to keep its events.
+  const std::string packet = publishPacket(0);
+  TEST_ASSERT_EQUAL(0, client.write(reinterpret_cast<const uint8_t*>(packet.data()), packet.size()));
+  TEST_ASSERT_FALSE(client.flushBuffer());
+
+  // Even once the transport works again.
+  transport.failWrites = false;
+  TEST_ASSERT_FALSE(client.flushBuffer());
+  TEST_ASSERT_EQUAL(0, transport.writes.size());
+
+  client.connect("broker", 1883);
+  TEST_ASSERT_TRUE(client.connected());
+  const std::string sent = publish(client, 1);
+  TEST_ASSERT_TRUE(client.flushBuffer());
+  TEST_ASSERT_TRUE(sent == transport.received());
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_burst_coalesced);
+  RUN_TEST(test_large_burst_fills_segments);
+  RUN_TEST(test_small_packets_fill_segments);
+  RUN_TEST(test_lone_write_sent_after_max_delay);
+  RUN_TEST(test_read_sends_buffer_first);
+  RUN_TEST(test_failed_write_breaks_connection_until_reconnect);
+  return UNITY_END();
+}
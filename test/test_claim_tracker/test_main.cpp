@@ -0,0 +1,258 @@
+#include <unity.h>
+#include <ClaimTracker.h>
+#include <ClaimTracker.cpp>
+#include <deque>
+#include <random>
+#include <vector>
+
+// Defined with the event pipeline, which isn't part of the native build.
+const char* DASH_EVENT_NAMES[DASH_NUM_EVENT_TYPES] = {"probe_request", "connected"};
+
+#define WINDOW_MS 200
+
+// Several nodes sharing a broker. Claims go out through formatClaim and come
+// back through parseClaim, to every node including the sender, after a fixed
+// delivery delay.
+class Cluster {
+public:
+  struct Message {
+    unsigned long deliverAt;
+    std::string topic;
+    std::string payload;
+  };
+
+  struct Win {
+    size_t node;
+    DashEventType type;
+    uint8_t mac[6];
+  };
+
+  Cluster(const size_t numNodes, const unsigned long latencyMs)
+    : latencyMs(latencyMs),
+      now(0)
+  {
+    for (size_t i = 0; i < numNodes; i++) {
+      ClaimTracker* tracker = new ClaimTracker(0x1000 + i);
+      tracker->setWindow(WINDOW_MS);
+      tracker->onWon([this, i](const DashEventType type, const uint8_t* mac) {
+        Win win;
+        win.node = i;
+        win.type = type;
+        memcpy(win.mac, mac, 6);
+        wins.push_back(win);
+      });
+      nodes.push_back(tracker);
+    }
+  }
+
+  ~Cluster() {
+    for (size_t i = 0; i < nodes.size(); i++) {
+      delete nodes[i];
+    }
+  }
+
+  void hear(const size_t node, const DashEventType type, const uint8_t* mac, const int8_t rssi) {
+    if (nodes[node]->claimLocal(type, mac, rssi, now)) {
+      char topic[CLUSTER_CLAIM_TOPIC_LENGTH];
+      char payload[CLUSTER_CLAIM_PAYLOAD_LENGTH];
+      nodes[node]->formatClaim(type, mac, rssi, topic, payload);
+
+      Message message;
+      message.deliverAt = now + latencyMs;
+      message.topic = topic;
+      message.payload = payload;
+      inFlight.push_back(message);
+    }
+  }
+
+  void run(const unsigned long ms) {
+    for (const unsigned long until = now + ms; now < until; now++) {
+      while (!inFlight.empty() && inFlight.front().deliverAt <= now) {
+        deliver(inFlight.front());
+        inFlight.pop_front();
+      }
+
+      for (size_t i = 0; i < nodes.size(); i++) {
+        nodes[i]->loop(now);
+      }
+    }
+  }
+
+  void deliver(const Message& message) {
+    DashEventType type;
+    uint8_t mac[6];
+    uint32_t nodeId;
+    int8_t rssi;
+
+    TEST_ASSERT_TRUE(ClaimTracker::parseClaim(message.topic.c_str(), reinterpret_cast<const uint8_t*>(message.payload.data()), message.payload.size(), type, mac, nodeId, rssi));
+
+    for (size_t i = 0; i < nodes.size(); i++) {
+      nodes[i]->recordRemote(type, mac, nodeId, rssi, now);
+    }
+  }
+
+  const unsigned long latencyMs;
+  unsigned long now;
+  std::vector<ClaimTracker*> nodes;
+  std::deque<Message> inFlight;
+  std::vector<Win> wins;
+};
+
+static const uint8_t MAC[6] = {0x44, 0x65, 0x0D, 0x01, 0x02, 0x03};
+
+void setUp() { }
+void tearDown() { }
+
+void test_claim_round_trip() {
+  ClaimTracker tracker(0xBEEF);
+  char topic[CLUSTER_CLAIM_TOPIC_LENGTH];
+  char payload[CLUSTER_CLAIM_PAYLOAD_LENGTH];
+
+  tracker.formatClaim(DASH_EVENT_CONNECTED, MAC, -67, topic, payload);
+  TEST_ASSERT_EQUAL_STRING(CLUSTER_CLAIM_TOPIC_PREFIX "44:65:0D:01:02:03/connected", topic);
+
+  DashEventType type;
+  uint8_t mac[6];
+  uint32_t nodeId;
+  int8_t rssi;
+
+  TEST_ASSERT_TRUE(ClaimTracker::parseClaim(topic, reinterpret_cast<const uint8_t*>(payload), strlen(payload), type, mac, nodeId, rssi));
+  TEST_ASSERT_EQUAL(DASH_EVENT_CONNECTED, type);
+  TEST_ASSERT_EQUAL_MEMORY(MAC, mac, 6);
+  TEST_ASSERT_EQUAL(0xBEEF, nodeId);
+  TEST_ASSERT_EQUAL(-67, rssi);
+
+  TEST_ASSERT_FALSE(ClaimTracker::parseClaim(CLUSTER_CLAIM_TOPIC_PREFIX "44:65:0D:01:02:03/pressed", reinterpret_cast<const uint8_t*>(payload), strlen(payload), type, mac, nodeId, rssi));
+  TEST_ASSERT_FALSE(ClaimTracker::parseClaim("other/44:65:0D:01:02:03/connected", reinterpret_cast<const uint8_t*>(payload), strlen(payload), type, mac, nodeId, rssi));
+}
+
+void test_strongest_node_wins() {
+  Cluster cluster(4, 20);
+  const int8_t rssi[4] = {-70, -55, -80, -62};
+
+  // Every node hears the press within a few ms of the others.
+  for (size_t i = 0; i < 4; i++) {
+    cluster.hear(i, DASH_EVENT_PROBE_REQUEST, MAC, rssi[i]);
+    cluster.run(3);
+  }
+  cluster.run(WINDOW_MS * 2);
+
+  TEST_ASSERT_EQUAL(1, cluster.wins.size());
+  TEST_ASSERT_EQUAL(1, cluster.wins[0].node);
+  TEST_ASSERT_EQUAL_MEMORY(MAC, cluster.wins[0].mac, 6);
+}
+
+void test_tie_goes_to_lowest_node_id() {
+  Cluster cluster(3, 20);
+
+  cluster.hear(2, DASH_EVENT_PROBE_REQUEST, MAC, -60);
+  cluster.hear(1, DASH_EVENT_PROBE_REQUEST, MAC, -60);
+  cluster.hear(0, DASH_EVENT_PROBE_REQUEST, MAC, -60);
+  cluster.run(WINDOW_MS * 2);
+
+  TEST_ASSERT_EQUAL(1, cluster.wins.size());
+  TEST_ASSERT_EQUAL(0, cluster.wins[0].node);
+}
+
+void test_late_weaker_node_stays_quiet() {
+  Cluster cluster(2, 20);
+
+  cluster.hear(0, DASH_EVENT_PROBE_REQUEST, MAC, -50);
+  cluster.run(50);
+  // Node 1 hears the same press after the claim reached it.
+  cluster.hear(1, DASH_EVENT_PROBE_REQUEST, MAC, -75);
+  cluster.run(WINDOW_MS * 2);
+
+  TEST_ASSERT_EQUAL(1, cluster.wins.size());
+  TEST_ASSERT_EQUAL(0, cluster.wins[0].node);
+  TEST_ASSERT_EQUAL(1, cluster.nodes[1]->getStats().yielded);
+}
+
+void test_separate_presses_each_publish() {
+  Cluster cluster(3, 20);
+
+  for (size_t press = 0; press < 5; press++) {
+    for (size_t i = 0; i < 3; i++) {
+      cluster.hear(i, DASH_EVENT_PROBE_REQUEST, MAC, -60 - ((i + press) % 3));
+    }
+    // Presses further apart than the window are different presses.
+    cluster.run(WINDOW_MS * 3);
+  }
+
+  TEST_ASSERT_EQUAL(5, cluster.wins.size());
+}
+
+// Randomized presses from many devices with random RSSI and arrival jitter.
+// Each press has to be published exactly once, by its strongest node.
+void test_random_presses_publish_once() {
+  const size_t numPresses = 500;
+  std::mt19937 rng(3);
+  Cluster cluster(5, 30);
+  size_t wrongWinner = 0;
+
+  for (size_t press = 0; press < numPresses; press++) {
+    uint8_t mac[6] = {0x02, 0, 0, 0, 0, static_cast<uint8_t>(press % 6)};
+    int8_t rssi[5];
+    size_t strongest = 0;
+
+    for (size_t i = 0; i < 5; i++) {
+      rssi[i] = -40 - static_cast<int8_t>(rng() % 50);
+      if (rssi[i] > rssi[strongest]) {
+        strongest = i;
+      }
+    }
+
+    const size_t winsBefore = cluster.wins.size();
+    for (size_t i = 0; i < 5; i++) {
+      cluster.hear(i, DASH_EVENT_PROBE_REQUEST, mac, rssi[i]);
+      cluster.run(rng() % 10);
+    }
+    cluster.run(WINDOW_MS * 3);
+
+    TEST_ASSERT_EQUAL(winsBefore + 1, cluster.wins.size());
+    wrongWinner += cluster.wins.back().node != strongest;
+  }
+
+  // Claims are only 30 ms in flight, well inside the window, so the
+  // strongest node should always be the one that publishes.
+  TEST_ASSERT_EQUAL(0, wrongWinner);
+}
+
+void test_full_table_publishes_evicted_claim() {
+  ClaimTracker tracker(1);
+  size_t won = 0;
+
+  tracker.setWindow(WINDOW_MS);
+  tracker.onWon([&won](const DashEventType type, const uint8_t* mac) {
+    won++;
+  });
+
+  uint8_t mac[6] = {0x02, 0, 0, 0, 0, 0};
+  for (size_t i = 0; i < CLUSTER_MAX_CLAIMS; i++) {
+    mac[5] = i;
+    TEST_ASSERT_TRUE(tracker.claimLocal(DASH_EVENT_PROBE_REQUEST, mac, -60, i));
+  }
+  TEST_ASSERT_EQUAL(0, won);
+
+  // One more press than there's room for. The oldest pending claim is
+  // published early rather than dropped.
+  mac[5] = CLUSTER_MAX_CLAIMS;
+  TEST_ASSERT_TRUE(tracker.claimLocal(DASH_EVENT_PROBE_REQUEST, mac, -60, CLUSTER_MAX_CLAIMS));
+  TEST_ASSERT_EQUAL(1, won);
+  TEST_ASSERT_EQUAL(1, tracker.getStats().evicted);
+
+  tracker.loop(WINDOW_MS * 2);
+  TEST_ASSERT_EQUAL(CLUSTER_MAX_CLAIMS + 1, won);
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_claim_round_trip);
+  RUN_TEST(test_strongest_node_wins);
+  RUN_TEST(test_tie_goes_to_lowest_node_id);
+  RUN_TEST(test_late_weaker_node_stays_quiet);
+  RUN_TEST(test_separate_presses_each_publish);
+  RUN_TEST(test_random_presses_publish_once);
+  RUN_TEST(test_full_table_publishes_evicted_claim);
+  return UNITY_END();
+}
@@ -0,0 +1,97 @@
+#include <unity.h>
+#include <ArduinoJson.h>
+#include <Settings.h>
+#include <Settings.cpp>
+#include <SettingsArena.cpp>
+#include <JsonStreamWriter.cpp>
+#include <DeviceRenderCache.h>
+#include <DeviceRenderCache.cpp>
+#include <string>
+
+const char* DASH_EVENT_NAMES[DASH_NUM_EVENT_TYPES] = {"probe_request", "connected"};
+
+void setUp() { }
+void tearDown() { }
+
+static void configure(Settings& settings, const std::string& topicPattern, const size_t numDevices) {
+  std::string json = "{\"mqtt_topic_pattern\":\"" + topicPattern + "\",\"monitored_macs\":[";
+  char entry[64];
+
+  for (size_t i = 0; i < numDevices; i++) {
+    snprintf(entry, sizeof(entry), "%s[\"44:65:0D:00:00:%02X\",\"button %u\"]", i > 0 ? "," : "", static_cast<unsigned>(i), static_cast<unsigned>(i));
+    json += entry;
+  }
+  json += "]}";
+
+  DynamicJsonBuffer buffer;
+  JsonObject& parsed = buffer.parseObject(json.c_str());
+  TEST_ASSERT_TRUE(parsed.success());
+  settings.patch(parsed);
+}
+
+// Every string comes out the same as rendering it on the spot.
+static void assertRendered(const DeviceRenderCache& cache, Settings& settings) {
+  char mac[25];
+
+  TEST_ASSERT_EQUAL(settings.numMonitoredMacs(), cache.size());
+
+  for (size_t i = 0; i < cache.size(); i++) {
+    Settings::formatMac(settings.monitoredMac(i), mac);
+    TEST_ASSERT_EQUAL_STRING(mac, cache.mac(i));
+    TEST_ASSERT_EQUAL_STRING(settings.deviceAlias(i), cache.alias(i));
+
+    for (size_t j = 0; j < DASH_NUM_EVENT_TYPES; j++) {
+      const String expected = DeviceRenderCache::renderTopic(settings.mqttTopicPattern(), DASH_EVENT_NAMES[j], mac, settings.deviceAlias(i));
+      TEST_ASSERT_EQUAL_STRING(expected.c_str(), cache.topic(i, static_cast<DashEventType>(j)));
+    }
+  }
+}
+
+void test_renders_topics() {
+  Settings settings;
+  DeviceRenderCache cache;
+
+  configure(settings, "dash/:device_alias/:event_type", 3);
+  cache.rebuild(settings);
+
+  TEST_ASSERT_EQUAL_STRING("dash/button 1/connected", cache.topic(1, DASH_EVENT_CONNECTED));
+  TEST_ASSERT_EQUAL_STRING("44:65:0D:00:00:02", cache.mac(2));
+  assertRendered(cache, settings);
+}
+
+void test_no_topic_pattern() {
+  Settings settings;
+  DeviceRenderCache cache;
+
+  configure(settings, "", 2);
+  cache.rebuild(settings);
+
+  TEST_ASSERT_NULL(cache.topic(0, DASH_EVENT_PROBE_REQUEST));
+  TEST_ASSERT_EQUAL_STRING("button 1", cache.alias(1));
+}
+
+// Past 64k of strings the 16 bit offsets would wrap, so they're rendered on
+// demand instead.
+void test_too_big_for_offsets() {
+  Settings settings;
+  DeviceRenderCache cache;
+  const std::string pattern = "dash/" + std::string(1100, 'x') + "/:mac_addr/:event_type";
+
+  configure(settings, pattern, 32);
+  cache.rebuild(settings);
+  assertRendered(cache, settings);
+
+  // And back to pre-rendering once they fit again.
+  configure(settings, "dash/:mac_addr/:event_type", 32);
+  cache.rebuild(settings);
+  assertRendered(cache, settings);
+  TEST_ASSERT_EQUAL_STRING("dash/44:65:0D:00:00:1F/probe_request", cache.topic(31, DASH_EVENT_PROBE_REQUEST));
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_renders_topics);
+  RUN_TEST(test_no_topic_pattern);
+  RUN_TEST(test_too_big_for_offsets);
+  return UNITY_END();
+}
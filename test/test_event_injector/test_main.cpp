@@ -0,0 +1,144 @@
+#include <unity.h>
+#include <EventInjector.h>
+#include <EventInjector.cpp>
+#include <CaptureQueue.cpp>
+
+static const uint8_t MACS[3][6] = {
+  {0x02, 0, 0, 0, 0, 1},
+  {0x02, 0, 0, 0, 0, 2},
+  {0x02, 0, 0, 0, 0, 3}
+};
+
+void setUp() {
+  ArduinoStub::setMillis(0);
+}
+
+void tearDown() { }
+
+// What main's capture task does with each synthetic event.
+static size_t drain(CaptureQueue& queue, EventInjector& injector, const unsigned long microsEach) {
+  CapturedEvent event;
+  size_t n = 0;
+
+  while (queue.pop(event)) {
+    ArduinoStub::advanceMicros(microsEach);
+    if (event.flags & CAPTURE_FLAG_SYNTHETIC) {
+      injector.processed();
+      injector.published();
+    }
+    n++;
+  }
+
+  return n;
+}
+
+void test_rejects_bad_runs() {
+  CaptureQueue queue;
+  EventInjector injector(queue);
+
+  TEST_ASSERT_FALSE(injector.start(&MACS[0][0], 0, DASH_EVENT_PROBE_REQUEST, 10, 10));
+  TEST_ASSERT_FALSE(injector.start(&MACS[0][0], INJECT_MAX_MACS + 1, DASH_EVENT_PROBE_REQUEST, 10, 10));
+  TEST_ASSERT_FALSE(injector.start(&MACS[0][0], 3, DASH_EVENT_PROBE_REQUEST, 0, 10));
+  TEST_ASSERT_FALSE(injector.start(&MACS[0][0], 3, DASH_EVENT_PROBE_REQUEST, INJECT_MAX_RATE + 1, 10));
+  TEST_ASSERT_FALSE(injector.start(&MACS[0][0], 3, DASH_EVENT_PROBE_REQUEST, 10, INJECT_MAX_COUNT + 1));
+  TEST_ASSERT_FALSE(injector.running());
+}
+
+void test_paces_to_rate() {
+  CaptureQueue queue;
+  EventInjector injector(queue);
+
+  TEST_ASSERT_TRUE(injector.start(&MACS[0][0], 3, DASH_EVENT_CONNECTED, 100, 50));
+
+  // The first goes out right away, then one every 10ms.
+  TEST_ASSERT_TRUE(injector.loop(0));
+  TEST_ASSERT_EQUAL(1, queue.size());
+  TEST_ASSERT_FALSE(injector.loop(9));
+  TEST_ASSERT_TRUE(injector.loop(10));
+  TEST_ASSERT_EQUAL(2, queue.size());
+
+  // A late loop catches up.
+  injector.loop(105);
+  TEST_ASSERT_EQUAL(11, queue.size());
+  drain(queue, injector, 0);
+
+  // And never goes past the count.
+  for (unsigned long now = 110; now < 2000; now += 7) {
+    injector.loop(now);
+    drain(queue, injector, 0);
+  }
+
+  TEST_ASSERT_EQUAL(50, injector.getStats().injected);
+  TEST_ASSERT_EQUAL(50, injector.getStats().processed);
+  TEST_ASSERT_EQUAL(0, injector.getStats().dropped);
+  TEST_ASSERT_FALSE(injector.running());
+}
+
+void test_rotates_macs_and_flags_events() {
+  CaptureQueue queue;
+  EventInjector injector(queue);
+  CapturedEvent event;
+
+  injector.start(&MACS[0][0], 3, DASH_EVENT_CONNECTED, 1000, 7);
+  injector.loop(10);
+
+  for (size_t i = 0; i < 7; i++) {
+    TEST_ASSERT_TRUE(queue.pop(event));
+    TEST_ASSERT_EQUAL_MEMORY(MACS[i % 3], event.mac, 6);
+    TEST_ASSERT_EQUAL(DASH_EVENT_CONNECTED, event.type);
+    TEST_ASSERT_EQUAL(CAPTURE_FLAG_SYNTHETIC, event.flags);
+  }
+}
+
+void test_latency_accounting() {
+  CaptureQueue queue;
+  EventInjector injector(queue);
+
+  injector.start(&MACS[0][0], 1, DASH_EVENT_PROBE_REQUEST, 1000, 4);
+  injector.loop(3);
+
+  // Processed one after another, 250us each, so the last waited 1ms.
+  drain(queue, injector, 250);
+
+  const InjectionStats& stats = injector.getStats();
+  TEST_ASSERT_EQUAL(4, stats.processed);
+  TEST_ASSERT_EQUAL(4, stats.published);
+  TEST_ASSERT_EQUAL(250 + 500 + 750 + 1000, stats.totalLatencyMicros);
+  TEST_ASSERT_EQUAL(1000, stats.maxLatencyMicros);
+}
+
+// Real traffic keeps its place: injected events are dropped, not queued
+// ahead of it, once the queue is full.
+void test_drops_when_queue_full() {
+  CaptureQueue queue;
+  EventInjector injector(queue);
+  const uint8_t real[6] = {0x44, 0x65, 0x0D, 1, 2, 3};
+
+  for (size_t i = 0; i < CAPTURE_QUEUE_SIZE - 5; i++) {
+    queue.push(DASH_EVENT_PROBE_REQUEST, real, -40);
+  }
+
+  injector.start(&MACS[0][0], 3, DASH_EVENT_PROBE_REQUEST, 1000, 20);
+  injector.loop(100);
+
+  const InjectionStats& stats = injector.getStats();
+  TEST_ASSERT_EQUAL(5, stats.injected);
+  TEST_ASSERT_EQUAL(15, stats.dropped);
+  TEST_ASSERT_EQUAL(CAPTURE_QUEUE_SIZE, queue.size());
+
+  // Only the events that made it in are tracked through the pipeline.
+  TEST_ASSERT_TRUE(injector.running());
+  TEST_ASSERT_EQUAL(CAPTURE_QUEUE_SIZE, drain(queue, injector, 10));
+  TEST_ASSERT_EQUAL(5, stats.processed);
+  TEST_ASSERT_FALSE(injector.running());
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_rejects_bad_runs);
+  RUN_TEST(test_paces_to_rate);
+  RUN_TEST(test_rotates_macs_and_flags_events);
+  RUN_TEST(test_latency_accounting);
+  RUN_TEST(test_drops_when_queue_full);
+  return UNITY_END();
+}
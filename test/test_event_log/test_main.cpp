@@ -0,0 +1,194 @@
+#include <unity.h>
+#include <EventLog.h>
+#include <EventLog.cpp>
+#include <vector>
+
+#define START_TIME 1700000000
+
+static const uint8_t MAC_A[6] = {0x44, 0x65, 0x0D, 0x00, 0x00, 0x0A};
+static const uint8_t MAC_B[6] = {0x44, 0x65, 0x0D, 0x00, 0x00, 0x0B};
+
+void setUp() {
+  SPIFFS.clear();
+  ArduinoStub::setMillis(0);
+  ArduinoStub::setTime(START_TIME);
+}
+
+void tearDown() { }
+
+// One record per second, alternating between two devices.
+static void recordSeconds(EventLog& log, const size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    log.record(DASH_EVENT_PROBE_REQUEST, i % 2 ? MAC_B : MAC_A, i % 2, -50);
+    ArduinoStub::setTime(time(NULL) + 1);
+  }
+}
+
+static std::vector<EventLogRecord> queryAll(EventLog& log, const uint32_t from = 0, const uint32_t to = UINT32_MAX, const uint8_t* mac = NULL) {
+  std::vector<EventLogRecord> records;
+  log.query(from, to, mac, [&records](const EventLogRecord& record) {
+    records.push_back(record);
+    return true;
+  });
+  return records;
+}
+
+void test_page_fits_one_spiffs_page() {
+  TEST_ASSERT_EQUAL(16, sizeof(EventLogRecord));
+  TEST_ASSERT_EQUAL(14, EVENT_LOG_RECORDS_PER_PAGE);
+  TEST_ASSERT_LESS_OR_EQUAL(FS_STUB_PAGE_DATA_SIZE, EVENT_LOG_PAGE_SIZE);
+}
+
+// Full pages are written once each, and every write lands on exactly one
+// SPIFFS data page.
+void test_write_amplification() {
+  EventLog log;
+  log.begin();
+  SPIFFS.resetStats();
+
+  recordSeconds(log, EVENT_LOG_RECORDS_PER_PAGE * 10);
+
+  TEST_ASSERT_EQUAL(10, log.getStats().pageWrites);
+  TEST_ASSERT_EQUAL(10, SPIFFS.stats().writes);
+  TEST_ASSERT_EQUAL(10, SPIFFS.stats().pagesTouched);
+
+  char message[128];
+  snprintf(message, sizeof(message), "%u records, %u page writes, %u bytes (%u per record)",
+    static_cast<unsigned>(log.getStats().records),
+    static_cast<unsigned>(SPIFFS.stats().writes),
+    static_cast<unsigned>(SPIFFS.stats().bytesWritten),
+    static_cast<unsigned>(SPIFFS.stats().bytesWritten / log.getStats().records));
+  TEST_MESSAGE(message);
+}
+
+void test_partial_page_flushed_after_interval() {
+  EventLog log;
+  log.begin();
+  SPIFFS.resetStats();
+
+  recordSeconds(log, 3);
+  log.loop(EVENT_LOG_FLUSH_INTERVAL - 1);
+  TEST_ASSERT_EQUAL(0, SPIFFS.stats().writes);
+
+  log.loop(EVENT_LOG_FLUSH_INTERVAL);
+  TEST_ASSERT_EQUAL(1, SPIFFS.stats().writes);
+  TEST_ASSERT_EQUAL(1, SPIFFS.stats().pagesTouched);
+
+  // Nothing new, nothing written.
+  log.loop(EVENT_LOG_FLUSH_INTERVAL * 3);
+  TEST_ASSERT_EQUAL(1, SPIFFS.stats().writes);
+}
+
+// A reboot without a flush loses only what was in the unwritten page.
+void test_crash_loses_only_unflushed_page() {
+  {
+    EventLog log;
+    log.begin();
+    recordSeconds(log, (EVENT_LOG_RECORDS_PER_PAGE * 2) + 5);
+  }
+
+  EventLog restored;
+  restored.begin();
+  TEST_ASSERT_EQUAL(EVENT_LOG_RECORDS_PER_PAGE * 2, queryAll(restored).size());
+
+  // A flushed partial page is picked up where it left off.
+  recordSeconds(restored, 5);
+  restored.flush();
+
+  EventLog again;
+  again.begin();
+  const std::vector<EventLogRecord> records = queryAll(again);
+  TEST_ASSERT_EQUAL((EVENT_LOG_RECORDS_PER_PAGE * 2) + 5, records.size());
+
+  for (size_t i = 1; i < records.size(); i++) {
+    TEST_ASSERT_LESS_THAN(records[i].time, records[i - 1].time);
+  }
+}
+
+void test_wraps_around_oldest_first() {
+  EventLog log;
+  log.begin();
+
+  recordSeconds(log, log.capacity() + (EVENT_LOG_RECORDS_PER_PAGE * 3));
+  log.flush();
+
+  // The page being filled takes the oldest page's place, so the log holds
+  // between one page short of its capacity and all of it.
+  const std::vector<EventLogRecord> records = queryAll(log);
+  TEST_ASSERT_LESS_OR_EQUAL(log.capacity(), records.size());
+  TEST_ASSERT_GREATER_OR_EQUAL(log.capacity() - EVENT_LOG_RECORDS_PER_PAGE, records.size());
+
+  // Newest record is the last one written, and the order holds across the
+  // wrap.
+  TEST_ASSERT_EQUAL(time(NULL) - 1, records.back().time);
+  for (size_t i = 1; i < records.size(); i++) {
+    TEST_ASSERT_EQUAL(records[i - 1].time + 1, records[i].time);
+  }
+}
+
+// A narrow time range only reads the pages that overlap it.
+void test_range_query_skips_pages() {
+  EventLog log;
+  log.begin();
+  recordSeconds(log, log.capacity());
+
+  const uint32_t from = START_TIME + (EVENT_LOG_RECORDS_PER_PAGE * 10) + 3;
+  const uint32_t to = from + 5;
+
+  std::vector<EventLogRecord> records;
+  const EventLogQueryStats stats = log.query(from, to, MAC_A, [&records](const EventLogRecord& record) {
+    records.push_back(record);
+    return true;
+  });
+
+  TEST_ASSERT_EQUAL(3, records.size());
+  TEST_ASSERT_EQUAL(3, stats.matched);
+  TEST_ASSERT_LESS_OR_EQUAL(2, stats.pagesRead);
+  TEST_ASSERT_GREATER_OR_EQUAL(EVENT_LOG_NUM_PAGES - 2, stats.pagesSkipped);
+
+  for (size_t i = 0; i < records.size(); i++) {
+    TEST_ASSERT_EQUAL_MEMORY(MAC_A, records[i].mac, 6);
+    TEST_ASSERT_TRUE(records[i].time >= from && records[i].time <= to);
+  }
+
+  char message[96];
+  snprintf(message, sizeof(message), "6 second range: %u of %u pages read",
+    static_cast<unsigned>(stats.pagesRead), EVENT_LOG_NUM_PAGES);
+  TEST_MESSAGE(message);
+}
+
+// Records from before SNTP has set the clock get a Unix time when they're
+// written, as long as it's the same boot.
+void test_uptime_resolved_once_clock_is_set() {
+  EventLog log;
+  log.begin();
+
+  ArduinoStub::setTime(0);
+  ArduinoStub::setMillis(10000);
+  log.record(DASH_EVENT_CONNECTED, MAC_A, 0, -60);
+
+  // Only shows up in unbounded queries until then.
+  TEST_ASSERT_EQUAL(1, queryAll(log).size());
+  TEST_ASSERT_EQUAL(0, queryAll(log, START_TIME, UINT32_MAX).size());
+
+  ArduinoStub::setMillis(25000);
+  ArduinoStub::setTime(START_TIME);
+  log.flush();
+
+  const std::vector<EventLogRecord> records = queryAll(log, START_TIME - 60, START_TIME);
+  TEST_ASSERT_EQUAL(1, records.size());
+  TEST_ASSERT_EQUAL(START_TIME - 15, records[0].time);
+  TEST_ASSERT_EQUAL(0, records[0].flags & EVENT_LOG_FLAG_UPTIME);
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_page_fits_one_spiffs_page);
+  RUN_TEST(test_write_amplification);
+  RUN_TEST(test_partial_page_flushed_after_interval);
+  RUN_TEST(test_crash_loses_only_unflushed_page);
+  RUN_TEST(test_wraps_around_oldest_first);
+  RUN_TEST(test_range_query_skips_pages);
+  RUN_TEST(test_uptime_resolved_once_clock_is_set);
+  return UNITY_END();
+}
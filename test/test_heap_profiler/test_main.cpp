@@ -0,0 +1,153 @@
+#include <unity.h>
+#include <stdlib.h>
+#include <HeapProfiler.h>
+#include <HeapProfiler.cpp>
+
+// Built in env:native_heap_profile, with the allocator wrapped. Stats are
+// cumulative for the whole run, so tests compare before and after.
+
+// Keeps the compiler from pairing up and removing mallocs and frees.
+static void* volatile sink;
+
+static void* allocate(const size_t size) {
+  void* ptr = malloc(size);
+  memset(ptr, 0x5A, size);
+  sink = ptr;
+  return ptr;
+}
+
+void setUp() {
+  HeapProfiler::setTag(HEAP_TAG_OTHER);
+}
+
+void tearDown() { }
+
+void test_charged_to_innermost_scope() {
+  const HeapTagStats mqtt = HeapProfiler::stats(HEAP_TAG_MQTT);
+  const HeapTagStats http = HeapProfiler::stats(HEAP_TAG_HTTP);
+  void* outer;
+  void* inner;
+
+  {
+    HEAP_SCOPE(HEAP_TAG_MQTT);
+    outer = allocate(100);
+
+    {
+      HEAP_SCOPE(HEAP_TAG_HTTP);
+      inner = allocate(40);
+    }
+
+    TEST_ASSERT_EQUAL(HEAP_TAG_MQTT, HeapProfiler::currentTag());
+  }
+  TEST_ASSERT_EQUAL(HEAP_TAG_OTHER, HeapProfiler::currentTag());
+
+  TEST_ASSERT_EQUAL(mqtt.allocs + 1, HeapProfiler::stats(HEAP_TAG_MQTT).allocs);
+  TEST_ASSERT_EQUAL(mqtt.liveBytes + 100, HeapProfiler::stats(HEAP_TAG_MQTT).liveBytes);
+  TEST_ASSERT_EQUAL(http.allocs + 1, HeapProfiler::stats(HEAP_TAG_HTTP).allocs);
+  TEST_ASSERT_EQUAL(http.liveBytes + 40, HeapProfiler::stats(HEAP_TAG_HTTP).liveBytes);
+
+  free(outer);
+  free(inner);
+  TEST_ASSERT_EQUAL(mqtt.liveBytes, HeapProfiler::stats(HEAP_TAG_MQTT).liveBytes);
+  TEST_ASSERT_EQUAL(http.liveBlocks, HeapProfiler::stats(HEAP_TAG_HTTP).liveBlocks);
+}
+
+// A block handed from one subsystem to another is credited back to the one
+// that allocated it.
+void test_free_credits_allocating_tag() {
+  const HeapTagStats events = HeapProfiler::stats(HEAP_TAG_EVENTS);
+  void* ptr;
+
+  {
+    HEAP_SCOPE(HEAP_TAG_EVENTS);
+    ptr = allocate(64);
+  }
+
+  {
+    HEAP_SCOPE(HEAP_TAG_WEBSOCKETS);
+    free(ptr);
+  }
+
+  TEST_ASSERT_EQUAL(events.frees + 1, HeapProfiler::stats(HEAP_TAG_EVENTS).frees);
+  TEST_ASSERT_EQUAL(events.liveBytes, HeapProfiler::stats(HEAP_TAG_EVENTS).liveBytes);
+}
+
+void test_realloc_keeps_tag() {
+  const HeapTagStats settings = HeapProfiler::stats(HEAP_TAG_SETTINGS);
+  char* ptr;
+
+  {
+    HEAP_SCOPE(HEAP_TAG_SETTINGS);
+    ptr = static_cast<char*>(allocate(16));
+  }
+
+  ptr = static_cast<char*>(realloc(ptr, 4096));
+  TEST_ASSERT_NOT_NULL(ptr);
+  TEST_ASSERT_EQUAL(0x5A, ptr[15]);
+  TEST_ASSERT_EQUAL(settings.liveBytes + 4096, HeapProfiler::stats(HEAP_TAG_SETTINGS).liveBytes);
+  TEST_ASSERT_EQUAL(settings.liveBlocks + 1, HeapProfiler::stats(HEAP_TAG_SETTINGS).liveBlocks);
+  TEST_ASSERT_GREATER_OR_EQUAL(settings.liveBytes + 4096, HeapProfiler::stats(HEAP_TAG_SETTINGS).peakLiveBytes);
+
+  free(ptr);
+  TEST_ASSERT_EQUAL(settings.liveBytes, HeapProfiler::stats(HEAP_TAG_SETTINGS).liveBytes);
+}
+
+void test_calloc() {
+  const HeapTagStats other = HeapProfiler::stats(HEAP_TAG_OTHER);
+  uint8_t* ptr = static_cast<uint8_t*>(calloc(10, 8));
+  sink = ptr;
+
+  TEST_ASSERT_NOT_NULL(ptr);
+  for (size_t i = 0; i < 80; i++) {
+    TEST_ASSERT_EQUAL(0, ptr[i]);
+  }
+  TEST_ASSERT_EQUAL(other.liveBytes + 80, HeapProfiler::stats(HEAP_TAG_OTHER).liveBytes);
+  free(ptr);
+
+  // count * size overflows. Volatile, or the compiler rejects the call.
+  volatile size_t count = SIZE_MAX / 2;
+  TEST_ASSERT_NULL(calloc(count, 4));
+}
+
+void test_samples_oldest_first() {
+  void* blocks[HEAP_PROFILE_NUM_SAMPLES * HEAP_PROFILE_SAMPLE_RATE * 2];
+  const size_t numBlocks = sizeof(blocks) / sizeof(blocks[0]);
+
+  {
+    HEAP_SCOPE(HEAP_TAG_EVENT_STREAM);
+    for (size_t i = 0; i < numBlocks; i++) {
+      blocks[i] = allocate(1000 + i);
+    }
+  }
+
+  // The ring has wrapped, so every sample is one of the blocks above.
+  HeapSample sample;
+  uint32_t lastSeq = 0;
+  size_t numSamples = 0;
+
+  while (HeapProfiler::sample(numSamples, sample)) {
+    TEST_ASSERT_EQUAL(HEAP_TAG_EVENT_STREAM, sample.tag);
+    TEST_ASSERT_GREATER_OR_EQUAL(1000, sample.size);
+    TEST_ASSERT_GREATER_THAN(lastSeq, sample.seq);
+    TEST_ASSERT_NOT_EQUAL(0, sample.caller);
+    lastSeq = sample.seq;
+    numSamples++;
+  }
+
+  TEST_ASSERT_EQUAL(HEAP_PROFILE_NUM_SAMPLES, numSamples);
+  TEST_ASSERT_LESS_THAN(HEAP_PROFILE_SAMPLE_RATE, HeapProfiler::numAllocs() - lastSeq);
+
+  for (size_t i = 0; i < numBlocks; i++) {
+    free(blocks[i]);
+  }
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_charged_to_innermost_scope);
+  RUN_TEST(test_free_credits_allocating_tag);
+  RUN_TEST(test_realloc_keeps_tag);
+  RUN_TEST(test_calloc);
+  RUN_TEST(test_samples_oldest_first);
+  return UNITY_END();
+}
@@ -0,0 +1,170 @@
+#include <unity.h>
+#include <HyperLogLog.h>
+#include <HyperLogLog.cpp>
+#include <OccupancyCounter.h>
+#include <OccupancyCounter.cpp>
+#include <math.h>
+#include <random>
+#include <vector>
+
+#define NUM_TRIALS 50
+
+// Three standard errors at p = 10 is ~10%, but over 50 trials the RMS error
+// should sit near the 3.25% bound.
+#define MAX_RMS_ERROR 0.05
+
+void setUp() { }
+void tearDown() { }
+
+static void randomMac(std::mt19937_64& rng, uint8_t* mac) {
+  const uint64_t bits = rng();
+  for (size_t i = 0; i < 6; i++) {
+    mac[i] = bits >> (i * 8);
+  }
+}
+
+// Same vendor prefix, consecutive serials, as a shelf of identical devices.
+static void sequentialMac(const uint32_t serial, uint8_t* mac) {
+  mac[0] = 0x44;
+  mac[1] = 0x65;
+  mac[2] = 0x0D;
+  mac[3] = serial >> 16;
+  mac[4] = serial >> 8;
+  mac[5] = serial;
+}
+
+void test_empty() {
+  HyperLogLog sketch;
+  TEST_ASSERT_EQUAL(0, sketch.estimate());
+}
+
+void test_duplicates_count_once() {
+  HyperLogLog sketch;
+  uint8_t mac[6];
+
+  for (size_t i = 0; i < 100; i++) {
+    for (size_t repeat = 0; repeat < 20; repeat++) {
+      sequentialMac(i, mac);
+      sketch.add(mac);
+    }
+  }
+
+  TEST_ASSERT_INT_WITHIN(5, 100, sketch.estimate());
+}
+
+void test_error_bound() {
+  const uint32_t sizes[] = {1, 10, 100, 1000, 10000, 100000};
+  std::mt19937_64 rng(45);
+  uint8_t mac[6];
+
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    double sumSquares = 0;
+
+    for (size_t trial = 0; trial < NUM_TRIALS; trial++) {
+      HyperLogLog sketch;
+
+      for (uint32_t i = 0; i < sizes[s]; i++) {
+        randomMac(rng, mac);
+        sketch.add(mac);
+      }
+
+      const double error = (static_cast<double>(sketch.estimate()) - sizes[s]) / sizes[s];
+      sumSquares += error * error;
+    }
+
+    const double rms = sqrt(sumSquares / NUM_TRIALS);
+
+    char message[96];
+    snprintf(message, sizeof(message), "%u distinct: RMS relative error %.2f%% over %u trials",
+      static_cast<unsigned>(sizes[s]), rms * 100, NUM_TRIALS);
+    TEST_MESSAGE(message);
+
+    TEST_ASSERT_TRUE(rms <= MAX_RMS_ERROR);
+  }
+}
+
+void test_sequential_macs() {
+  HyperLogLog sketch;
+  uint8_t mac[6];
+
+  for (uint32_t i = 0; i < 5000; i++) {
+    sequentialMac(i, mac);
+    sketch.add(mac);
+  }
+
+  TEST_ASSERT_INT_WITHIN(750, 5000, sketch.estimate());
+}
+
+// Two nodes that both heard the middle 1000 devices.
+void test_merge_counts_union_once() {
+  HyperLogLog a;
+  HyperLogLog b;
+  uint8_t mac[6];
+
+  for (uint32_t i = 0; i < 2000; i++) {
+    sequentialMac(i, mac);
+    a.add(mac);
+  }
+  for (uint32_t i = 1000; i < 3000; i++) {
+    sequentialMac(i, mac);
+    b.add(mac);
+  }
+
+  HyperLogLog fromRegisters;
+  fromRegisters.merge(a.registers());
+  fromRegisters.merge(b.registers());
+  a.merge(b);
+
+  TEST_ASSERT_EQUAL(a.estimate(), fromRegisters.estimate());
+  TEST_ASSERT_INT_WITHIN(450, 3000, a.estimate());
+
+  char message[64];
+  snprintf(message, sizeof(message), "2000 + 2000 overlapping by 1000: %u", static_cast<unsigned>(a.estimate()));
+  TEST_MESSAGE(message);
+}
+
+void test_windows_close_and_skip_idle() {
+  OccupancyCounter counter;
+  std::vector<uint32_t> closed;
+  uint8_t mac[6];
+
+  counter.onWindowClosed([&closed](const OccupancyWindow window, const HyperLogLog& sketch, const unsigned long start) {
+    if (window == OCCUPANCY_MINUTE) {
+      closed.push_back(start);
+    }
+  });
+
+  for (uint32_t i = 0; i < 50; i++) {
+    sequentialMac(i, mac);
+    counter.record(mac, i * 100);
+  }
+
+  counter.loop(60000);
+  TEST_ASSERT_EQUAL(1, closed.size());
+  TEST_ASSERT_EQUAL(0, closed[0]);
+  TEST_ASSERT_INT_WITHIN(3, 50, counter.window(OCCUPANCY_MINUTE).lastEstimate);
+  TEST_ASSERT_EQUAL(60000, counter.window(OCCUPANCY_MINUTE).start);
+  TEST_ASSERT_EQUAL(0, counter.window(OCCUPANCY_MINUTE).sketch.estimate());
+
+  // Nothing for several minutes: one close, for the window that had started,
+  // and the next one starts on a minute boundary.
+  counter.loop(60000 * 5 + 123);
+  TEST_ASSERT_EQUAL(2, closed.size());
+  TEST_ASSERT_EQUAL(0, counter.window(OCCUPANCY_MINUTE).lastEstimate);
+  TEST_ASSERT_EQUAL(60000 * 5, counter.window(OCCUPANCY_MINUTE).start);
+
+  // The hour window is still open and has everything.
+  TEST_ASSERT_EQUAL(0, counter.window(OCCUPANCY_HOUR).start);
+  TEST_ASSERT_INT_WITHIN(3, 50, counter.window(OCCUPANCY_HOUR).sketch.estimate());
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_empty);
+  RUN_TEST(test_duplicates_count_once);
+  RUN_TEST(test_error_bound);
+  RUN_TEST(test_sequential_macs);
+  RUN_TEST(test_merge_counts_union_once);
+  RUN_TEST(test_windows_close_and_skip_idle);
+  return UNITY_END();
+}
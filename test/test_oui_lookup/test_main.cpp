@@ -0,0 +1,134 @@
+#include <unity.h>
+#include <Arduino.h>
+
+// Every table entry the search looks at is one pgm_read_dword, so counting
+// those counts its comparisons.
+static size_t probes = 0;
+#undef pgm_read_dword
+#define pgm_read_dword(addr) (probes++, *reinterpret_cast<const uint32_t*>(addr))
+
+#include <OuiLookup.h>
+#include <OuiLookup.cpp>
+
+void setUp() { }
+void tearDown() { }
+
+static void macFromEntry(const uint32_t entry, uint8_t* mac) {
+  mac[0] = entry >> 24;
+  mac[1] = entry >> 16;
+  mac[2] = entry >> 8;
+  mac[3] = 0x12;
+  mac[4] = 0x34;
+  mac[5] = 0x56;
+}
+
+void test_known_vendor() {
+  const uint8_t mac[6] = {0x44, 0x65, 0x0D, 0x01, 0x02, 0x03};
+  char vendor[OUI_MAX_VENDOR_LENGTH];
+
+  TEST_ASSERT_TRUE(OuiLookup::findVendor(mac, vendor, sizeof(vendor)));
+  TEST_ASSERT_EQUAL_STRING("Amazon Technologies Inc.", vendor);
+}
+
+void test_every_entry_resolves() {
+  uint8_t mac[6];
+
+  for (size_t i = 0; i < OUI_TABLE_SIZE; i++) {
+    macFromEntry(OUI_ENTRIES[i], mac);
+
+    // Locally administered prefixes aren't looked up at all.
+    if (mac[0] & 0x02) {
+      continue;
+    }
+
+    TEST_ASSERT_TRUE(OuiLookup::findVendor(mac) == OUI_VENDORS + OUI_VENDOR_OFFSETS[OUI_ENTRIES[i] & 0xFF]);
+  }
+}
+
+void test_unknown_prefix() {
+  const uint8_t mac[6] = {0x00, 0x00, 0x01, 0x00, 0x00, 0x00};
+  char vendor[OUI_MAX_VENDOR_LENGTH];
+
+  TEST_ASSERT_NULL(OuiLookup::findVendor(mac));
+  TEST_ASSERT_FALSE(OuiLookup::findVendor(mac, vendor, sizeof(vendor)));
+}
+
+void test_locally_administered_skipped() {
+  // Amazon's prefix with the locally administered bit set.
+  const uint8_t mac[6] = {0x46, 0x65, 0x0D, 0x01, 0x02, 0x03};
+  TEST_ASSERT_NULL(OuiLookup::findVendor(mac));
+}
+
+void test_truncates_to_buffer() {
+  const uint8_t mac[6] = {0x44, 0x65, 0x0D, 0x01, 0x02, 0x03};
+  char vendor[7];
+
+  TEST_ASSERT_TRUE(OuiLookup::findVendor(mac, vendor, sizeof(vendor)));
+  TEST_ASSERT_EQUAL_STRING("Amazon", vendor);
+}
+
+// Host timing only says how the search scales, the device reads each probe
+// from flash. What carries over is the number of probes.
+void test_benchmark() {
+  const size_t numLookups = 1000000;
+  std::mt19937 rng(1);
+  uint8_t macs[256][6];
+  size_t found = 0;
+  size_t maxProbes = 0;
+  size_t totalProbes = 0;
+
+  for (size_t i = 0; i < 256; i++) {
+    if (i % 2) {
+      macFromEntry(OUI_ENTRIES[rng() % OUI_TABLE_SIZE], macs[i]);
+    } else {
+      for (size_t j = 0; j < 6; j++) {
+        macs[i][j] = rng();
+      }
+      macs[i][0] &= ~0x02;
+    }
+  }
+
+  // Every prefix in the table, plus the misses on either side of each.
+  uint8_t mac[6];
+  size_t numCounted = 0;
+  for (size_t i = 0; i < OUI_TABLE_SIZE; i++) {
+    for (int delta = -1; delta <= 1; delta++) {
+      macFromEntry(OUI_ENTRIES[i] + (delta << 8), mac);
+      if (mac[0] & 0x02) {
+        continue;
+      }
+
+      probes = 0;
+      OuiLookup::findVendor(mac);
+      maxProbes = std::max(maxProbes, probes);
+      totalProbes += probes;
+      numCounted++;
+    }
+  }
+
+  const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < numLookups; i++) {
+    found += OuiLookup::findVendor(macs[i % 256]) != NULL;
+  }
+  const double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+  char message[160];
+  snprintf(message, sizeof(message), "%u entries, %u probes at most, %.1f on average, %.1f ns/lookup on host, %u found",
+    static_cast<unsigned>(OUI_TABLE_SIZE), static_cast<unsigned>(maxProbes),
+    static_cast<double>(totalProbes) / numCounted, ns / numLookups, static_cast<unsigned>(found));
+  TEST_MESSAGE(message);
+
+  TEST_ASSERT_LESS_OR_EQUAL(8, maxProbes);
+  TEST_ASSERT_GREATER_OR_EQUAL(numLookups / 2, found);
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_known_vendor);
+  RUN_TEST(test_every_entry_resolves);
+  RUN_TEST(test_unknown_prefix);
+  RUN_TEST(test_locally_administered_skipped);
+  RUN_TEST(test_truncates_to_buffer);
+  RUN_TEST(test_benchmark);
+  return UNITY_END();
+}
@@ -0,0 +1,144 @@
+#include <unity.h>
+#include <ResponseCache.h>
+#include <ResponseCache.cpp>
+#include <BoundedPrint.h>
+#include <BoundedPrint.cpp>
+#include <JsonStreamWriter.h>
+#include <JsonStreamWriter.cpp>
+
+static const char* JSON = "application/json";
+
+void setUp() {
+  ArduinoStub::setMillis(1000);
+}
+
+void tearDown() { }
+
+static std::string contents(const CachedResponse* response) {
+  return std::string(reinterpret_cast<const char*>(response->data), response->length);
+}
+
+void test_hit_serves_complete_response() {
+  ResponseCache cache;
+
+  TEST_ASSERT_NULL(cache.get(CACHED_SETTINGS, 1, 0));
+  TEST_ASSERT_NOT_NULL(cache.put(CACHED_SETTINGS, 1, JSON, String("{\"a\":1}")));
+
+  const CachedResponse* response = cache.get(CACHED_SETTINGS, 1, 0);
+  TEST_ASSERT_NOT_NULL(response);
+  TEST_ASSERT_EQUAL_STRING(
+    "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: 7\r\nConnection: close\r\n\r\n{\"a\":1}",
+    contents(response).c_str()
+  );
+
+  TEST_ASSERT_EQUAL(1, cache.getStats().hits);
+  TEST_ASSERT_EQUAL(1, cache.getStats().misses);
+  TEST_ASSERT_EQUAL(response->length, cache.getStats().bytesServed);
+}
+
+// Settings::generation() moves on with every change, including a fleet
+// config applied through FleetConfig.
+void test_generation_change_misses() {
+  ResponseCache cache;
+
+  cache.put(CACHED_DEVICES, 7, JSON, String("[]"));
+  TEST_ASSERT_NOT_NULL(cache.get(CACHED_DEVICES, 7, 0));
+  TEST_ASSERT_NULL(cache.get(CACHED_DEVICES, 8, 0));
+
+  cache.put(CACHED_DEVICES, 8, JSON, String("[1]"));
+  TEST_ASSERT_NOT_NULL(cache.get(CACHED_DEVICES, 8, 0));
+}
+
+void test_max_age() {
+  ResponseCache cache;
+
+  cache.put(CACHED_ABOUT, 1, JSON, String("{}"));
+
+  ArduinoStub::advanceMillis(1000);
+  TEST_ASSERT_NOT_NULL(cache.get(CACHED_ABOUT, 1, 1000));
+  // No time limit.
+  TEST_ASSERT_NOT_NULL(cache.get(CACHED_ABOUT, 1, 0));
+
+  ArduinoStub::advanceMillis(1);
+  TEST_ASSERT_NULL(cache.get(CACHED_ABOUT, 1, 1000));
+  TEST_ASSERT_NOT_NULL(cache.get(CACHED_ABOUT, 1, 0));
+}
+
+void test_entries_are_per_endpoint() {
+  ResponseCache cache;
+
+  cache.put(CACHED_ABOUT, 1, JSON, String("about"));
+  cache.put(CACHED_SETTINGS, 1, JSON, String("settings"));
+
+  TEST_ASSERT_TRUE(contents(cache.get(CACHED_ABOUT, 1, 0)).find("about") != std::string::npos);
+  TEST_ASSERT_TRUE(contents(cache.get(CACHED_SETTINGS, 1, 0)).find("settings") != std::string::npos);
+  TEST_ASSERT_NULL(cache.get(CACHED_DEVICES, 1, 0));
+
+  cache.put(CACHED_ABOUT, 1, JSON, String("x"));
+  TEST_ASSERT_EQUAL(cache.get(CACHED_ABOUT, 1, 0)->length + cache.get(CACHED_SETTINGS, 1, 0)->length, cache.size());
+}
+
+void test_budget() {
+  ResponseCache cache;
+  const String big(std::string(RESPONSE_CACHE_MAX_BYTES / 2, 'x'));
+
+  cache.put(CACHED_ABOUT, 1, JSON, big);
+  TEST_ASSERT_NOT_NULL(cache.get(CACHED_ABOUT, 1, 0));
+
+  // Doesn't fit next to the first, which is dropped to make room.
+  TEST_ASSERT_NOT_NULL(cache.put(CACHED_SETTINGS, 1, JSON, big));
+  TEST_ASSERT_NULL(cache.get(CACHED_ABOUT, 1, 0));
+  TEST_ASSERT_LESS_OR_EQUAL(RESPONSE_CACHE_MAX_BYTES, cache.size());
+
+  // Never fits.
+  TEST_ASSERT_NULL(cache.put(CACHED_DEVICES, 1, JSON, String(std::string(RESPONSE_CACHE_MAX_BYTES, 'x'))));
+  TEST_ASSERT_NULL(cache.get(CACHED_DEVICES, 1, 0));
+  TEST_ASSERT_EQUAL(1, cache.getStats().uncacheable);
+  TEST_ASSERT_EQUAL(0, cache.size());
+}
+
+static void writeDevices(JsonStreamWriter& json, const size_t n) {
+  json.beginArray();
+  for (size_t i = 0; i < n; i++) {
+    json.beginObject().field("alias", "kitchen").field("ix", static_cast<unsigned int>(i)).endObject();
+  }
+  json.endArray();
+}
+
+// What DashStadiumHttpServer::sendCachedJson does on a miss: render into at
+// most the cache's budget, and stream instead if it doesn't fit.
+void test_bounded_render() {
+  ResponseCache cache;
+
+  {
+    BoundedPrint body(RESPONSE_CACHE_MAX_BYTES);
+    JsonStreamWriter json(body);
+    writeDevices(json, 3);
+
+    TEST_ASSERT_FALSE(body.overflowed());
+    const CachedResponse* response = cache.put(CACHED_DEVICES, 1, JSON, body.data(), body.length());
+    TEST_ASSERT_NOT_NULL(response);
+
+    const std::string rendered = contents(response);
+    TEST_ASSERT_TRUE(rendered.find("Content-Length: 82\r\n") != std::string::npos);
+    TEST_ASSERT_TRUE(rendered.find("[{\"alias\":\"kitchen\",\"ix\":0},") != std::string::npos);
+  }
+
+  BoundedPrint body(RESPONSE_CACHE_MAX_BYTES);
+  JsonStreamWriter json(body);
+  writeDevices(json, 1000);
+
+  TEST_ASSERT_TRUE(body.overflowed());
+  TEST_ASSERT_LESS_OR_EQUAL(RESPONSE_CACHE_MAX_BYTES, body.length());
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_hit_serves_complete_response);
+  RUN_TEST(test_generation_change_misses);
+  RUN_TEST(test_max_age);
+  RUN_TEST(test_entries_are_per_endpoint);
+  RUN_TEST(test_budget);
+  RUN_TEST(test_bounded_render);
+  return UNITY_END();
+}
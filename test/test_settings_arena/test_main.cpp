@@ -0,0 +1,367 @@
+#include <unity.h>
+#include <CountingHeap.h>
+#include <ArduinoJson.h>
+#include <Settings.h>
+#include <Settings.cpp>
+#include <SettingsArena.cpp>
+#include <JsonStreamWriter.cpp>
+#include <random>
+#include <string>
+#include <vector>
+
+#define MAX_DEVICES 32
+
+// What a change may allocate besides the new arena: a device source lambda
+// too big for std::function to hold inline.
+#define REBUILD_SLACK 64
+
+// Settings with the arena and rebuild() in reach.
+class TestSettings : public Settings {
+public:
+  using Settings::rebuild;
+
+  const SettingsArena& getArena() const { return arena; }
+};
+
+struct Model {
+  std::string strings[SETTINGS_NUM_STRING_FIELDS];
+  std::vector<std::vector<uint8_t> > macs;
+  std::vector<std::string> aliases;
+};
+
+void setUp() { }
+void tearDown() { }
+
+static void patch(Settings& settings, const char* json) {
+  DynamicJsonBuffer buffer;
+  JsonObject& parsed = buffer.parseObject(json);
+  TEST_ASSERT_TRUE(parsed.success());
+  settings.patch(parsed);
+}
+
+static void assertMatches(const Settings& settings, const Model& model) {
+  for (size_t i = 0; i < SETTINGS_NUM_STRING_FIELDS; i++) {
+    TEST_ASSERT_EQUAL_STRING(model.strings[i].c_str(), settings.get(static_cast<SettingsField>(i)));
+  }
+
+  TEST_ASSERT_EQUAL(model.aliases.size(), settings.numMonitoredMacs());
+
+  for (size_t i = 0; i < model.aliases.size(); i++) {
+    TEST_ASSERT_EQUAL_MEMORY(model.macs[i].data(), settings.monitoredMac(i), 6);
+    TEST_ASSERT_EQUAL_STRING(model.aliases[i].c_str(), settings.deviceAlias(i));
+  }
+}
+
+static Model defaults() {
+  Model model;
+  model.strings[SETTING_AP_NAME] = "DashStadium";
+  model.strings[SETTING_AP_PASSWORD] = "qu3c2ER9Ddl";
+  return model;
+}
+
+static std::vector<uint8_t> macOf(const uint8_t last) {
+  std::vector<uint8_t> mac(6, 0);
+  mac[0] = 0x44;
+  mac[1] = 0x65;
+  mac[2] = 0x0D;
+  mac[5] = last;
+  return mac;
+}
+
+// Offsets, the MAC table and the pool, nothing else.
+void test_layout() {
+  TestSettings settings;
+  Model model = defaults();
+
+  patch(settings, "{\"mqtt_server\":\"mqtt.local\",\"monitored_macs\":[[\"44:65:0D:00:00:AA\",\"kitchen\"]]}");
+  model.strings[SETTING_MQTT_SERVER] = "mqtt.local";
+  model.macs.push_back(macOf(0xAA));
+  model.aliases.push_back("kitchen");
+  assertMatches(settings, model);
+
+  size_t pool = model.aliases[0].size() + 1;
+  for (size_t i = 0; i < SETTINGS_NUM_STRING_FIELDS; i++) {
+    pool += model.strings[i].size() + 1;
+  }
+  TEST_ASSERT_EQUAL(((SETTINGS_NUM_STRING_FIELDS + 1) * sizeof(uint16_t)) + (1 * 6) + pool, settings.arenaSize());
+}
+
+// Fields missing from a patch are copied from the block being replaced.
+void test_patch_keeps_unchanged_values() {
+  TestSettings settings;
+  Model model = defaults();
+
+  patch(settings, "{\"admin_username\":\"user\",\"admin_password\":\"secret\",\"monitored_macs\":[[\"44:65:0D:00:00:01\",\"door\"]]}");
+  model.strings[SETTING_ADMIN_USERNAME] = "user";
+  model.strings[SETTING_ADMIN_PASSWORD] = "secret";
+  model.macs.push_back(macOf(1));
+  model.aliases.push_back("door");
+  settings.takeChanges();
+
+  const uint32_t generation = settings.generation();
+  patch(settings, "{\"mqtt_server\":\"broker:8883\"}");
+  model.strings[SETTING_MQTT_SERVER] = "broker:8883";
+
+  assertMatches(settings, model);
+  TEST_ASSERT_EQUAL(generation + 1, settings.generation());
+  TEST_ASSERT_EQUAL(SETTINGS_CHANGED_MQTT, settings.takeChanges());
+  TEST_ASSERT_EQUAL_STRING("broker", settings.mqttServer().c_str());
+  TEST_ASSERT_EQUAL(8883, settings.mqttPort());
+
+  // null clears a field.
+  patch(settings, "{\"admin_password\":null}");
+  model.strings[SETTING_ADMIN_PASSWORD] = "";
+  assertMatches(settings, model);
+  TEST_ASSERT_EQUAL(SETTINGS_CHANGED_AUTH, settings.takeChanges());
+  TEST_ASSERT_FALSE(settings.hasAuthSettings());
+
+  // Rebuilt from its own strings, nothing changes.
+  const char* values[SETTINGS_NUM_STRING_FIELDS];
+  for (size_t i = 0; i < SETTINGS_NUM_STRING_FIELDS; i++) {
+    values[i] = settings.get(static_cast<SettingsField>(i));
+  }
+  settings.rebuild(values, settings.numMonitoredMacs(), NULL);
+  assertMatches(settings, model);
+  TEST_ASSERT_EQUAL(0, settings.takeChanges());
+}
+
+void test_set_if_present() {
+  TestSettings settings;
+  settings.takeChanges();
+
+  patch(settings, "{\"mqtt_tls\":true,\"debounce_threshold_ms\":2500,\"cluster_claim_window_ms\":150,\"fleet_enabled\":false}");
+  TEST_ASSERT_TRUE(settings.mqttTls);
+  TEST_ASSERT_EQUAL(2500, settings.debounceThresholdMs);
+  TEST_ASSERT_EQUAL(150, settings.clusterClaimWindowMs);
+  TEST_ASSERT_FALSE(settings.fleetEnabled);
+  // fleet_enabled was already false, and the debounce threshold has no bit.
+  TEST_ASSERT_EQUAL(SETTINGS_CHANGED_MQTT | SETTINGS_CHANGED_CLUSTER, settings.takeChanges());
+
+  patch(settings, "{\"mqtt_tls\":true,\"cluster_claim_window_ms\":150}");
+  TEST_ASSERT_EQUAL(0, settings.takeChanges());
+
+  patch(settings, "{\"fleet_enabled\":true,\"fleet_version\":3}");
+  TEST_ASSERT_EQUAL(3, settings.fleetVersion);
+  TEST_ASSERT_EQUAL(SETTINGS_CHANGED_FLEET, settings.takeChanges());
+}
+
+// The device source passed to rebuild() reads the patch; without
+// monitored_macs the default one copies from the block being replaced.
+void test_device_source() {
+  TestSettings settings;
+  settings.takeChanges();
+
+  patch(settings, "{\"monitored_macs\":[[\"44:65:0D:00:00:01\",\"door\"],\"junk\",[\"nonsense\"],[\"44:65:0D:00:00:02\",\"desk\"]]}");
+  TEST_ASSERT_EQUAL(SETTINGS_CHANGED_DEVICES, settings.takeChanges());
+  TEST_ASSERT_EQUAL(4, settings.numMonitoredMacs());
+
+  // Entries that aren't [mac, alias] come out zeroed, without an alias.
+  const uint8_t zero[6] = {0};
+  TEST_ASSERT_EQUAL_STRING("", settings.deviceAlias(1));
+  TEST_ASSERT_EQUAL_MEMORY(zero, settings.monitoredMac(1), 6);
+  TEST_ASSERT_EQUAL_MEMORY(zero, settings.monitoredMac(2), 6);
+  TEST_ASSERT_EQUAL_STRING("desk", settings.deviceAlias(3));
+
+  patch(settings, "{\"ap_name\":\"renamed\"}");
+  TEST_ASSERT_EQUAL(SETTINGS_CHANGED_AP, settings.takeChanges());
+  TEST_ASSERT_EQUAL(4, settings.numMonitoredMacs());
+  TEST_ASSERT_EQUAL_STRING("door", settings.deviceAlias(0));
+  TEST_ASSERT_EQUAL_MEMORY(macOf(2).data(), settings.monitoredMac(3), 6);
+
+  // Same MACs in the same order, only an alias differs.
+  patch(settings, "{\"monitored_macs\":[[\"44:65:0D:00:00:01\",\"front door\"],\"junk\",[\"nonsense\"],[\"44:65:0D:00:00:02\",\"desk\"]]}");
+  TEST_ASSERT_EQUAL(SETTINGS_CHANGED_ALIASES, settings.takeChanges());
+}
+
+void test_add_remove_devices() {
+  TestSettings settings;
+  Model model = defaults();
+  settings.takeChanges();
+
+  const std::vector<uint8_t> a = macOf(1);
+  const std::vector<uint8_t> b = macOf(2);
+  const std::vector<uint8_t> c = macOf(3);
+
+  TEST_ASSERT_TRUE(settings.addMonitoredMac(a.data(), "door"));
+  TEST_ASSERT_TRUE(settings.addMonitoredMac(b.data(), "desk"));
+  TEST_ASSERT_TRUE(settings.addMonitoredMac(c.data(), "car"));
+  TEST_ASSERT_EQUAL(SETTINGS_CHANGED_DEVICES, settings.takeChanges());
+
+  TEST_ASSERT_FALSE(settings.addMonitoredMac(b.data(), "desk"));
+  TEST_ASSERT_EQUAL(0, settings.takeChanges());
+
+  // The new alias replaces one that lives in the block being replaced.
+  TEST_ASSERT_TRUE(settings.addMonitoredMac(b.data(), "standing desk"));
+  TEST_ASSERT_EQUAL(SETTINGS_CHANGED_ALIASES, settings.takeChanges());
+
+  TEST_ASSERT_TRUE(settings.removeMonitoredMac(a.data()));
+  TEST_ASSERT_FALSE(settings.removeMonitoredMac(a.data()));
+  TEST_ASSERT_EQUAL(SETTINGS_CHANGED_DEVICES, settings.takeChanges());
+
+  model.macs.push_back(b);
+  model.aliases.push_back("standing desk");
+  model.macs.push_back(c);
+  model.aliases.push_back("car");
+  assertMatches(settings, model);
+  TEST_ASSERT_EQUAL(1, settings.findMonitoredMac(c.data()));
+  TEST_ASSERT_EQUAL(-1, settings.findMonitoredMac(a.data()));
+}
+
+// The baked config is a copy of a filled block, which starts with the offsets
+// ahead of the MAC table.
+void test_load_image() {
+  TestSettings settings;
+  Model model = defaults();
+
+  patch(settings, "{\"mqtt_topic_pattern\":\"dash/+/pressed\",\"monitored_macs\":[[\"44:65:0D:00:00:42\",\"door\"]]}");
+  model.strings[SETTING_MQTT_TOPIC_PATTERN] = "dash/+/pressed";
+  model.macs.push_back(macOf(0x42));
+  model.aliases.push_back("door");
+
+  const SettingsArena& source = settings.getArena();
+  const uint8_t* block = source.macs() - ((SETTINGS_NUM_STRING_FIELDS + 1) * sizeof(uint16_t));
+  std::vector<uint8_t> image(block, block + source.size());
+
+  SettingsArena loaded;
+  loaded.load_P(image.data(), image.size(), SETTINGS_NUM_STRING_FIELDS, 1);
+
+  for (size_t i = 0; i < SETTINGS_NUM_STRING_FIELDS; i++) {
+    TEST_ASSERT_EQUAL_STRING(model.strings[i].c_str(), loaded.string(i));
+  }
+  TEST_ASSERT_EQUAL_MEMORY(model.macs[0].data(), loaded.mac(0), 6);
+  TEST_ASSERT_EQUAL_STRING("door", loaded.alias(0));
+}
+
+static std::string patchFor(const Model& model, const size_t changed, const bool withDevices, std::mt19937& rng) {
+  std::string json = "{";
+  char mac[25];
+
+  // Only some fields, so the rest come from the old block.
+  for (size_t i = 0; i < SETTINGS_NUM_STRING_FIELDS; i++) {
+    if (i == changed || rng() % 3 == 0) {
+      json += "\"";
+      json += Settings::FIELD_KEYS[i];
+      json += "\":\"" + model.strings[i] + "\",";
+    }
+  }
+
+  json += "\"debounce_threshold_ms\":" + std::to_string(rng() % 5000);
+
+  if (withDevices) {
+    json += ",\"monitored_macs\":[";
+    for (size_t i = 0; i < model.aliases.size(); i++) {
+      Settings::formatMac(model.macs[i].data(), mac);
+      json += std::string(i > 0 ? "," : "") + "[\"" + mac + "\",\"" + model.aliases[i] + "\"]";
+    }
+    json += "]";
+  }
+
+  return json + "}";
+}
+
+// Repeated PUT /settings and device adds/removes through Settings. After each
+// change only the new block is left, and on the way the old and new blocks
+// are the only things live at once.
+void test_soak() {
+  const size_t numChanges = 20000;
+  std::mt19937 rng(7);
+  TestSettings* settings = new TestSettings();
+  Model model = defaults();
+  size_t maxPeak = 0;
+  size_t minSize = SIZE_MAX;
+  size_t maxSize = 0;
+
+  for (size_t n = 0; n < numChanges; n++) {
+    const size_t op = rng() % 5;
+    const size_t oldSize = settings->arenaSize();
+    // Kept out here so they're still allocated when the change is measured.
+    std::string json;
+    std::vector<uint8_t> mac;
+    size_t before;
+
+    if (op <= 1 || model.aliases.empty()) {
+      // PUT /settings, sometimes with the device table.
+      const size_t changed = rng() % SETTINGS_NUM_STRING_FIELDS;
+      model.strings[changed] = std::string(rng() % 40, 'a' + (rng() % 26));
+      const bool withDevices = op == 1;
+
+      if (withDevices && !model.aliases.empty()) {
+        model.aliases[rng() % model.aliases.size()] = std::string(rng() % 20, 'p');
+      }
+
+      json = patchFor(model, changed, withDevices, rng);
+      DynamicJsonBuffer buffer;
+      JsonObject& parsed = buffer.parseObject(json.c_str());
+
+      before = ArduinoStub::heapUsed();
+      ArduinoStub::resetHeapPeak();
+      settings->patch(parsed);
+    } else if (op == 2 && model.aliases.size() < MAX_DEVICES) {
+      mac = macOf(0);
+      for (size_t i = 3; i < 6; i++) {
+        mac[i] = rng();
+      }
+
+      if (settings->findMonitoredMac(mac.data()) != -1) {
+        continue;
+      }
+      model.macs.push_back(mac);
+      model.aliases.push_back(std::string(rng() % 20, 'k'));
+
+      before = ArduinoStub::heapUsed();
+      ArduinoStub::resetHeapPeak();
+      settings->addMonitoredMac(mac.data(), model.aliases.back().c_str());
+    } else if (op == 3) {
+      const size_t ix = rng() % model.aliases.size();
+      mac = model.macs[ix];
+      model.macs.erase(model.macs.begin() + ix);
+      model.aliases.erase(model.aliases.begin() + ix);
+
+      before = ArduinoStub::heapUsed();
+      ArduinoStub::resetHeapPeak();
+      settings->removeMonitoredMac(mac.data());
+    } else {
+      const size_t ix = rng() % model.aliases.size();
+      model.aliases[ix] = std::string(rng() % 20, 'z');
+
+      before = ArduinoStub::heapUsed();
+      ArduinoStub::resetHeapPeak();
+      settings->addMonitoredMac(model.macs[ix].data(), model.aliases[ix].c_str());
+    }
+
+    const size_t peak = ArduinoStub::heapPeak() - before;
+
+    // The old block is given back, nothing else is kept.
+    TEST_ASSERT_EQUAL(before - oldSize + settings->arenaSize(), ArduinoStub::heapUsed());
+    TEST_ASSERT_LESS_OR_EQUAL(settings->arenaSize() + REBUILD_SLACK, peak);
+
+    maxPeak = std::max(maxPeak, peak);
+    minSize = std::min(minSize, settings->arenaSize());
+    maxSize = std::max(maxSize, settings->arenaSize());
+  }
+
+  assertMatches(*settings, model);
+
+  const size_t before = ArduinoStub::heapUsed();
+  const size_t size = settings->arenaSize();
+  delete settings;
+  TEST_ASSERT_EQUAL(before - size - sizeof(TestSettings), ArduinoStub::heapUsed());
+
+  char message[128];
+  snprintf(message, sizeof(message), "%u changes, blocks of %u to %u bytes, peak heap %u bytes over what was in use",
+    static_cast<unsigned>(numChanges), static_cast<unsigned>(minSize), static_cast<unsigned>(maxSize),
+    static_cast<unsigned>(maxPeak));
+  TEST_MESSAGE(message);
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_layout);
+  RUN_TEST(test_patch_keeps_unchanged_values);
+  RUN_TEST(test_set_if_present);
+  RUN_TEST(test_device_source);
+  RUN_TEST(test_add_remove_devices);
+  RUN_TEST(test_load_image);
+  RUN_TEST(test_soak);
+  return UNITY_END();
+}
@@ -0,0 +1,115 @@
+#include <unity.h>
+#include <TaskScheduler.h>
+#include <TaskScheduler.cpp>
+#include <string>
+
+static std::string ran;
+
+void setUp() {
+  ArduinoStub::setMillis(1000);
+  ran.clear();
+}
+
+void tearDown() { }
+
+void test_runs_in_priority_order() {
+  TaskScheduler scheduler;
+
+  scheduler.addTask("maintenance", TASK_PRIORITY_MAINTENANCE, 100, 1000, []() { ran += "m"; });
+  scheduler.addTask("network", TASK_PRIORITY_NETWORK, 100, 1000, []() { ran += "n"; });
+  scheduler.addTask("capture", TASK_PRIORITY_CAPTURE, 100, 1000, []() { ran += "c"; });
+
+  scheduler.loop();
+  TEST_ASSERT_EQUAL_STRING("cnm", ran.c_str());
+}
+
+// Nothing due: sleeps until the next deadline, and not past it.
+void test_sleeps_until_next_deadline() {
+  TaskScheduler scheduler;
+
+  scheduler.addTask("a", TASK_PRIORITY_NETWORK, 15, 1000, []() { ran += "a"; });
+  scheduler.loop();
+  TEST_ASSERT_EQUAL(1015, millis());
+  TEST_ASSERT_EQUAL(15, scheduler.sleptMillis());
+
+  scheduler.loop();
+  TEST_ASSERT_EQUAL_STRING("aa", ran.c_str());
+
+  // Capped, so work it can't be woken for doesn't wait long.
+  TaskScheduler idle;
+  idle.addTask("b", TASK_PRIORITY_MAINTENANCE, 1000, 1000, []() { });
+  idle.loop();
+  TEST_ASSERT_EQUAL(1015 + 15 + SCHEDULER_MAX_SLEEP, millis());
+}
+
+// A trigger from a lower priority task goes back to the top of the pass.
+void test_trigger_preempts_pass() {
+  TaskScheduler scheduler;
+  int capture = -1;
+
+  capture = scheduler.addTask("capture", TASK_PRIORITY_CAPTURE, 1000, 1000, []() { ran += "c"; });
+  scheduler.addTask("network", TASK_PRIORITY_NETWORK, 1000, 1000, [&scheduler, &capture]() {
+    ran += "n";
+    if (ran.size() < 4) {
+      scheduler.trigger(capture);
+    }
+  });
+  scheduler.addTask("maintenance", TASK_PRIORITY_MAINTENANCE, 1000, 1000, []() { ran += "m"; });
+
+  scheduler.loop();
+  TEST_ASSERT_EQUAL_STRING("cncm", ran.c_str());
+}
+
+// Regression: nextRun used to be set after the task ran, which pushed a
+// task that triggered itself back a whole interval.
+void test_self_trigger_runs_again() {
+  TaskScheduler scheduler;
+  int id = -1;
+  size_t remaining = 3;
+
+  id = scheduler.addTask("drain", TASK_PRIORITY_CAPTURE, 1000, 1000, [&scheduler, &id, &remaining]() {
+    ran += "d";
+    if (--remaining > 0) {
+      scheduler.trigger(id);
+    }
+  });
+
+  const unsigned long start = millis();
+  scheduler.loop();
+  TEST_ASSERT_EQUAL_STRING("ddd", ran.c_str());
+  TEST_ASSERT_EQUAL(start + 1000, scheduler.getTask(id).nextRun);
+}
+
+void test_overruns_counted() {
+  TaskScheduler scheduler;
+
+  const int id = scheduler.addTask("slow", TASK_PRIORITY_NETWORK, 10, 500, []() { ArduinoStub::advanceMicros(800); });
+  scheduler.loop();
+
+  const TaskStats& stats = scheduler.getTask(id).stats;
+  TEST_ASSERT_EQUAL(1, stats.runs);
+  TEST_ASSERT_EQUAL(1, stats.overruns);
+  TEST_ASSERT_EQUAL(800, stats.maxMicros);
+}
+
+void test_full() {
+  TaskScheduler scheduler;
+
+  for (size_t i = 0; i < SCHEDULER_MAX_TASKS; i++) {
+    TEST_ASSERT_EQUAL(i, scheduler.addTask("t", TASK_PRIORITY_NETWORK, 10, 10, []() { }));
+  }
+
+  TEST_ASSERT_EQUAL(-1, scheduler.addTask("extra", TASK_PRIORITY_NETWORK, 10, 10, []() { }));
+  TEST_ASSERT_EQUAL(SCHEDULER_MAX_TASKS, scheduler.numTasks());
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_runs_in_priority_order);
+  RUN_TEST(test_sleeps_until_next_deadline);
+  RUN_TEST(test_trigger_preempts_pass);
+  RUN_TEST(test_self_trigger_runs_again);
+  RUN_TEST(test_overruns_counted);
+  RUN_TEST(test_full);
+  return UNITY_END();
+}
@@ -0,0 +1,201 @@
+#include <unity.h>
+#include <TopicTrie.h>
+#include <TopicTrie.cpp>
+#include <string>
+#include <vector>
+
+// What the last handler to run was given.
+static std::string handled;
+static std::vector<std::string> wildcards;
+static std::string rest;
+static bool hadRest;
+
+static TopicHandler record(const char* name) {
+  return [name](const TopicMatch& match, const uint8_t* payload, const size_t length) {
+    handled = name;
+    wildcards.clear();
+    for (size_t i = 0; i < match.numWildcards; i++) {
+      wildcards.push_back(match.wildcards[i]);
+    }
+    hadRest = match.rest != NULL;
+    rest = hadRest ? match.rest : "";
+  };
+}
+
+static bool dispatch(TopicTrie& trie, const char* topic) {
+  handled.clear();
+  return trie.dispatch(topic, reinterpret_cast<const uint8_t*>("x"), 1);
+}
+
+void setUp() {
+  handled.clear();
+  wildcards.clear();
+  rest.clear();
+  hadRest = false;
+}
+
+void tearDown() { }
+
+void test_exact() {
+  TopicTrie trie;
+  trie.on("dash_stadium/commands/restart", record("restart"));
+
+  TEST_ASSERT_TRUE(dispatch(trie, "dash_stadium/commands/restart"));
+  TEST_ASSERT_EQUAL_STRING("restart", handled.c_str());
+  TEST_ASSERT_EQUAL(0, wildcards.size());
+  TEST_ASSERT_FALSE(hadRest);
+
+  TEST_ASSERT_FALSE(dispatch(trie, "dash_stadium/commands"));
+  TEST_ASSERT_FALSE(dispatch(trie, "dash_stadium/commands/restart/now"));
+  TEST_ASSERT_FALSE(dispatch(trie, "dash_stadium/commands/restar"));
+}
+
+void test_single_level_captures_in_order() {
+  TopicTrie trie;
+  trie.on("dash_stadium/+/devices/+/set", record("set"));
+
+  TEST_ASSERT_TRUE(dispatch(trie, "dash_stadium/node1/devices/44:65:0D:01:02:03/set"));
+  TEST_ASSERT_EQUAL_STRING("set", handled.c_str());
+  TEST_ASSERT_EQUAL(2, wildcards.size());
+  TEST_ASSERT_EQUAL_STRING("node1", wildcards[0].c_str());
+  TEST_ASSERT_EQUAL_STRING("44:65:0D:01:02:03", wildcards[1].c_str());
+
+  // Only ever one level.
+  TEST_ASSERT_FALSE(dispatch(trie, "dash_stadium/node1/devices/a/b/set"));
+}
+
+// A branch that fails further down gives back what it captured.
+void test_failed_branch_drops_its_captures() {
+  TopicTrie trie;
+  trie.on("a/+/+/x", record("plus"));
+  trie.on("a/b/c/y", record("exact"));
+
+  TEST_ASSERT_TRUE(dispatch(trie, "a/b/c/x"));
+  TEST_ASSERT_EQUAL_STRING("plus", handled.c_str());
+  TEST_ASSERT_EQUAL(2, wildcards.size());
+  TEST_ASSERT_EQUAL_STRING("b", wildcards[0].c_str());
+  TEST_ASSERT_EQUAL_STRING("c", wildcards[1].c_str());
+}
+
+void test_multi_level_matches_rest() {
+  TopicTrie trie;
+  trie.on("dash_stadium/config/#", record("config"));
+
+  TEST_ASSERT_TRUE(dispatch(trie, "dash_stadium/config/devices/0/alias"));
+  TEST_ASSERT_EQUAL_STRING("config", handled.c_str());
+  TEST_ASSERT_TRUE(hadRest);
+  TEST_ASSERT_EQUAL_STRING("devices/0/alias", rest.c_str());
+
+  TEST_ASSERT_TRUE(dispatch(trie, "dash_stadium/config/x"));
+  TEST_ASSERT_EQUAL_STRING("x", rest.c_str());
+
+  TEST_ASSERT_FALSE(dispatch(trie, "dash_stadium/other/x"));
+}
+
+// MQTT has "a/#" match "a" as well.
+void test_multi_level_matches_parent() {
+  TopicTrie trie;
+  trie.on("dash_stadium/config/#", record("config"));
+
+  TEST_ASSERT_TRUE(dispatch(trie, "dash_stadium/config"));
+  TEST_ASSERT_EQUAL_STRING("config", handled.c_str());
+  TEST_ASSERT_TRUE(hadRest);
+  TEST_ASSERT_EQUAL_STRING("", rest.c_str());
+
+  TEST_ASSERT_FALSE(dispatch(trie, "dash_stadium"));
+
+  // A handler on the parent itself comes first.
+  trie.on("dash_stadium/config", record("parent"));
+  TEST_ASSERT_TRUE(dispatch(trie, "dash_stadium/config"));
+  TEST_ASSERT_EQUAL_STRING("parent", handled.c_str());
+  TEST_ASSERT_FALSE(hadRest);
+}
+
+void test_exact_takes_precedence() {
+  TopicTrie trie;
+  // Added wildcards first so order of insertion isn't what decides.
+  trie.on("a/#", record("multi"));
+  trie.on("a/+/c", record("single"));
+  trie.on("a/b/c", record("exact"));
+
+  TEST_ASSERT_TRUE(dispatch(trie, "a/b/c"));
+  TEST_ASSERT_EQUAL_STRING("exact", handled.c_str());
+
+  TEST_ASSERT_TRUE(dispatch(trie, "a/z/c"));
+  TEST_ASSERT_EQUAL_STRING("single", handled.c_str());
+
+  // Falls back past the exact branch when it goes nowhere.
+  TEST_ASSERT_TRUE(dispatch(trie, "a/b/d"));
+  TEST_ASSERT_EQUAL_STRING("multi", handled.c_str());
+  TEST_ASSERT_EQUAL_STRING("b/d", rest.c_str());
+}
+
+void test_empty_levels() {
+  TopicTrie trie;
+  trie.on("a/+/b", record("single"));
+  trie.on("c/#", record("multi"));
+
+  // "+" matches an empty level, as in MQTT.
+  TEST_ASSERT_TRUE(dispatch(trie, "a//b"));
+  TEST_ASSERT_EQUAL_STRING("single", handled.c_str());
+  TEST_ASSERT_EQUAL(1, wildcards.size());
+  TEST_ASSERT_EQUAL_STRING("", wildcards[0].c_str());
+
+  TEST_ASSERT_TRUE(dispatch(trie, "c//d"));
+  TEST_ASSERT_EQUAL_STRING("/d", rest.c_str());
+
+  // An empty level is still a level.
+  TEST_ASSERT_FALSE(dispatch(trie, "a/b"));
+}
+
+// A trailing "/" adds an empty last level.
+void test_trailing_slash() {
+  TopicTrie trie;
+  trie.on("a/b", record("exact"));
+  trie.on("a/b/+", record("single"));
+
+  TEST_ASSERT_TRUE(dispatch(trie, "a/b"));
+  TEST_ASSERT_EQUAL_STRING("exact", handled.c_str());
+
+  TEST_ASSERT_TRUE(dispatch(trie, "a/b/"));
+  TEST_ASSERT_EQUAL_STRING("single", handled.c_str());
+  TEST_ASSERT_EQUAL(1, wildcards.size());
+  TEST_ASSERT_EQUAL_STRING("", wildcards[0].c_str());
+
+  TopicTrie multi;
+  multi.on("a/#", record("multi"));
+  TEST_ASSERT_TRUE(dispatch(multi, "a/b/"));
+  TEST_ASSERT_EQUAL_STRING("b/", rest.c_str());
+}
+
+void test_limits() {
+  TopicTrie trie;
+  trie.on("#", record("all"));
+
+  TEST_ASSERT_TRUE(dispatch(trie, "a/b/c"));
+  TEST_ASSERT_EQUAL_STRING("a/b/c", rest.c_str());
+
+  std::string deep = "a";
+  for (size_t i = 1; i < TOPIC_TRIE_MAX_DEPTH; i++) {
+    deep += "/a";
+  }
+  TEST_ASSERT_TRUE(dispatch(trie, deep.c_str()));
+  TEST_ASSERT_FALSE(dispatch(trie, (deep + "/a").c_str()));
+
+  const std::string longTopic(TOPIC_TRIE_MAX_TOPIC_LENGTH, 'a');
+  TEST_ASSERT_FALSE(dispatch(trie, longTopic.c_str()));
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_exact);
+  RUN_TEST(test_single_level_captures_in_order);
+  RUN_TEST(test_failed_branch_drops_its_captures);
+  RUN_TEST(test_multi_level_matches_rest);
+  RUN_TEST(test_multi_level_matches_parent);
+  RUN_TEST(test_exact_takes_precedence);
+  RUN_TEST(test_empty_levels);
+  RUN_TEST(test_trailing_slash);
+  RUN_TEST(test_limits);
+  return UNITY_END();
+}
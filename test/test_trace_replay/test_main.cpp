@@ -0,0 +1,658 @@
+#include <unity.h>
+#include <CountingHeap.h>
+#include <ArduinoJson.h>
+#include <Settings.h>
+#include <Settings.cpp>
+#include <SettingsArena.cpp>
+#include <JsonStreamWriter.cpp>
+#include <EventPipeline.h>
+#include <EventPipeline.cpp>
+#include <DeviceDiscovery.cpp>
+#include <WarmState.cpp>
+#include <CaptureQueue.cpp>
+#include <DeviceRenderCache.cpp>
+#include <BufferedClient.cpp>
+#include <algorithm>
+#include <vector>
+
+// Replays 802.11 traffic through the capture queue, the event pipeline and the
+// publish path, with a recording broker on the other end of the connection.
+// A capture is replayed with its own timing:
+//
+//   DASH_REPLAY_TRACE=capture.pcap pio test -e native -f test_trace_replay
+//
+// Without one, a synthetic trace is generated and replayed.
+//
+// Time on the host says nothing about time on the node, so each step charges
+// its cost to the virtual clock. These are estimates for an ESP8266 at 80MHz;
+// override them to see where the capture queue starts dropping.
+#ifndef REPLAY_EVENT_MICROS
+#define REPLAY_EVENT_MICROS 150
+#endif
+
+#ifndef REPLAY_PUBLISH_MICROS
+#define REPLAY_PUBLISH_MICROS 400
+#endif
+
+// What the rest of the loop takes before the capture task gets another pass.
+#ifndef REPLAY_LOOP_MICROS
+#define REPLAY_LOOP_MICROS 1000
+#endif
+
+// As in main.cpp and MqttClient.h.
+#define CAPTURE_DRAIN_BUDGET_US 2000
+#define DASH_MQTT_PAYLOAD "1"
+#define REPLAY_MAX_PACKET_SIZE 256
+
+// The most frequent senders in a trace are the ones monitored.
+#define REPLAY_NUM_DEVICES 8
+#define REPLAY_DEBOUNCE_MS 1000
+
+#define LINKTYPE_IEEE802_11 105
+#define LINKTYPE_RADIOTAP 127
+
+// Harness memory comes from malloc, so only what the node allocates is counted.
+template <typename T>
+struct HostAllocator {
+  typedef T value_type;
+
+  HostAllocator() { }
+  template <typename U> HostAllocator(const HostAllocator<U>&) { }
+
+  T* allocate(const size_t n) { return static_cast<T*>(malloc(n * sizeof(T))); }
+  void deallocate(T* p, const size_t) { free(p); }
+};
+
+template <typename T, typename U>
+bool operator==(const HostAllocator<T>&, const HostAllocator<U>&) { return true; }
+template <typename T, typename U>
+bool operator!=(const HostAllocator<T>&, const HostAllocator<U>&) { return false; }
+
+template <typename T>
+using HostVector = std::vector<T, HostAllocator<T> >;
+
+struct Frame {
+  // Since the first frame in the trace.
+  uint64_t micros;
+  uint8_t mac[6];
+  uint8_t type;
+};
+
+struct Publish {
+  uint64_t capturedAt;
+  size_t deviceIx;
+  uint8_t type;
+};
+
+struct ReplayResult {
+  size_t frames;
+  uint64_t durationMicros;
+  uint32_t dropped;
+  uint32_t received;
+  uint32_t transportWrites;
+  uint32_t maxEventsPerSecond;
+  uint32_t p50Micros;
+  uint32_t p99Micros;
+  uint32_t maxMicros;
+  size_t heapAtStart;
+  size_t heapPeak;
+  EventPipelineStats stats;
+};
+
+void setUp() {
+  ArduinoStub::setMillis(1000);
+}
+
+void tearDown() { }
+
+static uint32_t readUint32(const uint8_t* p, const bool bigEndian) {
+  return bigEndian
+    ? (static_cast<uint32_t>(p[0]) << 24) | (p[1] << 16) | (p[2] << 8) | p[3]
+    : (static_cast<uint32_t>(p[3]) << 24) | (p[2] << 16) | (p[1] << 8) | p[0];
+}
+
+// Probe requests and association requests from a pcap of 802.11 frames, raw
+// or with radiotap headers. Same as .replay_trace.py.
+static bool readPcap(FILE* f, HostVector<Frame>& frames) {
+  uint8_t header[24];
+
+  if (fread(header, 1, sizeof(header), f) != sizeof(header)) {
+    return false;
+  }
+
+  const uint32_t magic = readUint32(header, false);
+  bool bigEndian;
+  bool nanos;
+
+  if (magic == 0xa1b2c3d4 || magic == 0xa1b23c4d) {
+    bigEndian = false;
+    nanos = magic == 0xa1b23c4d;
+  } else if (magic == 0xd4c3b2a1 || magic == 0x4d3cb2a1) {
+    bigEndian = true;
+    nanos = magic == 0x4d3cb2a1;
+  } else {
+    return false;
+  }
+
+  const uint32_t linkType = readUint32(header + 20, bigEndian);
+  if (linkType != LINKTYPE_IEEE802_11 && linkType != LINKTYPE_RADIOTAP) {
+    return false;
+  }
+
+  uint8_t record[16];
+  HostVector<uint8_t> data;
+  uint64_t first = 0;
+
+  while (fread(record, 1, sizeof(record), f) == sizeof(record)) {
+    const uint32_t length = readUint32(record + 8, bigEndian);
+    const uint64_t frac = readUint32(record + 4, bigEndian);
+    const uint64_t timestamp = (readUint32(record, bigEndian) * 1000000ULL) + (nanos ? frac / 1000 : frac);
+
+    data.resize(length);
+    if (fread(data.data(), 1, length, f) != length) {
+      break;
+    }
+
+    const uint8_t* frame = data.data();
+    size_t frameLength = length;
+
+    if (linkType == LINKTYPE_RADIOTAP) {
+      // Radiotap is little endian whatever the capture is.
+      const size_t radiotapLength = frameLength >= 4 ? (frame[2] | (frame[3] << 8)) : frameLength;
+      frame += std::min(radiotapLength, frameLength);
+      frameLength -= std::min(radiotapLength, frameLength);
+    }
+
+    if (frameLength < 16) {
+      continue;
+    }
+
+    const uint8_t frameType = (frame[0] >> 2) & 0x3;
+    const uint8_t subtype = (frame[0] >> 4) & 0xF;
+    Frame parsed;
+
+    if (frameType == 0 && subtype == 4) {
+      parsed.type = DASH_EVENT_PROBE_REQUEST;
+    } else if (frameType == 0 && subtype == 0) {
+      parsed.type = DASH_EVENT_CONNECTED;
+    } else {
+      continue;
+    }
+
+    if (frames.empty()) {
+      first = timestamp;
+    }
+
+    parsed.micros = timestamp > first ? timestamp - first : 0;
+    memcpy(parsed.mac, frame + 10, 6);
+    frames.push_back(parsed);
+  }
+
+  return true;
+}
+
+static void writeUint32(FILE* f, const uint32_t value) {
+  fwrite(&value, sizeof(value), 1, f);
+}
+
+// Little endian, microsecond timestamps, radiotap headers with no fields.
+static void writePcap(FILE* f, const HostVector<Frame>& frames) {
+  writeUint32(f, 0xa1b2c3d4);
+  writeUint32(f, 0x00040002);
+  writeUint32(f, 0);
+  writeUint32(f, 0);
+  writeUint32(f, 65535);
+  writeUint32(f, LINKTYPE_RADIOTAP);
+
+  for (size_t i = 0; i < frames.size(); i++) {
+    uint8_t packet[8 + 24] = {0, 0, 8, 0};
+    uint8_t* frame = packet + 8;
+
+    frame[0] = frames[i].type == DASH_EVENT_PROBE_REQUEST ? 0x40 : 0x00;
+    memset(frame + 4, 0xFF, 6);
+    memcpy(frame + 10, frames[i].mac, 6);
+
+    writeUint32(f, frames[i].micros / 1000000);
+    writeUint32(f, frames[i].micros % 1000000);
+    writeUint32(f, sizeof(packet));
+    writeUint32(f, sizeof(packet));
+    fwrite(packet, 1, sizeof(packet), f);
+  }
+}
+
+static void addFrame(HostVector<Frame>& frames, const uint64_t micros, const uint8_t* mac, const DashEventType type) {
+  Frame frame;
+  frame.micros = micros;
+  memcpy(frame.mac, mac, 6);
+  frame.type = type;
+  frames.push_back(frame);
+}
+
+static bool byTime(const Frame& a, const Frame& b) {
+  return a.micros < b.micros;
+}
+
+// Two minutes of a busy room: dash buttons pressed now and then (a burst of
+// probes, then an association), phones probing in short bursts, and a crowd
+// arriving all at once half way through.
+static void syntheticTrace(HostVector<Frame>& frames) {
+  std::mt19937 rng(26);
+  const uint64_t duration = 120 * 1000000ULL;
+  uint8_t mac[6] = {0x44, 0x65, 0x0D, 0, 0, 0};
+
+  for (size_t i = 0; i < REPLAY_NUM_DEVICES; i++) {
+    mac[5] = i;
+
+    for (uint64_t t = rng() % 20000000; t < duration; t += 20000000 + rng() % 20000000) {
+      for (size_t j = 0; j < 12; j++) {
+        addFrame(frames, t + (j * 5000) + rng() % 2000, mac, DASH_EVENT_PROBE_REQUEST);
+      }
+      addFrame(frames, t + 80000, mac, DASH_EVENT_CONNECTED);
+    }
+  }
+
+  // Locally administered, so they can't collide with a button.
+  mac[0] = 0x02;
+
+  for (size_t i = 0; i < 300; i++) {
+    mac[3] = i >> 8;
+    mac[4] = i & 0xFF;
+
+    for (uint64_t t = rng() % 60000000; t < duration; t += 10000000 + rng() % 50000000) {
+      for (size_t j = 0; j < 4; j++) {
+        addFrame(frames, t + (j * 5000), mac, DASH_EVENT_PROBE_REQUEST);
+      }
+    }
+  }
+
+  mac[3] = 0xFF;
+
+  for (size_t i = 0; i < 600; i++) {
+    mac[4] = i >> 8;
+    mac[5] = i & 0xFF;
+    addFrame(frames, (duration / 2) + rng() % 100000, mac, DASH_EVENT_PROBE_REQUEST);
+  }
+
+  std::sort(frames.begin(), frames.end(), byTime);
+}
+
+static uint64_t macKey(const uint8_t* mac) {
+  uint64_t key = 0;
+  for (size_t i = 0; i < 6; i++) {
+    key = (key << 8) | mac[i];
+  }
+  return key;
+}
+
+static bool byCount(const std::pair<uint32_t, uint64_t>& a, const std::pair<uint32_t, uint64_t>& b) {
+  return a.first != b.first ? a.first > b.first : a.second < b.second;
+}
+
+static void monitorTopSenders(Settings& settings, const HostVector<Frame>& frames) {
+  HostVector<uint64_t> macs;
+  HostVector<std::pair<uint32_t, uint64_t> > senders;
+
+  for (size_t i = 0; i < frames.size(); i++) {
+    macs.push_back(macKey(frames[i].mac));
+  }
+  std::sort(macs.begin(), macs.end());
+
+  for (size_t i = 0; i < macs.size(); i++) {
+    if (senders.empty() || senders.back().second != macs[i]) {
+      senders.push_back(std::make_pair(0, macs[i]));
+    }
+    senders.back().first++;
+  }
+  std::sort(senders.begin(), senders.end(), byCount);
+
+  std::string json = "{\"mqtt_topic_pattern\":\"dash_stadium/:device_alias/:event_type\",\"debounce_threshold_ms\":";
+  json += std::to_string(REPLAY_DEBOUNCE_MS) + ",\"monitored_macs\":[";
+
+  for (size_t i = 0; i < std::min(senders.size(), static_cast<size_t>(REPLAY_NUM_DEVICES)); i++) {
+    char entry[48];
+    const uint64_t key = senders[i].second;
+
+    snprintf(entry, sizeof(entry), "%s[\"%02X:%02X:%02X:%02X:%02X:%02X\",\"device %u\"]", i > 0 ? "," : "",
+      static_cast<unsigned>((key >> 40) & 0xFF), static_cast<unsigned>((key >> 32) & 0xFF),
+      static_cast<unsigned>((key >> 24) & 0xFF), static_cast<unsigned>((key >> 16) & 0xFF),
+      static_cast<unsigned>((key >> 8) & 0xFF), static_cast<unsigned>(key & 0xFF), static_cast<unsigned>(i));
+    json += entry;
+  }
+  json += "]}";
+
+  DynamicJsonBuffer buffer;
+  JsonObject& parsed = buffer.parseObject(json.c_str());
+  TEST_ASSERT_TRUE(parsed.success());
+  settings.patch(parsed);
+}
+
+// Reads the PUBLISH packets off the connection, and when each one arrives
+// checks it against what was published and takes its latency.
+class Broker : public Client {
+public:
+  Broker(const HostVector<Publish>& sent, const DeviceRenderCache& cache, HostVector<uint32_t>& latencies)
+    : received(0), writes(0), sent(sent), cache(cache), latencies(latencies)
+  { }
+
+  virtual int connect(IPAddress ip, uint16_t port) override { return 1; }
+  virtual int connect(const char* host, uint16_t port) override { return 1; }
+  virtual size_t write(uint8_t b) override { return write(&b, 1); }
+
+  // BufferedClient only ever sends whole packets.
+  virtual size_t write(const uint8_t* buf, size_t size) override {
+    size_t pos = 0;
+    writes++;
+
+    while (pos < size) {
+      TEST_ASSERT_EQUAL(0x30, buf[pos++]);
+
+      size_t remaining = 0;
+      size_t shift = 0;
+      uint8_t b;
+      do {
+        b = buf[pos++];
+        remaining |= (b & 0x7F) << shift;
+        shift += 7;
+      } while (b & 0x80);
+
+      const size_t topicLength = (buf[pos] << 8) | buf[pos + 1];
+      TEST_ASSERT_LESS_THAN(sent.size(), received);
+
+      const Publish& publish = sent[received++];
+      const char* topic = cache.topic(publish.deviceIx, static_cast<DashEventType>(publish.type));
+      TEST_ASSERT_EQUAL(strlen(topic), topicLength);
+      TEST_ASSERT_EQUAL_MEMORY(topic, buf + pos + 2, topicLength);
+
+      latencies.push_back(ArduinoStub::clockMicros() - publish.capturedAt);
+      pos += remaining;
+    }
+
+    TEST_ASSERT_EQUAL(size, pos);
+    return size;
+  }
+
+  virtual int available() override { return 0; }
+  virtual int read() override { return -1; }
+  virtual int read(uint8_t* buf, size_t size) override { return 0; }
+  virtual int peek() override { return -1; }
+  virtual bool flush(unsigned int maxWaitMs = 0) override { return true; }
+  virtual bool stop(unsigned int maxWaitMs = 0) override { return true; }
+  virtual uint8_t connected() override { return 1; }
+  virtual operator bool() override { return true; }
+
+  size_t received;
+  size_t writes;
+
+private:
+  const HostVector<Publish>& sent;
+  const DeviceRenderCache& cache;
+  HostVector<uint32_t>& latencies;
+};
+
+// A QoS 0 PUBLISH as PubSubClient builds it, in one write.
+static size_t encodePublish(uint8_t* packet, const char* topic, const char* payload) {
+  const size_t topicLength = strlen(topic);
+  const size_t payloadLength = strlen(payload);
+  size_t remaining = 2 + topicLength + payloadLength;
+  size_t pos = 0;
+
+  TEST_ASSERT_LESS_OR_EQUAL(REPLAY_MAX_PACKET_SIZE, remaining + 5);
+
+  packet[pos++] = 0x30;
+  do {
+    packet[pos] = remaining & 0x7F;
+    remaining >>= 7;
+    packet[pos++] |= remaining > 0 ? 0x80 : 0;
+  } while (remaining > 0);
+
+  packet[pos++] = topicLength >> 8;
+  packet[pos++] = topicLength & 0xFF;
+  memcpy(packet + pos, topic, topicLength);
+  pos += topicLength;
+  memcpy(packet + pos, payload, payloadLength);
+
+  return pos + payloadLength;
+}
+
+static uint32_t percentile(HostVector<uint32_t>& values, const size_t p) {
+  if (values.empty()) {
+    return 0;
+  }
+
+  const size_t ix = std::min(values.size() - 1, (values.size() * p) / 100);
+  std::nth_element(values.begin(), values.begin() + ix, values.end());
+  return values[ix];
+}
+
+// Frames go into the capture queue as they're captured, and the capture task
+// drains it the way drainCaptureQueue() does in main.cpp.
+static ReplayResult replay(const HostVector<Frame>& frames) {
+  Settings settings;
+  monitorTopSenders(settings, frames);
+
+  EventPipeline pipeline(settings);
+  DeviceRenderCache cache;
+  CaptureQueue queue;
+  pipeline.resetDevices();
+  cache.rebuild(settings);
+
+  const uint64_t start = ArduinoStub::clockMicros();
+  const size_t seconds = (frames.empty() ? 0 : frames.back().micros / 1000000) + 1;
+
+  HostVector<Publish> sent;
+  HostVector<uint32_t> latencies;
+  HostVector<uint32_t> perSecond(seconds + 1, 0);
+  HostVector<unsigned long> lastPublished(REPLAY_NUM_DEVICES * DASH_NUM_EVENT_TYPES, 0);
+  sent.reserve(frames.size());
+  latencies.reserve(frames.size());
+
+  Broker broker(sent, cache, latencies);
+  BufferedClient client(broker);
+  client.connect("broker", 1883);
+
+  // Capture times of what's in the queue, in lockstep with it.
+  uint64_t queuedAt[CAPTURE_QUEUE_SIZE];
+  size_t queuedHead = 0;
+  size_t queuedTail = 0;
+  uint64_t capturedAt = 0;
+  size_t next = 0;
+
+  pipeline.onDeviceEvent([&](const DashEventType type, const uint8_t* mac, const size_t deviceIx, const int8_t rssi) {
+    unsigned long& last = lastPublished[(deviceIx * DASH_NUM_EVENT_TYPES) + type];
+    TEST_ASSERT_TRUE(last == 0 || (millis() - last) > REPLAY_DEBOUNCE_MS);
+    last = millis();
+
+    uint8_t packet[REPLAY_MAX_PACKET_SIZE];
+    const size_t length = encodePublish(packet, cache.topic(deviceIx, type), DASH_MQTT_PAYLOAD);
+
+    ArduinoStub::advanceMicros(REPLAY_PUBLISH_MICROS);
+    Publish publish = {capturedAt, deviceIx, static_cast<uint8_t>(type)};
+    sent.push_back(publish);
+    TEST_ASSERT_EQUAL(length, client.write(packet, length));
+  });
+
+  // What the WiFi callbacks would have pushed by now.
+  auto capture = [&]() {
+    while (next < frames.size() && start + frames[next].micros <= ArduinoStub::clockMicros()) {
+      if (queue.push(static_cast<DashEventType>(frames[next].type), frames[next].mac, 0)) {
+        queuedAt[queuedHead++ % CAPTURE_QUEUE_SIZE] = start + frames[next].micros;
+      }
+      next++;
+    }
+  };
+
+  ArduinoStub::resetHeapPeak();
+  const size_t heapAtStart = ArduinoStub::heapUsed();
+
+  while (next < frames.size() || queue.size() > 0) {
+    if (queue.size() == 0 && start + frames[next].micros > ArduinoStub::clockMicros()) {
+      ArduinoStub::advanceMicros(start + frames[next].micros - ArduinoStub::clockMicros());
+    }
+    capture();
+
+    const uint32_t passStart = micros();
+    CapturedEvent event;
+
+    while ((micros() - passStart) < CAPTURE_DRAIN_BUDGET_US && queue.pop(event)) {
+      capturedAt = queuedAt[queuedTail++ % CAPTURE_QUEUE_SIZE];
+      ArduinoStub::advanceMicros(REPLAY_EVENT_MICROS);
+      pipeline.triggerEvent(static_cast<DashEventType>(event.type), event.mac, event.rssi);
+      perSecond[std::min(seconds, static_cast<size_t>((ArduinoStub::clockMicros() - start) / 1000000))]++;
+      capture();
+    }
+
+    client.flushBuffer();
+
+    if (queue.size() > 0) {
+      ArduinoStub::advanceMicros(REPLAY_LOOP_MICROS);
+    }
+  }
+
+  ReplayResult result;
+  result.frames = frames.size();
+  result.durationMicros = ArduinoStub::clockMicros() - start;
+  result.dropped = queue.dropped();
+  result.received = broker.received;
+  result.transportWrites = broker.writes;
+  result.maxEventsPerSecond = *std::max_element(perSecond.begin(), perSecond.end());
+  result.maxMicros = latencies.empty() ? 0 : *std::max_element(latencies.begin(), latencies.end());
+  result.p50Micros = percentile(latencies, 50);
+  result.p99Micros = percentile(latencies, 99);
+  result.heapAtStart = heapAtStart;
+  result.heapPeak = ArduinoStub::heapPeak();
+  result.stats = pipeline.getStats();
+
+  return result;
+}
+
+static void report(const char* name, const ReplayResult& result) {
+  const double seconds = result.durationMicros / 1e6;
+  char message[256];
+
+  snprintf(message, sizeof(message),
+    "%s: %u frames over %.1fs, %.0f events/s sustained, %u in the busiest second, %u dropped",
+    name, static_cast<unsigned>(result.frames), seconds, result.stats.events / seconds,
+    result.maxEventsPerSecond, result.dropped);
+  TEST_MESSAGE(message);
+
+  snprintf(message, sizeof(message),
+    "%u from monitored devices, %u debounced, %u published in %u writes; latency p50 %uus, p99 %uus, max %uus",
+    result.stats.monitoredEvents, result.stats.debouncedEvents, result.stats.publishedEvents,
+    result.transportWrites, result.p50Micros, result.p99Micros, result.maxMicros);
+  TEST_MESSAGE(message);
+
+  snprintf(message, sizeof(message), "heap %u bytes at start, high water mark %u, min free %u",
+    static_cast<unsigned>(result.heapAtStart), static_cast<unsigned>(result.heapPeak), result.stats.minFreeHeap);
+  TEST_MESSAGE(message);
+}
+
+static void assertConsistent(const ReplayResult& result) {
+  TEST_ASSERT_EQUAL(result.frames, result.stats.events + result.dropped);
+  TEST_ASSERT_EQUAL(result.stats.monitoredEvents, result.stats.publishedEvents + result.stats.debouncedEvents);
+  TEST_ASSERT_EQUAL(result.stats.publishedEvents, result.received);
+
+  // Nothing on the event path allocates.
+  TEST_ASSERT_EQUAL(result.heapAtStart, result.heapPeak);
+}
+
+void test_reads_raw_and_radiotap() {
+  HostVector<Frame> frames;
+  const uint8_t mac[6] = {0x44, 0x65, 0x0D, 1, 2, 3};
+
+  addFrame(frames, 0, mac, DASH_EVENT_PROBE_REQUEST);
+  addFrame(frames, 1500, mac, DASH_EVENT_CONNECTED);
+
+  FILE* f = tmpfile();
+  TEST_ASSERT_NOT_NULL(f);
+  writePcap(f, frames);
+
+  // A data frame, which isn't an event.
+  const uint8_t data[8 + 24] = {0, 0, 8, 0, 0, 0, 0, 0, 0x08};
+  writeUint32(f, 1);
+  writeUint32(f, 0);
+  writeUint32(f, sizeof(data));
+  writeUint32(f, sizeof(data));
+  fwrite(data, 1, sizeof(data), f);
+  rewind(f);
+
+  HostVector<Frame> read;
+  TEST_ASSERT_TRUE(readPcap(f, read));
+  fclose(f);
+
+  TEST_ASSERT_EQUAL(2, read.size());
+  TEST_ASSERT_EQUAL(DASH_EVENT_PROBE_REQUEST, read[0].type);
+  TEST_ASSERT_EQUAL(DASH_EVENT_CONNECTED, read[1].type);
+  TEST_ASSERT_EQUAL(1500, read[1].micros);
+  TEST_ASSERT_EQUAL_MEMORY(mac, read[1].mac, 6);
+
+  // Big endian, nanosecond timestamps, no radiotap.
+  const uint8_t bigEndian[] = {
+    0xa1, 0xb2, 0x3c, 0x4d, 0, 2, 0, 4, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xFF, 0xFF, 0, 0, 0, LINKTYPE_IEEE802_11,
+    0, 0, 0, 2, 0x00, 0x0F, 0x42, 0x40, 0, 0, 0, 24, 0, 0, 0, 24,
+    0x40, 0, 0, 0, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x44, 0x65, 0x0D, 1, 2, 3, 0, 0, 0, 0, 0, 0, 0, 0
+  };
+
+  f = tmpfile();
+  fwrite(bigEndian, 1, sizeof(bigEndian), f);
+  rewind(f);
+
+  read.clear();
+  TEST_ASSERT_TRUE(readPcap(f, read));
+  fclose(f);
+
+  TEST_ASSERT_EQUAL(1, read.size());
+  TEST_ASSERT_EQUAL(DASH_EVENT_PROBE_REQUEST, read[0].type);
+  TEST_ASSERT_EQUAL_MEMORY(mac, read[0].mac, 6);
+}
+
+void test_synthetic_trace() {
+  HostVector<Frame> generated;
+  syntheticTrace(generated);
+
+  // Through a file, same as a capture.
+  FILE* f = tmpfile();
+  TEST_ASSERT_NOT_NULL(f);
+  writePcap(f, generated);
+  rewind(f);
+
+  HostVector<Frame> frames;
+  TEST_ASSERT_TRUE(readPcap(f, frames));
+  fclose(f);
+  TEST_ASSERT_EQUAL(generated.size(), frames.size());
+
+  const ReplayResult result = replay(frames);
+  report("synthetic", result);
+  assertConsistent(result);
+
+  // A press is published once, and the rest of its burst debounced.
+  TEST_ASSERT_GREATER_THAN(0, result.stats.publishedEvents);
+  TEST_ASSERT_GREATER_THAN(0, result.stats.debouncedEvents);
+}
+
+void test_captured_trace() {
+  const char* path = getenv("DASH_REPLAY_TRACE");
+
+  if (path == NULL) {
+    TEST_IGNORE_MESSAGE("Set DASH_REPLAY_TRACE to a pcap to replay it");
+  }
+
+  FILE* f = fopen(path, "rb");
+  TEST_ASSERT_NOT_NULL(f);
+
+  HostVector<Frame> frames;
+  const bool parsed = readPcap(f, frames);
+  fclose(f);
+  TEST_ASSERT_TRUE(parsed);
+
+  const ReplayResult result = replay(frames);
+  report(path, result);
+  assertConsistent(result);
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_reads_raw_and_radiotap);
+  RUN_TEST(test_synthetic_trace);
+  RUN_TEST(test_captured_trace);
+  return UNITY_END();
+}
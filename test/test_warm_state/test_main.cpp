@@ -0,0 +1,155 @@
+#include <unity.h>
+#include <WarmState.h>
+#include <WarmState.cpp>
+#include <CaptureQueue.cpp>
+
+#define NUM_EVENT_TYPES 2
+#define BUFFER_SIZE 384
+
+static uint32_t buffer[BUFFER_SIZE / sizeof(uint32_t)];
+static uint8_t* bytes = reinterpret_cast<uint8_t*>(buffer);
+
+void setUp() {
+  memset(buffer, 0xA5, sizeof(buffer));
+}
+
+void tearDown() { }
+
+static WarmStateHeader makeHeader() {
+  WarmStateHeader header;
+  memset(&header, 0, sizeof(header));
+  header.devicesHash = 0x12345678;
+  header.events = 1000;
+  header.monitoredEvents = 100;
+  header.debouncedEvents = 40;
+  header.publishedEvents = 60;
+  return header;
+}
+
+void test_round_trip() {
+  const uint32_t ages[3 * NUM_EVENT_TYPES] = {0, 1, 500, UINT32_MAX, 42, 43};
+  WarmStateHeader header = makeHeader();
+
+  const size_t length = WarmState::encode(header, ages, 3, NUM_EVENT_TYPES, bytes, sizeof(buffer));
+  TEST_ASSERT_EQUAL(sizeof(WarmStateHeader) + sizeof(ages), length);
+  TEST_ASSERT_EQUAL(0, length % 4);
+
+  WarmStateHeader decoded;
+  const uint32_t* decodedAges;
+  TEST_ASSERT_TRUE(WarmState::decode(bytes, sizeof(buffer), NUM_EVENT_TYPES, decoded, decodedAges));
+  TEST_ASSERT_EQUAL(3, decoded.numDevices);
+  TEST_ASSERT_EQUAL(0x12345678, decoded.devicesHash);
+  TEST_ASSERT_EQUAL(1000, decoded.events);
+  TEST_ASSERT_EQUAL(60, decoded.publishedEvents);
+  TEST_ASSERT_EQUAL_MEMORY(ages, decodedAges, sizeof(ages));
+}
+
+void test_devices_that_dont_fit_are_left_out() {
+  uint32_t ages[100 * NUM_EVENT_TYPES];
+  memset(ages, 0, sizeof(ages));
+  WarmStateHeader header = makeHeader();
+
+  const size_t length = WarmState::encode(header, ages, 100, NUM_EVENT_TYPES, bytes, sizeof(buffer));
+  const size_t fitting = WarmState::maxDevices(sizeof(buffer), NUM_EVENT_TYPES);
+
+  TEST_ASSERT_LESS_THAN(100, fitting);
+  TEST_ASSERT_EQUAL(fitting, header.numDevices);
+  TEST_ASSERT_LESS_OR_EQUAL(sizeof(buffer), length);
+}
+
+void test_rejects_corruption() {
+  const uint32_t ages[NUM_EVENT_TYPES] = {1, 2};
+  WarmStateHeader header = makeHeader();
+  WarmStateHeader decoded;
+  const uint32_t* decodedAges;
+
+  const size_t length = WarmState::encode(header, ages, 1, NUM_EVENT_TYPES, bytes, sizeof(buffer));
+  bytes[length - 1] ^= 0x01;
+  TEST_ASSERT_FALSE(WarmState::decode(bytes, sizeof(buffer), NUM_EVENT_TYPES, decoded, decodedAges));
+
+  // What RTC memory holds after a power-on.
+  memset(buffer, 0xA5, sizeof(buffer));
+  TEST_ASSERT_FALSE(WarmState::decode(bytes, sizeof(buffer), NUM_EVENT_TYPES, decoded, decodedAges));
+}
+
+void test_pending_round_trip() {
+  CaptureQueue queue;
+  const uint8_t macs[3][6] = {{1, 2, 3, 4, 5, 6}, {1, 2, 3, 4, 5, 7}, {1, 2, 3, 4, 5, 8}};
+
+  for (size_t i = 0; i < 3; i++) {
+    queue.push(i == 1 ? DASH_EVENT_CONNECTED : DASH_EVENT_PROBE_REQUEST, macs[i], -40);
+  }
+
+  CapturedEvent events[CAPTURE_QUEUE_SIZE];
+  const size_t numEvents = queue.copyTo(events, CAPTURE_QUEUE_SIZE);
+  const size_t length = WarmState::encodePending(events, numEvents, bytes, sizeof(buffer));
+
+  TEST_ASSERT_EQUAL(3, numEvents);
+  TEST_ASSERT_EQUAL(0, length % 4);
+  TEST_ASSERT_GREATER_OR_EQUAL(sizeof(WarmStatePendingHeader) + (3 * sizeof(CapturedEvent)), length);
+
+  const CapturedEvent* decoded;
+  size_t numDecoded;
+  size_t decodedLength;
+  TEST_ASSERT_TRUE(WarmState::decodePending(bytes, sizeof(buffer), decoded, numDecoded, decodedLength));
+  TEST_ASSERT_EQUAL(3, numDecoded);
+  TEST_ASSERT_EQUAL(length, decodedLength);
+  TEST_ASSERT_EQUAL_MEMORY(macs[1], decoded[1].mac, 6);
+  TEST_ASSERT_EQUAL(DASH_EVENT_CONNECTED, decoded[1].type);
+}
+
+// The layout main.cpp writes: pending events first, then the pipeline state
+// in whatever room is left.
+void test_pending_then_pipeline_state() {
+  CapturedEvent events[CAPTURE_QUEUE_SIZE];
+  memset(events, 0, sizeof(events));
+  for (size_t i = 0; i < CAPTURE_QUEUE_SIZE; i++) {
+    events[i].mac[5] = i;
+  }
+
+  const size_t pendingLength = WarmState::encodePending(events, CAPTURE_QUEUE_SIZE, bytes, sizeof(buffer));
+  TEST_ASSERT_GREATER_THAN(0, pendingLength);
+
+  uint32_t ages[4 * NUM_EVENT_TYPES] = {10, 20, 30, 40, 50, 60, 70, 80};
+  WarmStateHeader header = makeHeader();
+  const size_t length = WarmState::encode(header, ages, 4, NUM_EVENT_TYPES, bytes + pendingLength, sizeof(buffer) - pendingLength);
+  TEST_ASSERT_GREATER_THAN(0, length);
+  TEST_ASSERT_LESS_OR_EQUAL(sizeof(buffer), pendingLength + length);
+
+  const CapturedEvent* decoded;
+  size_t numDecoded;
+  size_t decodedLength;
+  TEST_ASSERT_TRUE(WarmState::decodePending(bytes, sizeof(buffer), decoded, numDecoded, decodedLength));
+  TEST_ASSERT_EQUAL(CAPTURE_QUEUE_SIZE, numDecoded);
+  TEST_ASSERT_EQUAL(CAPTURE_QUEUE_SIZE - 1, decoded[CAPTURE_QUEUE_SIZE - 1].mac[5]);
+
+  WarmStateHeader decodedHeader;
+  const uint32_t* decodedAges;
+  TEST_ASSERT_TRUE(WarmState::decode(bytes + decodedLength, sizeof(buffer) - decodedLength, NUM_EVENT_TYPES, decodedHeader, decodedAges));
+  TEST_ASSERT_EQUAL(header.numDevices, decodedHeader.numDevices);
+  TEST_ASSERT_EQUAL_MEMORY(ages, decodedAges, header.numDevices * NUM_EVENT_TYPES * sizeof(uint32_t));
+}
+
+void test_pending_rejects_corruption() {
+  CapturedEvent events[2];
+  memset(events, 0, sizeof(events));
+
+  const size_t length = WarmState::encodePending(events, 2, bytes, sizeof(buffer));
+  bytes[length - 1] ^= 0x01;
+
+  const CapturedEvent* decoded;
+  size_t numDecoded;
+  size_t decodedLength;
+  TEST_ASSERT_FALSE(WarmState::decodePending(bytes, sizeof(buffer), decoded, numDecoded, decodedLength));
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_round_trip);
+  RUN_TEST(test_devices_that_dont_fit_are_left_out);
+  RUN_TEST(test_rejects_corruption);
+  RUN_TEST(test_pending_round_trip);
+  RUN_TEST(test_pending_then_pipeline_state);
+  RUN_TEST(test_pending_rejects_corruption);
+  return UNITY_END();
+}
@@ -1,23 +1,70 @@
 var FORM_SETTINGS = [
   "admin_username", "admin_password",
   "mqtt_server", "mqtt_topic_pattern", "mqtt_username", "mqtt_password",
+  "mqtt_tls", "mqtt_tls_fingerprint",
   "ap_name", "ap_password",
-  "debounce_threshold_ms"
+  "debounce_threshold_ms", "cluster_claim_window_ms", "fleet_enabled"
 ];
 
+// Not returned by GET /settings. Only sent back when a new value is entered.
+var SECRET_SETTINGS = ["admin_password", "mqtt_password", "ap_password"];
+
 var FORM_SETTINGS_HELP = {
   mqtt_server : "Domain or IP address of MQTT broker. Optionally specify a port " +
     "with (example) mymqqtbroker.com:1884.",
   mqtt_topic_pattern : "Pattern for MQTT topic. Example: " +
-    "dash_stadium/:event_type/:mac_addr. See README for further details."
+    "dash_stadium/:event_type/:mac_addr. See README for further details.",
+  mqtt_tls : "Set to true to connect to the MQTT broker over TLS.",
+  mqtt_tls_fingerprint : "SHA-1 fingerprint of the broker's certificate. If " +
+    "empty, the broker is verified against the CA certificate uploaded to /mqtt_ca.",
+  cluster_claim_window_ms : "When several nodes share an MQTT broker, only the " +
+    "one that hears a press strongest publishes it. Presses heard within this " +
+    "many milliseconds of each other are treated as the same. 0 disables.",
+  fleet_enabled : "Set to true to follow the config published to " +
+    "dash_stadium/fleet/config and dash_stadium/fleet/delta on the MQTT broker."
 }
 
-var webSocket = new WebSocket("ws://" + location.hostname + ":81");
-webSocket.onmessage = function(e) {
-  var data = JSON.parse(e.data);
+var lastEventSeq = 0;
+
+var appendWifiEvent = function(data) {
+  lastEventSeq = data.seq;
+
   var line = "[" + (new Date()).toISOString() + "] event: "
-    + data.event + ", mac: " + data.macAddr + "\n";
+    + data.event + ", mac: " + data.macAddr;
+
+  if (data.vendor) {
+    line += " (" + data.vendor + ")";
+  }
+
+  line += "\n";
   $('.wifi-events').append(line);
+};
+
+var connectWebSocket = function() {
+  // Resume where we left off so events during a reconnect aren't lost.
+  var url = "ws://" + location.hostname + ":81/";
+  if (lastEventSeq > 0) {
+    url += "?since=" + (lastEventSeq + 1);
+  }
+
+  var webSocket = new WebSocket(url);
+  webSocket.onmessage = function(e) {
+    appendWifiEvent(JSON.parse(e.data));
+  };
+  webSocket.onclose = function() {
+    setTimeout(connectWebSocket, 1000);
+  };
+};
+
+// EventSource reconnects and resumes (via Last-Event-ID) on its own, and works
+// when the firmware is built without the WebSocket server.
+if (window.EventSource) {
+  var eventSource = new EventSource('/events/stream');
+  eventSource.onmessage = function(e) {
+    appendWifiEvent(JSON.parse(e.data));
+  };
+} else {
+  connectWebSocket();
 }
 
 var loadSettings = function() {
@@ -40,6 +87,18 @@ var loadSettings = function() {
         deviceForm.append(deviceRow(v[0], v[1]));
       });
     }
+
+    loadDeviceVendors();
+  });
+};
+
+var loadDeviceVendors = function() {
+  $.getJSON('/devices', function(devices) {
+    var rows = $('#monitored-devices tr');
+
+    devices.forEach(function(device, i) {
+      $('.device-vendor', rows.eq(i)).text(device.vendor || '');
+    });
   });
 };
 
@@ -81,6 +140,28 @@ var saveMonitoredDevices = function() {
   }
 };
 
+var loadDiscoveredDevices = function() {
+  $.getJSON('/discovered', function(devices) {
+    var table = $('#discovered-devices').html('');
+
+    devices.forEach(function(device) {
+      var elmt = '<tr>';
+      elmt += '<td>' + device.mac + '</td>';
+      elmt += '<td>' + (device.vendor || '') + '</td>';
+      elmt += '<td>' + device.count + '</td>';
+      elmt += '<td>' + Math.round(device.last_seen_ms_ago / 1000) + 's ago</td>';
+      elmt += '<td>';
+      elmt += '<button class="btn btn-success add-discovered" data-mac="' + device.mac + '">';
+      elmt += '<i class="glyphicon glyphicon-plus"></i>';
+      elmt += '</button>';
+      elmt += '</td>';
+      elmt += '</tr>';
+
+      table.append(elmt);
+    });
+  });
+};
+
 var deviceRow = function(macAddr, alias) {
   var elmt = '<tr>';
   elmt += '<td>';
@@ -89,6 +170,7 @@ var deviceRow = function(macAddr, alias) {
   elmt += '<td>'
   elmt += '<input name="deviceAliases[]" class="form-control" value="' + alias + '"/>';;
   elmt += '</td>';
+  elmt += '<td class="device-vendor"></td>';
   elmt += '<td>';
   elmt += '<button class="btn btn-danger remove-device">';
   elmt += '<i class="glyphicon glyphicon-remove"></i>';
@@ -126,7 +208,7 @@ $(function() {
 
       if (elmt.attr('type') === 'radio') {
         obj[k] = elmt.filter(':checked').val();
-      } else {
+      } else if (SECRET_SETTINGS.indexOf(k) === -1 || elmt.val() !== '') {
         obj[k] = elmt.val();
       }
     });
@@ -163,6 +245,14 @@ $(function() {
     $(this).closest('tr').remove();
   });
 
+  $('#refresh-discovered-btn').click(loadDiscoveredDevices);
+
+  $('body').on('click', '.add-discovered', function() {
+    $('#monitored-devices').append(deviceRow($(this).data('mac'), ''));
+    saveMonitoredDevices();
+    $(this).closest('tr').remove();
+  });
+
   $('#monitored-devices-form').submit(function(e) {
     saveMonitoredDevices();
     e.preventDefault();
@@ -170,4 +260,5 @@ $(function() {
   });
 
   loadSettings();
+  loadDiscoveredDevices();
 });